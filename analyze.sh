@@ -8,7 +8,6 @@ MLQOUT=./output_mlq
 METRIC_CFS=./metrics
 METRIC_MLQ=./metrics_mlq
 PARSER=./tools/parse_cfs.py
-SIM_MLQ=./tools/sim_mlq.py
 
 mkdir -p "$OUTDIR" "$MLQOUT" "$METRIC_CFS" "$METRIC_MLQ"
 # mkdir -p "$MLQOUT" "$METRIC_MLQ"
@@ -21,7 +20,7 @@ for tc in "$TESTDIR"/*.{in}; do
   [[ -e "$tc" ]] || continue
   b=$(basename "$tc")
   out="$OUTDIR/${b%.*}.out"
-  "./$BIN" "$tc" | tee "$out"
+  "./$BIN" --metrics "$METRIC_CFS/${b%.*}.json" "$tc" | tee "$out"
 done
 
 echo "📊 Parsing CFS logs…"
@@ -36,7 +35,7 @@ echo "🚀 Running MLQ testcases…"
 for tc in "$TESTDIR"/*.in; do
   b=$(basename "${tc%.in}")
   out="$MLQOUT/$b.out"
-  python3 "$SIM_MLQ" "$tc" | tee "$out"
+  "./$BIN" --policy=mlq --metrics "$METRIC_MLQ/$b.json" "$tc" | tee "$out"
 done
 
 echo "📊 Parsing MLQ logs…"
@@ -0,0 +1,16 @@
+#ifndef ALLOC_STATS_H
+#define ALLOC_STATS_H
+
+#include <stdint.h>
+
+/*
+ * Heap allocation counter for benchmarking. Builds that define
+ * SIM_COUNT_ALLOCS and link with -Wl,--wrap=malloc,--wrap=calloc,--wrap=realloc
+ * route every allocation through a counting wrapper; other builds report
+ * ALLOC_COUNT_NONE.
+ */
+#define ALLOC_COUNT_NONE UINT64_MAX
+
+uint64_t alloc_count(void);
+
+#endif // ALLOC_STATS_H
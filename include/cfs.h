@@ -1,30 +1,93 @@
-#ifndef CFS_H
-#define CFS_H
-
-#include <stdint.h>
-#include <pthread.h>
-#include "rbtree.h"
-#include "common.h"
-
-#define SCHED_LATENCY_NSEC   200ULL
-#define MIN_GRANULARITY_NSEC 10ULL
-#define WEIGHT_NORM          1024.0
-
-struct cfs_rq {
-    RBTree          *tree;
-    uint64_t         total_weight;
-    pthread_mutex_t  rq_lock;
-};
-
-extern struct cfs_rq cfs_rq;
-
-void     cfs_init_rq(void);
-uint32_t cfs_compute_weight(int nice);
-void     cfs_enqueue(pcb_t *p);
-void     cfs_dequeue(pcb_t *p);
-pcb_t   *cfs_pick_next(void);
-uint64_t cfs_timeslice(pcb_t *p, uint32_t extern_weight);
-void     cfs_update_vruntime(pcb_t *p, uint64_t delta_ns, uint32_t extern_weight);
-void     cfs_task_tick(pcb_t *p, uint64_t elapsed_ns, uint32_t extern_weight);
-
-#endif
+#ifndef CFS_H
+#define CFS_H
+
+#include <stdint.h>
+#include <pthread.h>
+#include "rbtree_intrusive.h"
+#include "common.h"
+
+// Defaults for cfs_tunables
+#define SCHED_LATENCY_NSEC   200ULL
+#define MIN_GRANULARITY_NSEC 10ULL
+#define WAKEUP_GRANULARITY_NSEC 10ULL
+#define WEIGHT_NORM          1024.0     // weight of a nice-0 task
+#define WEIGHT_NORM_SHIFT    10
+
+// vruntime is an integer in units of 2^-VRUNTIME_SHIFT weighted ns.
+#define VRUNTIME_SHIFT       10
+
+// Per-queue memo of 2^64 / weight for the vruntime denominators seen lately.
+#define CFS_INV_CACHE_BITS   5
+#define CFS_INV_CACHE        (1 << CFS_INV_CACHE_BITS)
+
+// Scheduler knobs, set per simulation at run time.
+typedef struct {
+    uint64_t sched_latency;     // period every runnable task should get a slice in
+    uint64_t min_granularity;   // floor for a single slice
+    uint64_t wakeup_granularity;    // lead a woken task needs to preempt
+    uint64_t quantum;           // MLQ slice
+} cfs_tunables;
+
+typedef struct {
+    uint64_t weight;
+    uint64_t inv;               // ceil(2^64 / weight)
+} cfs_inv_weight;
+
+RB_HEAD(cfs_tree, pcb_t);
+
+struct mlq_levels;
+
+// Run-queue of any policy: the tree is CFS's, mlq the MLQ policy's FIFOs.
+struct cfs_rq {
+    struct cfs_tree      tree;
+    uint64_t             total_weight;
+    uint32_t             nr_running;
+    uint64_t             min_vruntime;  // never decreases; floor for placing tasks
+    struct task_group   *tg;            // group owning this queue, NULL for a root queue
+    const cfs_tunables  *tun;
+    cfs_inv_weight       inv_cache[CFS_INV_CACHE];
+    struct mlq_levels   *mlq;           // NULL under CFS
+    pthread_mutex_t      rq_lock;       // held by callers that share the queue between
+                                        // threads (runtime.c); the simulator never takes it
+};
+
+/*
+ * A task group sits in its parent's queue (or the root queue) as one entity
+ * weighted by its shares, and has its own queue of tasks and subgroups.
+ * Picking descends from the root through the leftmost entity of each level,
+ * and running time is charged to the task and every group above it.
+ */
+struct task_group {
+    uint32_t           id;
+    struct task_group *parent;      // NULL for a group directly under the root
+    pcb_t              se;          // entity in the parent queue, weight = shares
+    struct cfs_rq      rq;
+    bool               placed;      // se has been on a queue before
+    uint64_t           cpu_time;    // CPU its tasks and subgroups have had
+    uint64_t           nr_tasks;    // tasks that joined it directly
+};
+
+void     cfs_init_rq(struct cfs_rq *rq, const cfs_tunables *tun);
+void     cfs_destroy_rq(struct cfs_rq *rq);
+uint32_t cfs_compute_weight(int nice);
+void     cfs_enqueue(struct cfs_rq *rq, pcb_t *p);
+void     cfs_dequeue(struct cfs_rq *rq, pcb_t *p);
+pcb_t   *cfs_pick_next(struct cfs_rq *rq);
+uint64_t cfs_timeslice(struct cfs_rq *rq, pcb_t *p, uint32_t extern_weight);
+uint64_t cfs_timeslice_range(const struct cfs_rq *rq, const pcb_t *p, uint64_t total,
+                             uint64_t cap, uint64_t *lo, uint64_t *hi);
+uint64_t cfs_calc_delta(struct cfs_rq *rq, uint64_t delta_ns, uint64_t weight);
+void     cfs_update_vruntime(struct cfs_rq *rq, pcb_t *p, uint64_t delta_ns, uint32_t extern_weight);
+void     cfs_place_entity(struct cfs_rq *rq, pcb_t *p);
+void     cfs_place_wakeup(struct cfs_rq *rq, pcb_t *p);
+bool     cfs_wakeup_preempt(struct cfs_rq *rq, const pcb_t *curr, const pcb_t *p);
+void     cfs_move(struct cfs_rq *src, struct cfs_rq *dst, pcb_t *p);
+void     cfs_task_tick(struct cfs_rq *rq, pcb_t *p, uint64_t elapsed_ns, uint32_t extern_weight);
+// vruntime of the entity standing for p in the root queue: p or its top group.
+uint64_t cfs_top_vruntime(const pcb_t *p);
+
+void     cfs_group_init(struct task_group *tg, uint32_t id, uint32_t shares,
+                        struct task_group *parent, struct cfs_rq *root);
+void     cfs_group_destroy(struct task_group *tg);
+
+#endif
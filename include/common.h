@@ -1,24 +1,80 @@
-#ifndef COMMON_H
-#define COMMON_H
-
-#include <stdint.h>
-
-//Simplify pcb_t for CFS_SCHED
-
-
-typedef struct pcb_t {
-    uint32_t pid;
-    double    vruntime;
-    uint32_t weight;
-} pcb_t;
-
-typedef struct cpu {
-    uint32_t cpu_id;
-    uint32_t running_time;
-    pcb_t* running_process;
-    uint32_t last_dispatch;
-} cpu_t;
-
-
-
-#endif
+#ifndef COMMON_H
+#define COMMON_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include "rbtree_intrusive.h"
+
+//Simplify pcb_t for CFS_SCHED
+
+struct cfs_rq;
+struct event_node;
+struct task_group;
+
+typedef struct pcb_t {
+    uint32_t pid;
+    uint64_t vruntime;      // fixed point, see VRUNTIME_SHIFT
+    uint32_t weight;
+    struct cfs_rq *rq;      // run-queue the task was last enqueued on
+    union {
+        RB_ENTRY(struct pcb_t) run_node;    // CFS tree
+        struct {
+            struct pcb_t *prev, *next;
+        } fifo;                             // MLQ level
+    };
+    bool     on_rq;
+    uint64_t seq;           // position in the input, orders same-time arrivals
+    uint64_t arrival;
+    int64_t  remain;        // CPU time still needed
+    uint64_t time_slice;    // length of the current dispatch
+    uint64_t burst;         // total CPU time requested
+    uint64_t first_run;     // time of first dispatch, UINT64_MAX until then
+    uint32_t nr_dispatch;   // times the task was put on a CPU
+    int32_t  nice;
+
+    // A group's entity in its parent queue is a pcb_t too, with my_q set.
+    struct task_group *group;   // group the entity is queued in, NULL for the root
+    struct cfs_rq *my_q;        // queue a group entity stands for, NULL for tasks
+
+    // Phases: run `run` ns of CPU, block `block` ns, repeat. run == 0: one phase.
+    uint64_t run;
+    uint64_t block;
+    uint64_t phase_left;    // CPU time left in the current run phase
+    uint64_t io_time;       // total time spent blocked on I/O
+    int32_t  lock;          // lock held for every run phase, -1 for none
+    bool     holds_lock;
+    struct pcb_t *wait_next;    // next waiter on the same lock
+
+    uint64_t wake_time;     // last wakeup, UINT64_MAX once the task ran after it
+    uint32_t nr_wakeups;
+    uint64_t wake_sum;      // wakeup-to-run latency, summed over wakeups
+    uint64_t wake_max;
+
+    uint32_t last_cpu;      // CPU of the last dispatch, 0 before the first
+    uint64_t mig_cost;      // cache warm-up paid after moving between CPUs
+} pcb_t;
+
+typedef struct cpu {
+    uint32_t cpu_id;
+    uint64_t running_time;
+    pcb_t* running_process;
+    uint64_t last_dispatch;
+    uint64_t warmup;        // migration cost the running stint pays before it gets work done
+    struct cfs_rq *rq;      // own queue, or the shared cfs_rq
+    size_t heap_idx;        // slot in cpu_m.cpu_heap, HEAP_NONE while running
+    struct event_node *end_ev;  // pending EVENT_END/EVENT_SLEEP of the running task
+    uint64_t slice_lo;      // total weights over which the running stint's
+    uint64_t slice_hi;      // length stays what it was computed as
+    size_t slice_lo_idx;    // slots in cpu_manager.slice_lo / slice_hi
+    size_t slice_hi_idx;
+    struct cpu *young_prev; // cpu_manager.young list, while not yet preemptible
+    struct cpu *young_next;
+    bool young;
+    size_t victim_idx;      // slot in cpu_manager.victims once preemptible
+    uint64_t victim_vruntime;   // root-level vruntime of the task, as of its dispatch
+} cpu_t;
+
+
+
+#endif
@@ -1,37 +1,152 @@
-#include "common.h"
-#include "heap.h"
-
-typedef struct {
-    cpu_t* cpu_list;
-    heap_t cpu_heap;
-    uint32_t total_weight_proc;
-    int n;
-} cpu_manager;
-
-//Dùng cpu ít sử dụng nhất
-static int cpu_freecmp(const void *a, const void *b) {
-    const cpu_t *c1 = *(const cpu_t **)a;
-    const cpu_t *c2 = *(const cpu_t **)b;
-
-    if (c1->running_time < c2->running_time) return -1;
-    if (c1->running_time > c2->running_time) return  1;
-
-    if (c1->cpu_id < c2->cpu_id) return -1;  
-    if (c1->cpu_id > c2->cpu_id) return  1;
-
-    return 0;
-}
-
-extern cpu_manager cpu_m;
-
-void   cpu_init(int n);
-cpu_t *cpu_peek(void);
-cpu_t *cpu_pop(void);
-int    cpu_dispatch(pcb_t* p, int current_time);
-int    cpu_release(cpu_t* c, int current_time);
-
-
-
-
-
-
+#ifndef CPU_H
+#define CPU_H
+
+#include <stdbool.h>
+#include "common.h"
+#include "heap_typed.h"
+#include "cfs.h"
+#include "policy.h"
+#include "trace.h"
+#include "topology.h"
+
+// Simulated time between two periodic load-balancing passes (per-CPU queues only).
+#define LOAD_BALANCE_INTERVAL_NSEC 400ULL
+
+//Dùng cpu ít sử dụng nhất
+static inline int cpu_freecmp(const cpu_t *c1, const cpu_t *c2) {
+    if (c1->running_time < c2->running_time) return -1;
+    if (c1->running_time > c2->running_time) return  1;
+
+    if (c1->cpu_id < c2->cpu_id) return -1;  
+    if (c1->cpu_id > c2->cpu_id) return  1;
+
+    return 0;
+}
+
+// Idle CPUs, least used on top
+HEAP_HEAD(cpu_heap, cpu_t);
+HEAP_GENERATE(cpu_heap, cpu_t, heap_idx, cpu_freecmp)
+
+// Running CPUs by the bounds of their slice range: highest slice_lo on top of
+// one heap, lowest slice_hi on top of the other.
+static inline int cpu_slice_lo_cmp(const cpu_t *c1, const cpu_t *c2) {
+    if (c1->slice_lo != c2->slice_lo) return c1->slice_lo > c2->slice_lo ? -1 : 1;
+    return c1->cpu_id < c2->cpu_id ? -1 : c1->cpu_id > c2->cpu_id;
+}
+
+static inline int cpu_slice_hi_cmp(const cpu_t *c1, const cpu_t *c2) {
+    if (c1->slice_hi != c2->slice_hi) return c1->slice_hi < c2->slice_hi ? -1 : 1;
+    return c1->cpu_id < c2->cpu_id ? -1 : c1->cpu_id > c2->cpu_id;
+}
+
+HEAP_HEAD(cpu_slice_lo, cpu_t);
+HEAP_GENERATE(cpu_slice_lo, cpu_t, slice_lo_idx, cpu_slice_lo_cmp)
+HEAP_HEAD(cpu_slice_hi, cpu_t);
+HEAP_GENERATE(cpu_slice_hi, cpu_t, slice_hi_idx, cpu_slice_hi_cmp)
+
+// Preemptible running CPUs, largest vruntime (then highest id) on top.
+static inline int cpu_victim_cmp(const cpu_t *c1, const cpu_t *c2) {
+    uint64_t v1 = c1->victim_vruntime, v2 = c2->victim_vruntime;
+    if (v1 != v2) return v1 > v2 ? -1 : 1;
+    return c1->cpu_id > c2->cpu_id ? -1 : c1->cpu_id < c2->cpu_id;
+}
+
+HEAP_HEAD(cpu_victims, cpu_t);
+HEAP_GENERATE(cpu_victims, cpu_t, victim_idx, cpu_victim_cmp)
+
+typedef struct {
+    cpu_t* cpu_list;
+    struct cpu_heap cpu_heap;
+    uint64_t *idle_mask;        // bit i set while cpu_list[i] is idle; padding bits stay set
+    uint32_t total_weight_proc;
+    int n;
+    bool per_cpu_rq;            // one cfs_rq per CPU instead of the shared cfs_rq
+    struct cfs_rq *rqs;         // per-CPU queues, NULL in shared mode
+    uint64_t nr_migrations;
+    uint64_t last_balance;
+    struct cfs_rq *shared_rq;   // queue of every CPU unless per_cpu_rq
+    const sched_policy *pol;    // policy of every queue
+    trace_t *trace;             // migrations are logged here
+    struct cpu_slice_lo slice_lo;   // running CPUs, shared queue only
+    struct cpu_slice_hi slice_hi;
+    cpu_t **stale;              // scratch for cpu_slice_stale()
+    cpu_t *young_head;          // running CPUs not preemptible yet, in dispatch
+    cpu_t *young_tail;          // order (shared queue only)
+    struct cpu_victims victims;
+    cpu_topology topo;
+    bool affinity;              // place and balance by distance to a task's last CPU
+} cpu_manager;
+
+void   cpu_init(cpu_manager *cm, int n, bool per_cpu_rq, struct cfs_rq *shared_rq,
+                const sched_policy *pol, const cfs_tunables *tun,
+                const cpu_topology *topo, bool affinity, trace_t *trace);
+void   cpu_destroy(cpu_manager *cm);
+cpu_t *cpu_peek(cpu_manager *cm);
+cpu_t *cpu_pop(cpu_manager *cm);
+void   cpu_push(cpu_manager *cm, cpu_t *c);
+int    cpu_dispatch(cpu_manager *cm, pcb_t* p, uint64_t current_time);
+int    cpu_dispatch_on(cpu_manager *cm, cpu_t *c, pcb_t *p, uint64_t current_time);
+int    cpu_release(cpu_manager *cm, cpu_t* c, uint64_t ran);
+void   cpu_account(cpu_manager *cm, cpu_t *c, uint64_t ran);
+// Put idle c back in a recorded running state (snapshots): p dispatched at
+// last_dispatch, still young or already a preemption candidate. Young CPUs
+// go in dispatch order.
+void   cpu_restore(cpu_manager *cm, cpu_t *c, pcb_t *p, uint64_t last_dispatch,
+                   uint64_t victim_vruntime, bool young);
+
+// Index of the first running CPU at or after i, or cm->n if there is none.
+static inline int cpu_next_busy(const cpu_manager *cm, int i) {
+    if (i >= cm->n) return cm->n;
+    int w = i >> 6;
+    uint64_t busy = ~cm->idle_mask[w] & (~0ULL << (i & 63));
+    while (!busy) {
+        if (++w << 6 >= cm->n) return cm->n;
+        busy = ~cm->idle_mask[w];
+    }
+    return (w << 6) + __builtin_ctzll(busy);
+}
+
+#define cpu_for_each_busy(cm, i) \
+    for (int i = cpu_next_busy(cm, 0); i < (cm)->n; i = cpu_next_busy(cm, i + 1))
+
+// Index of the first idle CPU at or after i, or cm->n if there is none.
+static inline int cpu_next_idle(const cpu_manager *cm, int i) {
+    if (i >= cm->n) return cm->n;
+    int w = i >> 6;
+    uint64_t idle = cm->idle_mask[w] & (~0ULL << (i & 63));
+    while (!idle) {
+        if (++w << 6 >= cm->n) return cm->n;
+        idle = cm->idle_mask[w];
+    }
+    i = (w << 6) + __builtin_ctzll(idle);
+    return i < cm->n ? i : cm->n;     // padding bits are set too
+}
+
+#define cpu_for_each_idle(cm, i) \
+    for (int i = cpu_next_idle(cm, 0); i < (cm)->n; i = cpu_next_idle(cm, i + 1))
+
+// Record the total-weight range over which the stint running on c keeps its length.
+void   cpu_slice_set(cpu_manager *cm, cpu_t *c, uint64_t lo, uint64_t hi);
+// Running CPUs whose range excludes total, in CPU order (shared queue only).
+// They stay out of the range heaps until cpu_slice_set() is called again.
+int    cpu_slice_stale(cpu_manager *cm, uint64_t total, cpu_t ***out);
+
+// Running CPU with the largest vruntime that has run for at least min_gran
+// by now, or NULL (shared queue only).
+cpu_t *cpu_preempt_victim(cpu_manager *cm, uint64_t now, uint64_t min_gran);
+
+// Weight the CFS formulas see besides the queued tasks: all running tasks when
+// the queue is shared, only the task on c when every CPU has its own queue.
+uint32_t cpu_extern_weight(const cpu_manager *cm, const cpu_t *c);
+
+// Idle CPU to run p on (shared queue): with affinity, the one it last ran
+// on or the least used idle CPU in the closest domain around it; otherwise,
+// or when no CPU of its node is idle, fallback.
+cpu_t *cpu_affine_idle(cpu_manager *cm, const pcb_t *p, cpu_t *fallback);
+
+// Load balancing (no-ops in shared mode).
+struct cfs_rq *cpu_select_rq(cpu_manager *cm, const pcb_t *p);
+pcb_t *cpu_idle_balance(cpu_manager *cm, cpu_t *c, uint64_t now);
+int    cpu_load_balance(cpu_manager *cm, uint64_t now);
+
+#endif
@@ -1,30 +1,90 @@
-#ifndef EVENT_TREE_H
-#define EVENT_TREE_H
-
-#include <stdbool.h>
-#include <stdint.h>
-#include "common.h"
-#include "rbtree.h"
-
-typedef enum { EVENT_ARRIVAL, EVENT_END } event_type;
-
-typedef struct {
-    event_type ev;
-    uint64_t   time;
-    pcb_t      *proc;
-    cpu_t      *cpu;
-} event_t;
-
-typedef struct {
-    RBTree *tree;
-} event_tree;
-
-
-void event_tree_init(event_tree *et);
-void event_tree_destroy(event_tree *et);
-void event_tree_insert(event_tree *et, const event_t *ev);
-bool event_tree_peek(const event_tree *et, event_t *out_ev);
-bool event_tree_pop(event_tree *et, event_t *out_ev);
-int event_delete(event_tree *et, const event_t *to_del);
-
-#endif // EVENT_TREE_H
+#ifndef EVENT_TREE_H
+#define EVENT_TREE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "common.h"
+#include "rbtree_intrusive.h"
+
+/*
+ * EVENT_END closes a stint at the end of its slice, EVENT_SLEEP at the end
+ * of its run phase; EVENT_WAKEUP makes a blocked task runnable again.
+ */
+typedef enum { EVENT_ARRIVAL, EVENT_END, EVENT_SLEEP, EVENT_WAKEUP } event_type;
+
+typedef struct {
+    event_type ev;
+    uint64_t   time;
+    pcb_t      *proc;
+    cpu_t      *cpu;
+} event_t;
+
+// Which structure orders the pending events.
+typedef enum {
+    EVQ_WHEEL,      // hierarchical timing wheel, O(1) schedule/cancel
+    EVQ_RBTREE      // red-black tree, kept as the reference ordering
+} evq_backend;
+
+struct wheel_slot;
+
+// Queued copy of an event; the queue links live in the record itself.
+typedef struct event_node {
+    event_t ev;
+    union {
+        RB_ENTRY(struct event_node) link;
+        struct {
+            struct event_node *next;
+            struct event_node *prev;
+            struct wheel_slot *slot;
+        } wl;
+    };
+} event_node;
+
+// Returned by event_tree_insert; valid until the event is popped or cancelled.
+typedef event_node *event_handle;
+
+RB_HEAD(event_rb, event_node);
+
+#define WHEEL_BITS   6
+#define WHEEL_SLOTS  (1 << WHEEL_BITS)
+#define WHEEL_LEVELS 11                 // 11 * 6 bits cover a 64-bit time
+
+struct wheel_slot {
+    event_node *head;
+    bool        sorted;                 // only level-0 slots are ever sorted
+    uint8_t     level;
+    uint8_t     index;
+};
+
+typedef struct {
+    struct wheel_slot slots[WHEEL_LEVELS][WHEEL_SLOTS];
+    uint64_t          occupied[WHEEL_LEVELS];  // bit i set when slots[l][i] is non-empty
+    uint64_t          now;                     // time of the last popped event
+    event_node       *min_cache;               // earliest event while level 0 is empty
+} timing_wheel;
+
+typedef struct event_chunk event_chunk;
+
+typedef struct {
+    evq_backend     backend;
+    struct event_rb tree;
+    timing_wheel   *wheel;
+    size_t          count;
+    event_node     *free_list;   // recycled records, chained through link.rbe_right
+    event_chunk    *chunks;      // slabs the records are carved from
+} event_tree;
+
+
+void event_tree_init(event_tree *et, evq_backend backend);
+void event_tree_destroy(event_tree *et);
+event_handle event_tree_insert(event_tree *et, const event_t *ev);
+bool event_tree_peek(event_tree *et, event_t *out_ev);
+bool event_tree_pop(event_tree *et, event_t *out_ev);
+int event_delete(event_tree *et, const event_t *to_del);
+void event_cancel(event_tree *et, event_handle h);
+void event_move(event_tree *et, event_handle h, uint64_t new_time);
+// Call fn on every pending event, in no particular order.
+void event_tree_walk(const event_tree *et, void (*fn)(const event_t *ev, void *arg), void *arg);
+
+#endif // EVENT_TREE_H
@@ -0,0 +1,124 @@
+// heap_typed.h
+#ifndef HEAP_TYPED_H
+#define HEAP_TYPED_H
+
+/*
+ * Binary min-heap of element pointers, generated per element type.
+ *
+ * Each element stores its own slot index (a size_t member named by `field`),
+ * which acts as a stable handle: remove() and update() after a key change
+ * are O(log n) without searching. Moves are plain pointer assignments; the
+ * only allocation is array growth in push().
+ *
+ *     typedef struct job { int prio; size_t hidx; } job;
+ *     static inline int job_cmp(const job *a, const job *b) { ... }
+ *     HEAP_HEAD(job_heap, job);
+ *     HEAP_GENERATE(job_heap, job, hidx, job_cmp)
+ */
+
+#include <stdlib.h>
+#include <stddef.h>
+
+#define HEAP_NONE ((size_t)-1)      // handle value of an element not in a heap
+
+#define HEAP_HEAD(name, type)                                                 \
+struct name {                                                                 \
+    type  **data;                                                             \
+    size_t  size;                                                             \
+    size_t  capacity;                                                         \
+}
+
+#define HEAP_GENERATE(name, type, field, cmp)                                 \
+                                                                              \
+static inline int name##_init(struct name *h, size_t capacity) {              \
+    h->data = capacity ? malloc(capacity * sizeof(type *)) : NULL;            \
+    if (capacity && !h->data) return -1;                                      \
+    h->size = 0;                                                              \
+    h->capacity = capacity;                                                   \
+    return 0;                                                                 \
+}                                                                             \
+                                                                              \
+static inline void name##_free(struct name *h) {                              \
+    free(h->data);                                                            \
+    h->data = NULL;                                                           \
+    h->size = h->capacity = 0;                                                \
+}                                                                             \
+                                                                              \
+static inline void name##_set(struct name *h, size_t i, type *e) {            \
+    h->data[i] = e;                                                           \
+    e->field = i;                                                             \
+}                                                                             \
+                                                                              \
+static inline void name##_sift_up(struct name *h, size_t i) {                 \
+    type *e = h->data[i];                                                     \
+    while (i > 0) {                                                           \
+        size_t parent = (i - 1) >> 1;                                         \
+        if (cmp(h->data[parent], e) <= 0) break;                              \
+        name##_set(h, i, h->data[parent]);                                    \
+        i = parent;                                                           \
+    }                                                                         \
+    name##_set(h, i, e);                                                      \
+}                                                                             \
+                                                                              \
+static inline void name##_sift_down(struct name *h, size_t i) {               \
+    type *e = h->data[i];                                                     \
+    while (1) {                                                               \
+        size_t child = 2 * i + 1;                                             \
+        if (child >= h->size) break;                                          \
+        if (child + 1 < h->size && cmp(h->data[child + 1], h->data[child]) < 0) \
+            child++;                                                          \
+        if (cmp(h->data[child], e) >= 0) break;                               \
+        name##_set(h, i, h->data[child]);                                     \
+        i = child;                                                            \
+    }                                                                         \
+    name##_set(h, i, e);                                                      \
+}                                                                             \
+                                                                              \
+static inline int name##_push(struct name *h, type *e) {                      \
+    if (h->size == h->capacity) {                                             \
+        size_t newcap = h->capacity ? h->capacity * 2 : 1;                    \
+        type **newdata = realloc(h->data, newcap * sizeof(type *));           \
+        if (!newdata) return -1;                                              \
+        h->data = newdata;                                                    \
+        h->capacity = newcap;                                                 \
+    }                                                                         \
+    h->data[h->size] = e;                                                     \
+    name##_sift_up(h, h->size++);                                             \
+    return 0;                                                                 \
+}                                                                             \
+                                                                              \
+static inline type *name##_peek(const struct name *h) {                       \
+    return h->size ? h->data[0] : NULL;                                       \
+}                                                                             \
+                                                                              \
+static inline int name##_contains(const type *e) {                            \
+    return e->field != HEAP_NONE;                                             \
+}                                                                             \
+                                                                              \
+/* Remove e wherever it sits; -1 if it is not in the heap. */                 \
+static inline int name##_remove(struct name *h, type *e) {                    \
+    size_t i = e->field;                                                      \
+    if (i == HEAP_NONE || i >= h->size || h->data[i] != e) return -1;         \
+    e->field = HEAP_NONE;                                                     \
+    if (i == --h->size) return 0;                                             \
+    type *moved = h->data[h->size];                                           \
+    name##_set(h, i, moved);                                                  \
+    name##_sift_down(h, i);                                                   \
+    name##_sift_up(h, moved->field);                                          \
+    return 0;                                                                 \
+}                                                                             \
+                                                                              \
+static inline type *name##_pop(struct name *h) {                              \
+    type *top = name##_peek(h);                                               \
+    if (top) name##_remove(h, top);                                           \
+    return top;                                                               \
+}                                                                             \
+                                                                              \
+/* Restore order after e's key changed in either direction. */                \
+static inline void name##_update(struct name *h, type *e) {                   \
+    if (e->field == HEAP_NONE) return;                                        \
+    name##_sift_up(h, e->field);                                              \
+    name##_sift_down(h, e->field);                                            \
+}
+
+#endif // HEAP_TYPED_H
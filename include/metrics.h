@@ -0,0 +1,88 @@
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include "common.h"
+#include "cpu.h"
+
+/*
+ * Per-task and aggregate metrics, computed as the simulation runs so a
+ * log never has to be parsed afterwards. Memory is constant in the number
+ * of tasks: each finished task is folded into running sums and streaming
+ * histograms and, optionally, one CSV row.
+ */
+
+// Log-linear histogram: exact below 2^HIST_SUB_BITS, then 2^HIST_SUB_BITS
+// buckets per power of two (relative error under 1 / 2^HIST_SUB_BITS).
+#define HIST_SUB_BITS 4
+#define HIST_SUB      (1u << HIST_SUB_BITS)
+#define HIST_BUCKETS  ((64 - HIST_SUB_BITS + 1) * HIST_SUB)
+
+typedef struct {
+    uint64_t count;
+    uint64_t max;
+    double   sum;
+    uint64_t buckets[HIST_BUCKETS];
+} histogram_t;
+
+void     hist_add(histogram_t *h, uint64_t v);
+void     hist_merge(histogram_t *dst, const histogram_t *src);
+uint64_t hist_percentile(const histogram_t *h, double q);    // q in [0, 1]
+double   hist_mean(const histogram_t *h);
+
+// The percentiles every report prints, and their names there.
+#define HIST_NUM_PCT 4
+extern const double      hist_pct_q[HIST_NUM_PCT];
+extern const char *const hist_pct_name[HIST_NUM_PCT];
+
+// CPU a task group got over the run, its subgroups included.
+typedef struct {
+    uint32_t id;
+    uint32_t parent;
+    uint32_t shares;
+    uint64_t tasks;
+    uint64_t cpu_time;
+} metrics_group;
+
+typedef struct {
+    histogram_t response;       // first dispatch - arrival
+    histogram_t waiting;        // turnaround - burst - time asleep on I/O
+    histogram_t turnaround;     // finish - arrival
+    histogram_t wakeup;         // dispatch - wakeup, one sample per wakeup
+    histogram_t *wakeup_by_nice[40];    // index nice + 20, allocated on first use
+    uint64_t    lock_waits;     // times a picked task found its lock taken
+    uint64_t    tasks;
+    uint64_t    events;         // events popped from the event queue
+    uint64_t    context_switches;
+    uint64_t    dispatch_distance[TOPO_LEVELS]; // redispatches by distance from the last CPU
+    uint64_t    migration_cost;     // total cache warm-up charged
+    double      fair_sum;       // Σ x, x = weight-normalised service rate
+    double      fair_sum_sq;    // Σ x²
+    FILE       *task_csv;       // per-task rows, NULL if not requested
+    char       *task_csv_buf;
+
+    // filled by metrics_end()
+    uint64_t    makespan;
+    int         num_cpu;
+    uint64_t   *cpu_busy;
+    uint64_t    migrations;
+    metrics_group *groups;      // filled by metrics_groups()
+    uint32_t    num_groups;
+} metrics_t;
+
+void metrics_init(metrics_t *m, const char *task_csv_path);
+void metrics_dispatch(metrics_t *m, pcb_t *p, uint64_t now);
+void metrics_finish(metrics_t *m, const pcb_t *p, uint64_t now);
+void metrics_end(metrics_t *m, const cpu_manager *cm, uint64_t now);
+// metrics_end() without a cpu_manager: sets makespan and num_cpu and a zeroed
+// cpu_busy for the caller to fill in.
+void metrics_end_busy(metrics_t *m, int num_cpu, uint64_t now);
+void metrics_groups(metrics_t *m, const struct task_group *groups, uint32_t n);
+// JSON unless path ends in ".csv"; "-" writes to stdout.
+void metrics_report(const metrics_t *m, const char *path);
+double metrics_avg_utilization(const metrics_t *m);
+double metrics_jain(const metrics_t *m);     // 1 = perfectly weight-fair
+void metrics_destroy(metrics_t *m);
+
+#endif // METRICS_H
@@ -0,0 +1,61 @@
+#ifndef OPREC_H
+#define OPREC_H
+
+#include <stdint.h>
+
+/*
+ * Container operation recorder. Builds that define SIM_RECORD_OPS (make
+ * simulate_cfs_record) log every operation on the run queues, the event
+ * queue and the idle-CPU heap to the file given with --record-ops, for
+ * tools/ds_bench.c to replay against other containers. In other builds
+ * OPREC() expands to nothing and oprec_open() refuses.
+ *
+ * File: an oprec_header, then oprec records in the order the simulator
+ * made the calls. Elements and queue instances are numbered densely in the
+ * order they first show up; a number is reused once its address is.
+ */
+#define OPREC_MAGIC   "CFSOPS"
+#define OPREC_VERSION 1
+
+typedef enum {
+    OPQ_RUN,        // cfs_rq trees (shared, per-CPU and group queues)
+    OPQ_EVENT,      // event_tree
+    OPQ_CPU,        // idle-CPU heap
+    OPQ_KINDS
+} opq_kind;
+
+typedef enum {
+    OP_INSERT,
+    OP_ERASE,
+    OP_POP_MIN,     // id: the element removed
+    OP_MIN,         // id: the element found
+    OP_UPDATE,      // key and tie are the new ones
+} op_type;
+
+typedef struct {
+    char     magic[8];
+    uint32_t version;
+    uint32_t rec_size;
+} oprec_header;
+
+typedef struct {
+    uint8_t  kind;      // opq_kind
+    uint8_t  op;        // op_type
+    uint16_t queue;     // instance of that kind
+    uint32_t id;        // element
+    uint64_t key;
+    uint64_t tie;       // orders equal keys exactly as the simulator does
+} oprec;
+
+void oprec_open(const char *path);
+void oprec_close(void);
+
+#ifdef SIM_RECORD_OPS
+void oprec_log(opq_kind kind, op_type op, const void *queue, const void *elem,
+               uint64_t key, uint64_t tie);
+#define OPREC(kind, op, queue, elem, key, tie) oprec_log(kind, op, queue, elem, key, tie)
+#else
+#define OPREC(kind, op, queue, elem, key, tie) ((void)0)
+#endif
+
+#endif // OPREC_H
@@ -0,0 +1,52 @@
+#ifndef POLICY_H
+#define POLICY_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "common.h"
+#include "cfs.h"
+
+/*
+ * Scheduling policy: how a run-queue orders its tasks, how long a picked
+ * task runs and what running does to its place in line. The event loop and
+ * the load balancer only reach a queue through one of these, so every
+ * simulation can run its own. A policy keeps total_weight, nr_running and
+ * the tasks' rq / on_rq current; load balancing relies on them.
+ */
+typedef struct sched_policy {
+    const char *name;
+    bool        groups;         // supports task groups
+    bool        preemptive;     // arrivals and wakeups may take a running task's CPU
+
+    void     (*init_rq)(struct cfs_rq *rq, const cfs_tunables *tun);
+    void     (*destroy_rq)(struct cfs_rq *rq);
+    // Queue a task that arrives (wakeup false) or wakes up from a block.
+    void     (*enqueue)(struct cfs_rq *rq, pcb_t *p, bool wakeup);
+    void     (*dequeue)(struct cfs_rq *rq, pcb_t *p);
+    pcb_t   *(*pick_next)(struct cfs_rq *rq);
+    // Length of p's next stint for a queued-plus-extern weight of total,
+    // capped at cap, and the range [*lo, *hi] of totals it holds over.
+    uint64_t (*timeslice)(const struct cfs_rq *rq, const pcb_t *p, uint64_t total,
+                          uint64_t cap, uint64_t *lo, uint64_t *hi);
+    // Charge a finished stint of ran ns to p and queue it again.
+    void     (*tick)(struct cfs_rq *rq, pcb_t *p, uint64_t ran, uint32_t extern_weight);
+    // Move a queued task to another queue.
+    void     (*move)(struct cfs_rq *src, struct cfs_rq *dst, pcb_t *p);
+    // Should woken p take the CPU from curr? Only asked of preemptive policies.
+    bool     (*wakeup_preempt)(struct cfs_rq *rq, const pcb_t *curr, const pcb_t *p);
+    // Visit the queued tasks in an order that enqueue() into an empty queue
+    // puts back exactly as it was (snapshots).
+    void     (*for_each)(struct cfs_rq *rq, void (*fn)(pcb_t *p, void *arg), void *arg);
+} sched_policy;
+
+// MLQ: one FIFO per nice level, lowest nice first, round robin by quantum.
+#define MLQ_LEVELS        40
+#define MLQ_QUANTUM_NSEC  200ULL
+
+extern const sched_policy cfs_policy;
+extern const sched_policy mlq_policy;
+
+// Policy by name ("cfs", "mlq"), NULL if there is none.
+const sched_policy *policy_find(const char *name);
+
+#endif // POLICY_H
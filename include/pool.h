@@ -0,0 +1,49 @@
+#ifndef POOL_H
+#define POOL_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <pthread.h>
+
+/*
+ * Fixed-size work-stealing thread pool for coarse jobs (whole simulations).
+ * Jobs are spread round-robin over per-worker deques; a worker takes its
+ * newest job first and, when its own deque is empty, steals the oldest job
+ * of another worker.
+ */
+
+typedef void (*pool_fn)(void *arg);
+
+typedef struct {
+    pool_fn  fn;
+    void    *arg;
+} pool_job;
+
+typedef struct {
+    pthread_mutex_t lock;
+    pool_job       *jobs;       // ring of cap slots
+    size_t          head;       // oldest job, taken by thieves
+    size_t          size;
+    size_t          cap;
+} pool_deque;
+
+typedef struct {
+    int              nthreads;
+    pthread_t       *threads;
+    pool_deque      *deques;
+    pthread_mutex_t  lock;      // guards the counters below
+    pthread_cond_t   work_cv;   // queued > 0 or shutdown
+    pthread_cond_t   done_cv;   // pending == 0
+    size_t           queued;    // jobs sitting in some deque
+    size_t           pending;   // jobs submitted and not finished
+    size_t           next;      // deque the next submit goes to
+    bool             shutdown;
+} pool_t;
+
+int  pool_default_threads(void);
+void pool_init(pool_t *p, int nthreads);
+void pool_submit(pool_t *p, pool_fn fn, void *arg);
+void pool_wait(pool_t *p);      // until every submitted job has finished
+void pool_destroy(pool_t *p);
+
+#endif // POOL_H
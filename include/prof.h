@@ -0,0 +1,70 @@
+#ifndef PROF_H
+#define PROF_H
+
+#include <stdint.h>
+
+/*
+ * Hot-path profiler. Builds that define SIM_PROFILE (make simulate_cfs_prof)
+ * time each phase of the event loop into log-linear histograms and count
+ * run-queue and event-queue operations; --profile=FILE writes the lot as
+ * JSON when the run is over. In other builds PROF_START/PROF_STOP/PROF_COUNT
+ * expand to nothing and prof_open() refuses.
+ *
+ * Phases are timed with the TSC where there is one (scaled to ns against
+ * CLOCK_MONOTONIC over the run), else with clock_gettime().
+ *
+ * The histograms and counters are per thread, so sweep and runtime workers
+ * in this build do not race on them; the report covers the thread that
+ * called prof_open(), which runs the one simulation --profile allows.
+ */
+
+typedef enum {
+    PH_POP,         // event_tree_pop of the next event
+    PH_BALANCE,     // periodic load balance, per-CPU queues only
+    PH_ENTER,       // Step 1: enqueue everything arriving or waking at t
+    PH_RESLICE,     // Step 2: restart or move stints whose slice changed
+    PH_DISPATCH,    // Step 2: hand queued work to idle CPUs
+    PH_PREEMPT,     // Step 3: victim searches and preemptions
+    PH_VICTIM,      // one victim search, inside PH_PREEMPT
+    PH_END,         // END/SLEEP handling and the dispatch that follows
+    PROF_PHASES
+} prof_phase;
+
+typedef enum {
+    PROF_RQ_INSERT,
+    PROF_RQ_ERASE,
+    PROF_EV_INSERT,
+    PROF_EV_POP,
+    PROF_EV_CANCEL,
+    PROF_EV_MOVE,
+    PROF_RB_ROTATE,     // both red-black trees
+    PROF_WHEEL_CASCADE, // timing-wheel slots moved down a level
+    PROF_COUNTERS
+} prof_counter;
+
+void prof_open(const char *path);
+void prof_close(void);      // writes the report
+
+#ifdef SIM_PROFILE
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+static inline uint64_t prof_ticks(void) { return __rdtsc(); }
+#else
+uint64_t prof_ticks(void);
+#endif
+
+extern _Thread_local uint64_t prof_counters[PROF_COUNTERS];
+
+void prof_phase_add(prof_phase ph, uint64_t ticks);
+
+#define PROF_START(ph) uint64_t prof_t0_##ph = prof_ticks()
+#define PROF_STOP(ph)  prof_phase_add(ph, prof_ticks() - prof_t0_##ph)
+#define PROF_COUNT(c)  (prof_counters[c]++)
+#else
+#define PROF_START(ph) ((void)0)
+#define PROF_STOP(ph)  ((void)0)
+#define PROF_COUNT(c)  ((void)0)
+#endif
+
+#endif // PROF_H
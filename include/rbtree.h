@@ -26,6 +26,7 @@ struct RBNode {
 
 struct RBTree {
     RBNode* root;
+    RBNode* leftmost;   // cached minimum, NULL when empty
     CmpOp cmpop;
     CloneFunc clone_data;
     FreeFunc free_data;
@@ -36,7 +37,14 @@ RBTree* new_rbtree(CmpOp cmpop, CloneFunc clone_data, FreeFunc free_data);
 void destroy_rbtree(RBTree* tree);
 void rbtree_insert(RBTree* tree, void* data);
 void rbtree_delete(RBTree* tree, void* data);
+void rbtree_erase(RBTree* tree, RBNode* node);
 void rbtree_print(RBTree* tree, PrintFunc print);
 void* rbtree_search(RBTree* tree, void* key);
 
+// Ordered iteration: rb_first is O(1), rb_next/rb_prev are amortised O(1)
+RBNode* rb_first(const RBTree* tree);
+RBNode* rb_last(const RBTree* tree);
+RBNode* rb_next(const RBNode* node);
+RBNode* rb_prev(const RBNode* node);
+
 #endif // RBTREE_H
@@ -0,0 +1,306 @@
+#ifndef RBTREE_INTRUSIVE_H
+#define RBTREE_INTRUSIVE_H
+
+/*
+ * Intrusive red-black tree, generated per element type.
+ *
+ * The links live inside the element (RB_ENTRY), so insert/erase never
+ * allocate, and the comparator is a static function the compiler can inline
+ * instead of the CmpOp pointer used by the generic RBTree.
+ *
+ *     typedef struct task { int key; RB_ENTRY(struct task) link; } task;
+ *     static inline int task_cmp(const task *a, const task *b) { ... }
+ *     RB_HEAD(task_tree, task);
+ *     RB_GENERATE(task_tree, task, link, task_cmp)
+ *
+ * generates task_tree_init/insert/erase/first/last/next/prev/find.
+ * Equal keys go to the right, like rbtree_insert().
+ */
+
+#include <stddef.h>
+#include "rbtree.h"
+#include "prof.h"
+
+#define RB_HEAD(name, type)                                                   \
+struct name {                                                                 \
+    type *rbh_root;                                                           \
+    type *rbh_leftmost;     /* cached minimum, NULL when empty */             \
+}
+
+#define RB_ENTRY(type)                                                        \
+struct {                                                                      \
+    type *rbe_left;                                                           \
+    type *rbe_right;                                                          \
+    type *rbe_parent;                                                         \
+    Color rbe_color;                                                          \
+}
+
+#define RB_LEFT(elm, field)     (elm)->field.rbe_left
+#define RB_RIGHT(elm, field)    (elm)->field.rbe_right
+#define RB_PARENT(elm, field)   (elm)->field.rbe_parent
+#define RB_COLOR(elm, field)    (elm)->field.rbe_color
+#define RB_IS_BLACK(elm, field) (!(elm) || RB_COLOR(elm, field) == BLACK)
+
+#define RB_GENERATE(name, type, field, cmp)                                   \
+                                                                              \
+static inline void name##_init(struct name *head) {                           \
+    head->rbh_root = NULL;                                                    \
+    head->rbh_leftmost = NULL;                                                \
+}                                                                             \
+                                                                              \
+static inline type *name##_first(const struct name *head) {                   \
+    return head->rbh_leftmost;                                                \
+}                                                                             \
+                                                                              \
+static inline type *name##_last(const struct name *head) {                    \
+    type *n = head->rbh_root;                                                 \
+    if (!n) return NULL;                                                      \
+    while (RB_RIGHT(n, field)) n = RB_RIGHT(n, field);                        \
+    return n;                                                                 \
+}                                                                             \
+                                                                              \
+static inline type *name##_next(type *n) {                                    \
+    if (RB_RIGHT(n, field)) {                                                 \
+        n = RB_RIGHT(n, field);                                               \
+        while (RB_LEFT(n, field)) n = RB_LEFT(n, field);                      \
+        return n;                                                             \
+    }                                                                         \
+    type *p = RB_PARENT(n, field);                                            \
+    while (p && n == RB_RIGHT(p, field)) {                                    \
+        n = p;                                                                \
+        p = RB_PARENT(p, field);                                              \
+    }                                                                         \
+    return p;                                                                 \
+}                                                                             \
+                                                                              \
+static inline type *name##_prev(type *n) {                                    \
+    if (RB_LEFT(n, field)) {                                                  \
+        n = RB_LEFT(n, field);                                                \
+        while (RB_RIGHT(n, field)) n = RB_RIGHT(n, field);                    \
+        return n;                                                             \
+    }                                                                         \
+    type *p = RB_PARENT(n, field);                                            \
+    while (p && n == RB_LEFT(p, field)) {                                     \
+        n = p;                                                                \
+        p = RB_PARENT(p, field);                                              \
+    }                                                                         \
+    return p;                                                                 \
+}                                                                             \
+                                                                              \
+static inline type *name##_find(const struct name *head, const type *key) {   \
+    type *n = head->rbh_root;                                                 \
+    while (n) {                                                               \
+        int c = cmp(key, n);                                                  \
+        if (c == 0) return n;                                                 \
+        n = c < 0 ? RB_LEFT(n, field) : RB_RIGHT(n, field);                   \
+    }                                                                         \
+    return NULL;                                                              \
+}                                                                             \
+                                                                              \
+static inline void name##_rotate_left(struct name *head, type *x) {           \
+    type *y = RB_RIGHT(x, field);                                             \
+    PROF_COUNT(PROF_RB_ROTATE);                                               \
+    RB_RIGHT(x, field) = RB_LEFT(y, field);                                   \
+    if (RB_LEFT(y, field)) RB_PARENT(RB_LEFT(y, field), field) = x;           \
+    RB_PARENT(y, field) = RB_PARENT(x, field);                                \
+    if (!RB_PARENT(x, field))                                                 \
+        head->rbh_root = y;                                                   \
+    else if (x == RB_LEFT(RB_PARENT(x, field), field))                        \
+        RB_LEFT(RB_PARENT(x, field), field) = y;                              \
+    else                                                                      \
+        RB_RIGHT(RB_PARENT(x, field), field) = y;                             \
+    RB_LEFT(y, field) = x;                                                    \
+    RB_PARENT(x, field) = y;                                                  \
+}                                                                             \
+                                                                              \
+static inline void name##_rotate_right(struct name *head, type *y) {          \
+    type *x = RB_LEFT(y, field);                                              \
+    PROF_COUNT(PROF_RB_ROTATE);                                               \
+    RB_LEFT(y, field) = RB_RIGHT(x, field);                                   \
+    if (RB_RIGHT(x, field)) RB_PARENT(RB_RIGHT(x, field), field) = y;         \
+    RB_PARENT(x, field) = RB_PARENT(y, field);                                \
+    if (!RB_PARENT(y, field))                                                 \
+        head->rbh_root = x;                                                   \
+    else if (y == RB_LEFT(RB_PARENT(y, field), field))                        \
+        RB_LEFT(RB_PARENT(y, field), field) = x;                              \
+    else                                                                      \
+        RB_RIGHT(RB_PARENT(y, field), field) = x;                             \
+    RB_RIGHT(x, field) = y;                                                   \
+    RB_PARENT(y, field) = x;                                                  \
+}                                                                             \
+                                                                              \
+static inline void name##_insert(struct name *head, type *z) {                \
+    type *y = NULL;                                                           \
+    type *x = head->rbh_root;                                                 \
+    int c = 0;                                                                \
+    int leftmost = 1;                                                         \
+    while (x) {                                                               \
+        y = x;                                                                \
+        c = cmp(z, x);                                                        \
+        if (c < 0) {                                                          \
+            x = RB_LEFT(x, field);                                            \
+        } else {                                                              \
+            x = RB_RIGHT(x, field);                                           \
+            leftmost = 0;                                                     \
+        }                                                                     \
+    }                                                                         \
+    RB_PARENT(z, field) = y;                                                  \
+    RB_LEFT(z, field) = RB_RIGHT(z, field) = NULL;                            \
+    RB_COLOR(z, field) = RED;                                                 \
+    if (!y)                                                                   \
+        head->rbh_root = z;                                                   \
+    else if (c < 0)                                                           \
+        RB_LEFT(y, field) = z;                                                \
+    else                                                                      \
+        RB_RIGHT(y, field) = z;                                               \
+    if (leftmost)                                                             \
+        head->rbh_leftmost = z;                                               \
+                                                                              \
+    type *p, *g, *u;                                                          \
+    while ((p = RB_PARENT(z, field)) && RB_COLOR(p, field) == RED) {          \
+        g = RB_PARENT(p, field);                                              \
+        if (p == RB_LEFT(g, field)) {                                         \
+            u = RB_RIGHT(g, field);                                           \
+            if (u && RB_COLOR(u, field) == RED) {                             \
+                RB_COLOR(p, field) = BLACK;                                   \
+                RB_COLOR(u, field) = BLACK;                                   \
+                RB_COLOR(g, field) = RED;                                     \
+                z = g;                                                        \
+                continue;                                                     \
+            }                                                                 \
+            if (z == RB_RIGHT(p, field)) {                                    \
+                name##_rotate_left(head, p);                                  \
+                z = p;                                                        \
+                p = RB_PARENT(z, field);                                      \
+            }                                                                 \
+            RB_COLOR(p, field) = BLACK;                                       \
+            RB_COLOR(g, field) = RED;                                         \
+            name##_rotate_right(head, g);                                     \
+        } else {                                                              \
+            u = RB_LEFT(g, field);                                            \
+            if (u && RB_COLOR(u, field) == RED) {                             \
+                RB_COLOR(p, field) = BLACK;                                   \
+                RB_COLOR(u, field) = BLACK;                                   \
+                RB_COLOR(g, field) = RED;                                     \
+                z = g;                                                        \
+                continue;                                                     \
+            }                                                                 \
+            if (z == RB_LEFT(p, field)) {                                     \
+                name##_rotate_right(head, p);                                 \
+                z = p;                                                        \
+                p = RB_PARENT(z, field);                                      \
+            }                                                                 \
+            RB_COLOR(p, field) = BLACK;                                       \
+            RB_COLOR(g, field) = RED;                                         \
+            name##_rotate_left(head, g);                                      \
+        }                                                                     \
+    }                                                                         \
+    RB_COLOR(head->rbh_root, field) = BLACK;                                  \
+}                                                                             \
+                                                                              \
+static inline void name##_transplant(struct name *head, type *u, type *v) {   \
+    if (!RB_PARENT(u, field))                                                 \
+        head->rbh_root = v;                                                   \
+    else if (u == RB_LEFT(RB_PARENT(u, field), field))                        \
+        RB_LEFT(RB_PARENT(u, field), field) = v;                              \
+    else                                                                      \
+        RB_RIGHT(RB_PARENT(u, field), field) = v;                             \
+    if (v) RB_PARENT(v, field) = RB_PARENT(u, field);                         \
+}                                                                             \
+                                                                              \
+static inline void name##_erase(struct name *head, type *z) {                 \
+    if (z == head->rbh_leftmost)                                              \
+        head->rbh_leftmost = name##_next(z);                                  \
+                                                                              \
+    type *y = z, *x, *xp;                                                     \
+    Color y_color = RB_COLOR(y, field);                                       \
+    if (!RB_LEFT(z, field)) {                                                 \
+        x = RB_RIGHT(z, field);                                               \
+        xp = RB_PARENT(z, field);                                             \
+        name##_transplant(head, z, x);                                        \
+    } else if (!RB_RIGHT(z, field)) {                                         \
+        x = RB_LEFT(z, field);                                                \
+        xp = RB_PARENT(z, field);                                             \
+        name##_transplant(head, z, x);                                        \
+    } else {                                                                  \
+        y = RB_RIGHT(z, field);                                               \
+        while (RB_LEFT(y, field)) y = RB_LEFT(y, field);                      \
+        y_color = RB_COLOR(y, field);                                         \
+        x = RB_RIGHT(y, field);                                               \
+        if (RB_PARENT(y, field) == z) {                                       \
+            xp = y;                                                           \
+        } else {                                                              \
+            xp = RB_PARENT(y, field);                                         \
+            name##_transplant(head, y, x);                                    \
+            RB_RIGHT(y, field) = RB_RIGHT(z, field);                          \
+            RB_PARENT(RB_RIGHT(y, field), field) = y;                         \
+        }                                                                     \
+        name##_transplant(head, z, y);                                        \
+        RB_LEFT(y, field) = RB_LEFT(z, field);                                \
+        RB_PARENT(RB_LEFT(y, field), field) = y;                              \
+        RB_COLOR(y, field) = RB_COLOR(z, field);                              \
+    }                                                                         \
+    if (y_color == RED) return;                                               \
+                                                                              \
+    type *w;                                                                  \
+    while (x != head->rbh_root && RB_IS_BLACK(x, field)) {                    \
+        if (x == RB_LEFT(xp, field)) {                                        \
+            w = RB_RIGHT(xp, field);                                          \
+            if (RB_COLOR(w, field) == RED) {                                  \
+                RB_COLOR(w, field) = BLACK;                                   \
+                RB_COLOR(xp, field) = RED;                                    \
+                name##_rotate_left(head, xp);                                 \
+                w = RB_RIGHT(xp, field);                                      \
+            }                                                                 \
+            if (RB_IS_BLACK(RB_LEFT(w, field), field) &&                      \
+                RB_IS_BLACK(RB_RIGHT(w, field), field)) {                     \
+                RB_COLOR(w, field) = RED;                                     \
+                x = xp;                                                       \
+                xp = RB_PARENT(x, field);                                     \
+            } else {                                                          \
+                if (RB_IS_BLACK(RB_RIGHT(w, field), field)) {                 \
+                    RB_COLOR(RB_LEFT(w, field), field) = BLACK;               \
+                    RB_COLOR(w, field) = RED;                                 \
+                    name##_rotate_right(head, w);                             \
+                    w = RB_RIGHT(xp, field);                                  \
+                }                                                             \
+                RB_COLOR(w, field) = RB_COLOR(xp, field);                     \
+                RB_COLOR(xp, field) = BLACK;                                  \
+                if (RB_RIGHT(w, field))                                       \
+                    RB_COLOR(RB_RIGHT(w, field), field) = BLACK;              \
+                name##_rotate_left(head, xp);                                 \
+                x = head->rbh_root;                                           \
+            }                                                                 \
+        } else {                                                              \
+            w = RB_LEFT(xp, field);                                           \
+            if (RB_COLOR(w, field) == RED) {                                  \
+                RB_COLOR(w, field) = BLACK;                                   \
+                RB_COLOR(xp, field) = RED;                                    \
+                name##_rotate_right(head, xp);                                \
+                w = RB_LEFT(xp, field);                                       \
+            }                                                                 \
+            if (RB_IS_BLACK(RB_LEFT(w, field), field) &&                      \
+                RB_IS_BLACK(RB_RIGHT(w, field), field)) {                     \
+                RB_COLOR(w, field) = RED;                                     \
+                x = xp;                                                       \
+                xp = RB_PARENT(x, field);                                     \
+            } else {                                                          \
+                if (RB_IS_BLACK(RB_LEFT(w, field), field)) {                  \
+                    RB_COLOR(RB_RIGHT(w, field), field) = BLACK;              \
+                    RB_COLOR(w, field) = RED;                                 \
+                    name##_rotate_left(head, w);                              \
+                    w = RB_LEFT(xp, field);                                   \
+                }                                                             \
+                RB_COLOR(w, field) = RB_COLOR(xp, field);                     \
+                RB_COLOR(xp, field) = BLACK;                                  \
+                if (RB_LEFT(w, field))                                        \
+                    RB_COLOR(RB_LEFT(w, field), field) = BLACK;               \
+                name##_rotate_right(head, xp);                                \
+                x = head->rbh_root;                                           \
+            }                                                                 \
+        }                                                                     \
+    }                                                                         \
+    if (x) RB_COLOR(x, field) = BLACK;                                        \
+}
+
+#endif // RBTREE_INTRUSIVE_H
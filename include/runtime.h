@@ -0,0 +1,104 @@
+#ifndef RUNTIME_H
+#define RUNTIME_H
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include "common.h"
+#include "cfs.h"
+#include "metrics.h"
+#include "workload.h"
+
+/*
+ * Threaded runtime: the CFS queues scheduling real work in-process. Every
+ * cpu_t is a worker thread pinned to a host CPU, with its own cfs_rq under
+ * rq_lock. A work item is a callback with a CPU budget. A worker runs the
+ * item with the least vruntime for up to its timeslice and charges it the
+ * wall time the callback took. Preemption is cooperative: the callback
+ * polls rt_should_yield() and returns once the slice is used up or a task
+ * that should preempt it (cfs_wakeup_preempt()) has been queued behind it.
+ * A worker with an empty queue steals from the others before it sleeps.
+ */
+
+typedef struct rt_ctx rt_ctx;
+
+// Do some work; true once the item is complete. Called again after a yield.
+typedef bool (*rt_work_fn)(void *arg, rt_ctx *ctx);
+
+typedef struct {
+    uint64_t acquisitions;
+    uint64_t contended;     // acquisitions that found the lock taken
+    uint64_t wait_ns;       // time spent waiting for it
+} rt_lock_stats;
+
+typedef struct {
+    uint64_t      tasks;
+    uint64_t      dispatches;
+    uint64_t      yields;       // callbacks that returned unfinished
+    uint64_t      preemptions;  // yields asked for by a queued task
+    uint64_t      steals;
+    rt_lock_stats lock;         // rq_lock, taken by workers and submitters
+    histogram_t   dispatch_latency;     // dispatch - queued, every dispatch
+} rt_stats;
+
+typedef struct {
+    pcb_t       pcb;            // first: the queues hold &pcb
+    rt_work_fn  fn;
+    void       *arg;
+    uint64_t    budget;         // CPU the item may use, 0 for no limit
+    uint64_t    ready;          // when it was last queued
+} rt_task;
+
+struct rt_runtime;
+
+typedef struct {
+    struct rt_runtime *rt;
+    cpu_t          cpu;         // running_process is the task in the callback
+    struct cfs_rq  rq;
+    pthread_t      thread;
+    int            host_cpu;    // CPU the thread is pinned to, -1 if pinning failed
+    atomic_bool    resched;     // a queued task should preempt the running one
+    rt_lock_stats  lock;        // guarded by rq.rq_lock
+    rt_stats       stats;       // touched by the worker thread only
+    uint64_t       last_finish;
+} rt_worker;
+
+typedef struct rt_runtime {
+    int             n;
+    rt_worker      *workers;
+    cfs_tunables    tun;
+    atomic_uint_fast64_t next;      // submissions so far: pid and target queue
+    atomic_uint_fast64_t queued;    // tasks sitting in some queue
+    atomic_uint_fast64_t pending;   // tasks submitted and not finished
+    atomic_int      sleepers;       // workers waiting on idle_cv
+    bool            stop;           // guarded by idle_lock
+    pthread_mutex_t idle_lock;
+    pthread_cond_t  idle_cv;        // queued > 0 or stop
+    pthread_cond_t  done_cv;        // pending == 0
+    uint64_t        t0;             // CLOCK_MONOTONIC at rt_init
+    metrics_t      *metrics;        // per-task metrics, NULL for none
+    pthread_mutex_t metrics_lock;
+} rt_runtime;
+
+// Start n workers; tun is copied. m, if not NULL, gets every finished task.
+void rt_init(rt_runtime *rt, int n, const cfs_tunables *tun, metrics_t *m);
+// Queue fn(arg) at nice level nice; thread-safe.
+void rt_submit(rt_runtime *rt, rt_work_fn fn, void *arg, int nice, uint64_t budget_ns);
+void rt_wait(rt_runtime *rt);       // until every submitted item has finished
+// Stop the workers, add their statistics to *out (if not NULL) and fill in
+// the metrics' run-wide fields.
+void rt_destroy(rt_runtime *rt, rt_stats *out);
+
+// For callbacks: time to return? Cheap enough to call in a loop.
+bool     rt_should_yield(rt_ctx *ctx);
+// CPU the item may still use, counting the current call; UINT64_MAX for no limit.
+uint64_t rt_budget_left(rt_ctx *ctx);
+// ns since rt_init.
+uint64_t rt_now(const rt_runtime *rt);
+
+// Submit every task of wl at arrival * unit ns after rt_init as an item that
+// spins for burst * unit ns. I/O phases, locks and groups are ignored.
+void rt_replay(rt_runtime *rt, workload_t *wl, uint64_t unit);
+
+#endif // RUNTIME_H
@@ -0,0 +1,75 @@
+#ifndef SAMPLER_H
+#define SAMPLER_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include "cpu.h"
+
+/*
+ * Load over time, sampled every `every` simulated ns. Nothing ticks: the
+ * event loop hands each event's time to sampler_advance() before handling
+ * it, and every boundary up to that time is sampled from the state the
+ * previous event left, which held over the whole gap. Rows go into a
+ * preallocated block of columns that is written out whenever it fills.
+ *
+ * The last row is at the end of the run, however short its interval.
+ *
+ * Per row: the boundary; for each CPU, the share of the interval it was
+ * busy (warm-up included); for each run queue (the shared one, or one per
+ * CPU), the tasks waiting in it, their total weight and its min_vruntime;
+ * and the spread of min_vruntime over the queues (0 with a shared queue).
+ *
+ * File: CSV, one row per sample, if the path ends in ".csv". Otherwise a
+ * sample_header, then blocks of up to block_rows rows: a uint32 row count,
+ * 4 bytes of padding, then the columns one after the other, each `rows`
+ * long: time (uint64), busy (float, num_cpu columns), depth (uint32,
+ * nr_queues columns), weight (uint64, nr_queues), min_vruntime (uint64,
+ * nr_queues), spread (uint64). Little-endian as written on x86-64.
+ */
+#define SAMPLE_MAGIC      "CFSSMPL"
+#define SAMPLE_VERSION    1
+#define SAMPLE_BLOCK_ROWS 1024
+
+typedef struct {
+    char     magic[8];
+    uint32_t version;
+    uint32_t num_cpu;
+    uint32_t nr_queues;
+    uint32_t block_rows;
+    uint64_t every;
+} sample_header;
+
+typedef struct {
+    FILE              *out;
+    bool               csv;
+    const cpu_manager *cm;
+    uint64_t           every;
+    uint64_t           next;        // next boundary to sample
+    uint64_t           last;        // previous boundary, or where sampling started
+    uint32_t           num_cpu;
+    uint32_t           nr_queues;
+    uint32_t           rows;        // filled in the current block
+    uint64_t          *prev_busy;   // per CPU, busy ns up to `last`
+    // the block, column-major: column c of row r is at [c * SAMPLE_BLOCK_ROWS + r]
+    uint64_t          *time;
+    float             *busy;
+    uint32_t          *depth;
+    uint64_t          *weight;
+    uint64_t          *min_vruntime;
+    uint64_t          *spread;
+} sampler_t;
+
+// Start sampling cm at now; the first boundary is the next multiple of every.
+void sampler_open(sampler_t *sp, const char *path, uint64_t every, const cpu_manager *cm,
+                  uint64_t now);
+void sampler_take(sampler_t *sp, uint64_t t);
+// Sample the boundaries up to end, write out what is left and close the file.
+void sampler_close(sampler_t *sp, uint64_t end);
+
+// Before the event at t is handled.
+static inline void sampler_advance(sampler_t *sp, uint64_t t) {
+    if (t >= sp->next) sampler_take(sp, t);
+}
+
+#endif // SAMPLER_H
@@ -0,0 +1,88 @@
+#ifndef SIM_H
+#define SIM_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "common.h"
+#include "cfs.h"
+#include "cpu.h"
+#include "event.h"
+#include "workload.h"
+#include "trace.h"
+#include "metrics.h"
+#include "sampler.h"
+
+/*
+ * One simulation. Everything a run touches hangs off sim_t, so independent
+ * runs can go on in parallel threads; only the workload_set they read from
+ * is shared.
+ */
+
+typedef struct {
+    const sched_policy *policy;
+    cfs_tunables tun;
+    bool         per_cpu_rq;    // one cfs_rq per CPU instead of a shared one
+    evq_backend  evq;
+    uint32_t     num_cpu;       // 0: use the count the workload asks for
+    cpu_topology topo;          // nodes == 0: one LLC, no SMT
+    uint64_t     migration_cost[TOPO_LEVELS];   // ns, by distance from the last CPU
+    bool         affinity;      // prefer CPUs close to where a task last ran
+    uint64_t     checkpoint_every;  // ns between snapshots, 0 for none
+    const char  *checkpoint_path;   // a snapshot for time T goes to "<path>.T"
+    uint64_t     sample_every;      // ns between load samples, 0 for none
+    const char  *sample_path;
+} sim_params;
+
+struct pcb_chunk;
+
+typedef struct {
+    struct pcb_chunk *chunks;
+    pcb_t            *free_list;    // chained through rq
+} pcb_pool;
+
+// A lock tasks hold through their run phases; waiters are handed it in FIFO order.
+typedef struct {
+    pcb_t *owner;
+    pcb_t *wait_head;       // chained through wait_next
+    pcb_t *wait_tail;
+} sim_lock;
+
+typedef struct {
+    sim_params          params;
+    const sched_policy *pol;        // params.policy
+    struct cfs_rq       rq;         // shared run-queue
+    cpu_manager         cpu;
+    event_tree          events;
+    pcb_pool            pool;
+    workload_t         *wl;         // streamed source, or
+    const workload_set *set;        // pre-parsed source
+    uint64_t            next_task;  // next index into set
+    sim_lock           *locks;      // indexed by lock id, grown as ids show up
+    uint32_t            nr_locks;
+    struct task_group  *groups;     // in workload order, parents first
+    uint32_t            nr_groups;
+    struct task_group **group_of;   // indexed by group id
+    trace_t            *trace;
+    metrics_t          *metrics;
+    uint64_t            next_checkpoint;
+    sampler_t           sampler;    // params.sample_every only
+} sim_t;
+
+struct sim_snapshot;
+
+void sim_params_default(sim_params *p);
+
+void sim_init(sim_t *s, const sim_params *p, trace_t *trace, metrics_t *m);
+void sim_destroy(sim_t *s);
+// One run per sim_init(): stream tasks from wl, or replay a loaded set.
+void sim_run(sim_t *s, workload_t *wl);
+void sim_run_set(sim_t *s, const workload_set *set);
+// Continue the run a snapshot was taken of; the tasks it had not read yet
+// come from wl / set, which must be the workload it was taken with.
+void sim_resume(sim_t *s, workload_t *wl, const struct sim_snapshot *snap);
+void sim_resume_set(sim_t *s, const workload_set *set, const struct sim_snapshot *snap);
+
+// For snapshot.c: a PCB from s's pool.
+pcb_t *sim_pcb_alloc(sim_t *s);
+
+#endif // SIM_H
@@ -0,0 +1,170 @@
+#ifndef SNAPSHOT_H
+#define SNAPSHOT_H
+
+#include <stdint.h>
+#include "sim.h"
+
+/*
+ * Snapshot of a run between two events: the tasks in flight, the queues, the
+ * CPUs, the pending events, locks and groups, and the metrics so far.
+ * Restoring one into a fresh sim_t continues the run exactly where it
+ * stopped, with the same or other tunables. Tasks that had not arrived yet
+ * are read again from the workload, so the file grows with the tasks in
+ * flight, not with the trace.
+ *
+ * File: a snapshot_header, then num_cpu snapshot_cpu, nr_groups
+ * snapshot_group, nr_queues uint64 min_vruntimes (shared queue, then the
+ * per-CPU ones), nr_tasks snapshot_task, nr_events snapshot_event,
+ * nr_lock_recs snapshot_lock (each followed by its waiters' uint32 task
+ * indices) and a snapshot_metrics with its histograms. All little-endian as
+ * written on x86-64.
+ */
+#define SNAPSHOT_MAGIC   "CFSSNAP"
+#define SNAPSHOT_VERSION 1
+#define SNAPSHOT_NONE    UINT32_MAX
+#define SNAPSHOT_GROUP_RQ 0x80000000u   // rq reference to group (ref & ~SNAPSHOT_GROUP_RQ)
+
+typedef struct {
+    char         magic[8];
+    uint32_t     version;
+    uint32_t     num_cpu;
+    char         policy[16];
+    cfs_tunables tun;
+    uint64_t     migration_cost[TOPO_LEVELS];
+    cpu_topology topo;
+    uint8_t      per_cpu_rq;
+    uint8_t      affinity;
+    uint8_t      reserved[6];
+    uint64_t     time;          // of the last event handled
+    uint64_t     done;          // tasks finished
+    uint64_t     fed;           // tasks read from the workload
+    uint64_t     wl_tasks;      // tasks in the workload
+    uint64_t     last_arrival;  // of the last task read; checks the workload on restore
+    uint64_t     nr_tasks;
+    uint64_t     nr_events;
+    uint32_t     nr_groups;
+    uint32_t     nr_queues;
+    uint32_t     nr_locks;      // slots in sim_t.locks
+    uint32_t     nr_lock_recs;  // locks with an owner or waiters
+    uint64_t     nr_migrations;
+    uint64_t     last_balance;
+} snapshot_header;
+
+typedef struct {
+    uint64_t running_time;
+    uint64_t last_dispatch;
+    uint64_t warmup;
+    uint64_t slice_lo;
+    uint64_t slice_hi;
+    uint64_t victim_vruntime;
+    uint32_t task;              // running task, SNAPSHOT_NONE when idle
+    uint32_t young;             // place in the young list, SNAPSHOT_NONE if not on it
+} snapshot_cpu;
+
+typedef struct {
+    uint64_t vruntime;
+    uint64_t min_vruntime;
+    uint64_t cpu_time;
+    uint64_t nr_tasks;
+    uint32_t placed;
+    uint32_t reserved;
+} snapshot_group;
+
+// Queued tasks come first, in the order the policy's for_each() gave them.
+typedef struct {
+    uint64_t seq;
+    uint64_t arrival;
+    uint64_t vruntime;
+    int64_t  remain;
+    uint64_t time_slice;
+    uint64_t burst;
+    uint64_t first_run;
+    uint64_t run;
+    uint64_t block;
+    uint64_t phase_left;
+    uint64_t io_time;
+    uint64_t wake_time;
+    uint64_t wake_sum;
+    uint64_t wake_max;
+    uint64_t mig_cost;
+    uint32_t pid;
+    uint32_t weight;
+    int32_t  nice;
+    int32_t  lock;
+    uint32_t nr_dispatch;
+    uint32_t nr_wakeups;
+    uint32_t last_cpu;
+    uint32_t group;             // group id, 0 for the root
+    uint32_t rq;                // last queue: 0 shared, 1 + i per-CPU i, or a group's
+    uint32_t queue;             // root queue it is on (as rq), SNAPSHOT_NONE if not queued
+    uint8_t  holds_lock;
+    uint8_t  reserved[7];
+} snapshot_task;
+
+typedef struct {
+    uint64_t time;
+    uint32_t type;              // event_type
+    uint32_t task;
+    uint32_t cpu;               // index, SNAPSHOT_NONE for arrivals and wakeups
+    uint32_t reserved;
+} snapshot_event;
+
+typedef struct {
+    uint32_t id;
+    uint32_t owner;             // task index, SNAPSHOT_NONE when free
+    uint32_t nr_waiters;
+    uint32_t reserved;
+} snapshot_lock;
+
+typedef struct {
+    uint64_t lock_waits;
+    uint64_t tasks;
+    uint64_t events;
+    uint64_t context_switches;
+    uint64_t dispatch_distance[TOPO_LEVELS];
+    uint64_t migration_cost;
+    double   fair_sum;
+    double   fair_sum_sq;
+    uint64_t nice_mask;         // bit i: wakeup_by_nice[i] follows the four others
+} snapshot_metrics;
+
+// A histogram: response, waiting, turnaround, wakeup, then the nice levels.
+typedef struct {
+    uint64_t count;
+    uint64_t max;
+    double   sum;
+    uint32_t nr_buckets;        // non-empty buckets, as snapshot_bucket records
+    uint32_t reserved;
+} snapshot_hist;
+
+typedef struct {
+    uint32_t index;
+    uint32_t reserved;
+    uint64_t n;
+} snapshot_bucket;
+
+typedef struct sim_snapshot {
+    snapshot_header hdr;
+    snapshot_cpu   *cpus;
+    snapshot_group *groups;
+    uint64_t       *min_vruntime;
+    snapshot_task  *tasks;
+    snapshot_event *events;
+    snapshot_lock  *locks;
+    uint32_t       *waiters;    // every lock's, in lock order
+    metrics_t       metrics;    // counters and histograms up to the snapshot
+} sim_snapshot;
+
+// Write s, between two events, to path. t is the time of the last event
+// handled and done the number of tasks finished.
+void snapshot_write(sim_t *s, uint64_t t, uint64_t done, const char *path);
+void snapshot_load(sim_snapshot *snap, const char *path);
+void snapshot_free(sim_snapshot *snap);
+// Policy, CPU count, queue layout, topology, tunables, migration costs and
+// affinity of the snapshot's run.
+void snapshot_params(const sim_snapshot *snap, sim_params *p);
+// Rebuild the state in s, whose groups and CPUs are set up and empty, and
+// return the time of the last event handled and the tasks done.
+void snapshot_apply(const sim_snapshot *snap, sim_t *s, uint64_t *t, uint64_t *done);
+
+#endif // SNAPSHOT_H
@@ -0,0 +1,36 @@
+#ifndef SWEEP_H
+#define SWEEP_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include "sim.h"
+
+/*
+ * Parameter sweep: every (workload × policy × latency × granularity × CPU count)
+ * combination runs as its own simulation on a work-stealing pool. Each
+ * workload is parsed once and shared read-only by all of its runs; results
+ * are printed as one CSV table in grid order. With a snapshot, every run
+ * resumes from it instead of starting at time 0.
+ */
+struct sim_snapshot;
+
+typedef struct {
+    const char **paths;
+    int          num_paths;
+    uint64_t    *latencies;     // sched_latency values
+    int          num_latencies;
+    uint64_t    *granularities; // min_granularity values
+    int          num_granularities;
+    uint64_t    *cpus;          // CPU counts; none means each workload's own
+    int          num_cpus;
+    const sched_policy **policies;  // none means base.policy
+    int          num_policies;
+    sim_params   base;          // everything else (queue mode, event backend, topology)
+    const struct sim_snapshot *snap;    // NULL to run from the start
+    int          threads;
+} sweep_spec;
+
+void sweep_run(const sweep_spec *spec, FILE *out);
+
+#endif // SWEEP_H
@@ -0,0 +1,47 @@
+#ifndef TOPOLOGY_H
+#define TOPOLOGY_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/*
+ * Machine layout: nodes × LLCs per node × cores per LLC × SMT threads per
+ * core. CPUs are numbered thread-fastest, so every domain (core, LLC, node)
+ * is a contiguous range of CPU indices and needs no table.
+ */
+
+// How far apart two CPUs are: the smallest domain they share.
+typedef enum {
+    TOPO_SAME = 0,      // same CPU
+    TOPO_SMT,           // SMT siblings on one core
+    TOPO_LLC,           // same last-level cache
+    TOPO_NODE,          // same NUMA node
+    TOPO_REMOTE,        // different nodes
+    TOPO_LEVELS
+} topo_level;
+
+extern const char *const topo_level_name[TOPO_LEVELS];     // "same", "smt", ...
+
+typedef struct {
+    uint32_t nodes;
+    uint32_t llcs;      // per node
+    uint32_t cores;     // per LLC
+    uint32_t threads;   // per core
+} cpu_topology;
+
+// "NODESxLLCSxCORESxTHREADS", e.g. "2x2x8x2"; false on anything else.
+bool topology_parse(const char *spec, cpu_topology *t);
+// n CPUs behind one LLC, no SMT: what the simulator assumed before topologies.
+void topology_flat(cpu_topology *t, uint32_t n);
+
+static inline uint64_t topology_cpus(const cpu_topology *t) {
+    return (uint64_t)t->nodes * t->llcs * t->cores * t->threads;
+}
+
+// Distance between CPU indices a and b (0-based).
+topo_level topology_distance(const cpu_topology *t, uint32_t a, uint32_t b);
+// CPU indices [*lo, *hi) sharing the level-l domain of cpu.
+void topology_domain(const cpu_topology *t, uint32_t cpu, topo_level l,
+                     uint32_t *lo, uint32_t *hi);
+
+#endif // TOPOLOGY_H
@@ -0,0 +1,106 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <pthread.h>
+#include <stdatomic.h>
+
+/*
+ * Scheduler event log, one per simulation.
+ *
+ * TRACE_TEXT formats every event straight to stdout. TRACE_BINARY packs
+ * events into fixed-size trace_rec records, queues them on a
+ * single-producer ring and has a background thread write them out in large
+ * batches; trace_decode() turns such a file back into exactly the text
+ * TRACE_TEXT prints. TRACE_CHROME queues the same records, but the writer
+ * turns them into Chrome trace-event JSON as it drains the ring (see
+ * trace_chrome()). TRACE_OFF drops everything (parameter sweeps).
+ */
+
+#define TRACE_MAGIC    "CFSEVLOG"
+#define TRACE_VERSION  1
+
+typedef enum {
+    TRACE_ENQUEUE,
+    TRACE_ASSIGN,
+    TRACE_STOP,
+    TRACE_FINISH,           // cpu is the CPU it ran on last (0 in older logs)
+    TRACE_MIGRATE_FROM,     // source CPU of the TRACE_MIGRATE that follows
+    TRACE_MIGRATE,
+    TRACE_DONE,
+    TRACE_MIGRATIONS,       // time holds the migration count
+    TRACE_SLEEP,            // end of a run phase
+    TRACE_WAKEUP,
+    TRACE_LOCK_WAIT         // cpu is the CPU the task was picked for
+} trace_kind;
+
+typedef struct {
+    char     magic[8];      // TRACE_MAGIC, not NUL-terminated
+    uint32_t version;
+    uint32_t rec_size;      // sizeof(trace_rec)
+} trace_header;
+
+typedef struct {
+    uint64_t time;
+    uint32_t pid;
+    uint16_t cpu;
+    uint16_t kind;          // trace_kind
+} trace_rec;
+
+typedef enum { TRACE_TEXT, TRACE_BINARY, TRACE_CHROME, TRACE_OFF } trace_mode;
+
+/*
+ * Chrome trace-event JSON, for Perfetto or chrome://tracing. One track per
+ * CPU with a slice per stint, from Assigned to Stopped / Sleep / Finish,
+ * named after the PID; Finish, Migrated and lock waits are instants on the
+ * CPU's track, Enqueue and Wakeup on a "run queue" track. Only the stint in
+ * progress on each CPU is remembered, so memory does not grow with the log.
+ */
+typedef struct {
+    uint64_t start;         // of the stint in progress
+    uint32_t pid;
+    bool     running;
+    bool     named;         // track name written
+} trace_chrome_cpu;
+
+typedef struct {
+    FILE             *out;
+    trace_chrome_cpu *cpus;     // indexed by CPU id, grown as ids show up
+    uint32_t          nr_cpus;
+    uint32_t          migrate_src;
+    bool              first;    // no event written yet
+} trace_chrome_t;
+
+typedef struct {
+    trace_mode             mode;
+    int                    fd;
+    trace_rec             *ring;
+    pthread_t              writer;
+    _Alignas(64) _Atomic size_t head;   // next slot the simulator fills
+    size_t                 tail_seen;   // simulator's last view of tail
+    _Alignas(64) _Atomic size_t tail;   // next slot the writer drains
+    atomic_bool            closing;
+    trace_chrome_t         chrome;      // TRACE_CHROME, owned by the writer
+} trace_t;
+
+// path is only used by TRACE_BINARY and TRACE_CHROME; "-" writes to stdout.
+void trace_open(trace_t *tr, trace_mode mode, const char *path);
+void trace_close(trace_t *tr);          // drain the ring and stop the writer
+
+void trace_event(trace_t *tr, trace_kind kind, uint64_t time, uint32_t pid, uint32_t cpu);
+void trace_migrate(trace_t *tr, uint64_t time, uint32_t pid, uint32_t from, uint32_t to);
+
+// Print the text line for r. MIGRATE_FROM prints nothing and fills *migrate_src.
+void trace_format(FILE *out, const trace_rec *r, uint32_t *migrate_src);
+// Decode a whole binary log, as text or as Chrome JSON; -1 on a bad header
+// or a truncated record.
+int  trace_decode(FILE *in, FILE *out, bool chrome);
+
+void trace_chrome_begin(trace_chrome_t *ct, FILE *out);
+void trace_chrome(trace_chrome_t *ct, const trace_rec *r);
+void trace_chrome_end(trace_chrome_t *ct);     // closes the JSON, not the file
+
+#endif // TRACE_H
@@ -0,0 +1,102 @@
+#ifndef WORKLOAD_H
+#define WORKLOAD_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "heap.h"
+
+#define MAX_CPU 4096
+
+// Tasks held back to restore arrival order; inputs must be sorted up to this.
+#define WORKLOAD_WINDOW 4096
+
+// Lock ids a task may name are 0 .. WORKLOAD_MAX_LOCKS - 1.
+#define WORKLOAD_MAX_LOCKS 65536
+
+// Task groups are 1 .. WORKLOAD_MAX_GROUPS - 1; 0 is the root.
+#define WORKLOAD_MAX_GROUPS 65536
+#define GROUP_MIN_SHARES    2
+#define GROUP_MAX_SHARES    262144
+
+// Memory-mapped input already consumed is returned to the kernel in steps of this.
+#define WORKLOAD_RELEASE_BYTES (64u << 20)
+
+// Read buffer for inputs that cannot be mapped (pipes, "-" for stdin).
+#define WORKLOAD_STREAM_BYTES (1u << 20)
+
+/*
+ * Binary trace: a header followed by num_tasks fixed-size records, all
+ * little-endian as written by the generator. From version 3 the header is
+ * followed by a uint64 group count and that many workload_group records.
+ */
+#define WORKLOAD_BIN_MAGIC   "CFSTRACE"
+#define WORKLOAD_BIN_VERSION 3      // version 2 has no groups, version 1 records stop after burst
+
+typedef struct {
+    char     magic[8];
+    uint32_t version;
+    uint32_t num_cpu;
+    uint64_t num_tasks;
+} workload_bin_header;
+
+typedef struct {
+    uint32_t pid;
+    int32_t  nice;
+    uint64_t arrival;
+    uint64_t burst;         // total CPU time
+    uint64_t run;           // CPU per run phase, 0 for a single phase
+    uint64_t block;         // sleep after each run phase but the last
+    int32_t  lock;          // held through every run phase, -1 for none
+    uint32_t group;         // task group, 0 for the root
+} task_spec_t;              // also the binary record layout
+
+// A task group: its tasks and subgroups share `shares` against its siblings.
+typedef struct {
+    uint32_t id;
+    uint32_t parent;        // 0 for the root; defined before its children
+    uint32_t shares;
+    uint32_t reserved;
+} workload_group;           // also the binary record layout
+
+typedef struct {
+    const char          *path;
+    const unsigned char *base;      // mapping of the whole file, NULL when streaming
+    size_t               size;
+    int                  fd;        // source of buf when streaming, -1 when mapped
+    unsigned char       *buf;
+    const unsigned char *cur;       // parse position
+    const unsigned char *end;       // end of the mapped or buffered bytes
+    const unsigned char *released;  // start of the part not yet given back
+    bool                 binary;
+    uint32_t             rec_size;  // binary record size for the file's version
+    uint32_t             num_cpu;
+    uint64_t             num_tasks;
+    workload_group      *groups;    // in definition order
+    uint32_t             num_groups;
+    bool                *group_defined;     // indexed by id, while parsing
+    uint64_t             parsed;    // records read from the file
+    uint64_t             emitted;   // records handed out in arrival order
+    uint64_t             last_arrival;
+    heap_t               window;    // pending_task ordered by (arrival, seq)
+} workload_t;
+
+// A whole workload parsed into memory, shared read-only by parallel runs.
+typedef struct {
+    const char  *path;
+    uint32_t     num_cpu;
+    uint64_t     num_tasks;
+    task_spec_t *tasks;     // arrival order; the index is the task's seq
+    workload_group *groups;
+    uint32_t     num_groups;
+} workload_set;
+
+void workload_open(workload_t *w, const char *path);
+void workload_close(workload_t *w);
+// Next task in arrival order; seq is its position in the file.
+bool workload_next(workload_t *w, task_spec_t *out, uint64_t *seq);
+
+void workload_load(workload_set *set, const char *path);
+void workload_set_free(workload_set *set);
+
+#endif // WORKLOAD_H
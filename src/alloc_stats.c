@@ -0,0 +1,39 @@
+#include <stddef.h>
+#include "alloc_stats.h"
+
+#ifdef SIM_COUNT_ALLOCS
+#include <stdatomic.h>
+
+// Sweep and runtime workers allocate concurrently.
+static _Atomic uint64_t nr_allocs;
+
+void *__real_malloc(size_t size);
+void *__real_calloc(size_t n, size_t size);
+void *__real_realloc(void *ptr, size_t size);
+
+void *__wrap_malloc(size_t size) {
+    atomic_fetch_add_explicit(&nr_allocs, 1, memory_order_relaxed);
+    return __real_malloc(size);
+}
+
+void *__wrap_calloc(size_t n, size_t size) {
+    atomic_fetch_add_explicit(&nr_allocs, 1, memory_order_relaxed);
+    return __real_calloc(n, size);
+}
+
+void *__wrap_realloc(void *ptr, size_t size) {
+    atomic_fetch_add_explicit(&nr_allocs, 1, memory_order_relaxed);
+    return __real_realloc(ptr, size);
+}
+
+uint64_t alloc_count(void) {
+    return atomic_load_explicit(&nr_allocs, memory_order_relaxed);
+}
+
+#else
+
+uint64_t alloc_count(void) {
+    return ALLOC_COUNT_NONE;
+}
+
+#endif
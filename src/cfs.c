@@ -1,92 +1,358 @@
-#include "cfs.h"
-#include "rbtree.h"
-#include <pthread.h>
-#include <stdlib.h>
-
-struct cfs_rq cfs_rq;
-
-/**
- * Comparator for CFS run-queue: compare by vruntime (double), then weight (higher first), then pid.
- */
-static int cfs_cmp(const void *a, const void *b) {
-    const pcb_t *p1 = a;
-    const pcb_t *p2 = b;
-    double v1 = p1->vruntime;
-    double v2 = p2->vruntime;
-    if (v1 < v2) return -1;
-    if (v1 > v2) return  1;
-    if (p1->weight > p2->weight) return -1;
-    if (p1->weight < p2->weight) return  1;
-    if (p1->pid < p2->pid) return -1;
-    if (p1->pid > p2->pid) return  1;
-    return 0;
-}
-
-/**
- * Helper to find the minimum node in RBTree (leftmost).
- */
-static pcb_t *cfs_tree_min(void) {
-    RBNode *node = cfs_rq.tree->root;
-    if (!node) return NULL;
-    while (node->left) node = node->left;
-    return (pcb_t *)node->data;
-}
-
-void cfs_init_rq(void) {
-    cfs_rq.tree = new_rbtree(cfs_cmp, NULL, NULL);
-    cfs_rq.total_weight = 0;
-    pthread_mutex_init(&cfs_rq.rq_lock, NULL);
-}
-
-static const uint32_t nice_to_weight[40] = {
-    88761, 71755, 56483, 46273, 36291, 29154, 23254, 18705, 14949, 11916,
-     9548,  7620,  6100,  4904,  3906,  3121,  2501,  1991,  1586,  1277,
-     1024,   820,   655,   526,   423,   335,   272,   215,   172,   137,
-      110,    87,    70,    56,    45,    36,    29,    23,    18,    15
-};
-
-uint32_t cfs_compute_weight(int nice) {
-    if (nice < -20) nice = -20;
-    if (nice >  19) nice =  19;
-    return nice_to_weight[nice + 20];
-}
-
-void cfs_enqueue(pcb_t *p) {
-    pthread_mutex_lock(&cfs_rq.rq_lock);
-    rbtree_insert(cfs_rq.tree, p);
-    cfs_rq.total_weight += p->weight;
-    pthread_mutex_unlock(&cfs_rq.rq_lock);
-}
-
-void cfs_dequeue(pcb_t *p) {
-    pthread_mutex_lock(&cfs_rq.rq_lock);
-    rbtree_delete(cfs_rq.tree, p);
-    cfs_rq.total_weight -= p->weight;
-    pthread_mutex_unlock(&cfs_rq.rq_lock);
-}
-
-pcb_t *cfs_pick_next(void) {
-    pthread_mutex_lock(&cfs_rq.rq_lock);
-    pcb_t *p = cfs_tree_min();
-    pthread_mutex_unlock(&cfs_rq.rq_lock);
-    return p;
-}
-
-uint64_t cfs_timeslice(pcb_t *p, uint32_t extern_weight) {
-    uint64_t total = (cfs_rq.total_weight + extern_weight) ? (cfs_rq.total_weight + extern_weight) : 1;
-    uint64_t slice = (SCHED_LATENCY_NSEC * p->weight) / total;
-    return (slice < MIN_GRANULARITY_NSEC ? MIN_GRANULARITY_NSEC : slice);
-}
-
-void cfs_update_vruntime(pcb_t *p, uint64_t delta_ns, uint32_t extern_weight) {
-    // virtual runtime is double now
-    double proportion = (double)delta_ns * WEIGHT_NORM / (double)(p->weight + extern_weight);
-    p->vruntime += proportion;
-}
-
-void cfs_task_tick(pcb_t *p, uint64_t elapsed_ns, uint32_t extern_weight) {
-    if (!p) return;
-    // cfs_dequeue(p);
-    cfs_update_vruntime(p, elapsed_ns, extern_weight);
-    cfs_enqueue(p);
-}
+#include "cfs.h"
+#include "policy.h"
+#include "oprec.h"
+#include "prof.h"
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+
+/**
+ * Comparator for CFS run-queue: compare by vruntime, then weight (higher first), then pid.
+ */
+static inline int cfs_cmp(const pcb_t *p1, const pcb_t *p2) {
+    uint64_t v1 = p1->vruntime;
+    uint64_t v2 = p2->vruntime;
+    if (v1 < v2) return -1;
+    if (v1 > v2) return  1;
+    if (p1->weight > p2->weight) return -1;
+    if (p1->weight < p2->weight) return  1;
+    if (p1->pid < p2->pid) return -1;
+    if (p1->pid > p2->pid) return  1;
+    return 0;
+}
+
+RB_GENERATE(cfs_tree, pcb_t, run_node, cfs_cmp)
+
+// cfs_cmp() past the vruntime, for the operation recorder.
+static inline uint64_t cfs_tie(const pcb_t *p) {
+    return (uint64_t)(UINT32_MAX - p->weight) << 32 | p->pid;
+}
+
+void cfs_init_rq(struct cfs_rq *rq, const cfs_tunables *tun) {
+    cfs_tree_init(&rq->tree);
+    rq->total_weight = 0;
+    rq->nr_running = 0;
+    rq->min_vruntime = 0;
+    rq->tg = NULL;
+    rq->mlq = NULL;
+    rq->tun = tun;
+    for (int i = 0; i < CFS_INV_CACHE; i++)
+        rq->inv_cache[i].weight = 0;
+    pthread_mutex_init(&rq->rq_lock, NULL);
+}
+
+void cfs_destroy_rq(struct cfs_rq *rq) {
+    cfs_tree_init(&rq->tree);
+    rq->total_weight = 0;
+    rq->nr_running = 0;
+    pthread_mutex_destroy(&rq->rq_lock);
+}
+
+static const uint32_t nice_to_weight[40] = {
+    88761, 71755, 56483, 46273, 36291, 29154, 23254, 18705, 14949, 11916,
+     9548,  7620,  6100,  4904,  3906,  3121,  2501,  1991,  1586,  1277,
+     1024,   820,   655,   526,   423,   335,   272,   215,   172,   137,
+      110,    87,    70,    56,    45,    36,    29,    23,    18,    15
+};
+
+uint32_t cfs_compute_weight(int nice) {
+    if (nice < -20) nice = -20;
+    if (nice >  19) nice =  19;
+    return nice_to_weight[nice + 20];
+}
+
+// Follow the leftmost queued task, but never move backwards.
+static void update_min_vruntime(struct cfs_rq *rq) {
+    pcb_t *first = cfs_tree_first(&rq->tree);
+    if (first && first->vruntime > rq->min_vruntime)
+        rq->min_vruntime = first->vruntime;
+}
+
+// Queue a task is kept on: its group's, or rq itself for an ungrouped task.
+static inline struct cfs_rq *leaf_rq(struct cfs_rq *rq, const pcb_t *p) {
+    return p->group ? &p->group->rq : rq;
+}
+
+static void enqueue_entity(struct cfs_rq *rq, pcb_t *se) {
+    cfs_tree_insert(&rq->tree, se);
+    OPREC(OPQ_RUN, OP_INSERT, rq, se, se->vruntime, cfs_tie(se));
+    PROF_COUNT(PROF_RQ_INSERT);
+    rq->total_weight += se->weight;
+    rq->nr_running++;
+    se->rq = rq;
+    se->on_rq = true;
+    update_min_vruntime(rq);
+}
+
+static bool dequeue_entity(struct cfs_rq *rq, pcb_t *se) {
+    bool was_on = false;
+    if (se->on_rq) {
+        cfs_tree_erase(&rq->tree, se);
+        OPREC(OPQ_RUN, OP_ERASE, rq, se, se->vruntime, cfs_tie(se));
+        PROF_COUNT(PROF_RQ_ERASE);
+        rq->total_weight -= se->weight;
+        rq->nr_running--;
+        se->on_rq = false;
+        update_min_vruntime(rq);
+        was_on = true;
+    }
+    return was_on;
+}
+
+// A group coming back on its parent queue is placed like a waking task; the
+// first time, like a new one.
+static void place_group(struct task_group *tg) {
+    pcb_t *se = &tg->se;
+    if (!tg->placed) {
+        cfs_place_entity(se->rq, se);
+        tg->placed = true;
+    } else {
+        cfs_place_wakeup(se->rq, se);
+    }
+}
+
+// A group is queued exactly while its own queue is not empty.
+void cfs_enqueue(struct cfs_rq *rq, pcb_t *p) {
+    rq = leaf_rq(rq, p);
+    enqueue_entity(rq, p);
+    for (struct task_group *tg = rq->tg; tg && !tg->se.on_rq; tg = tg->parent) {
+        place_group(tg);
+        enqueue_entity(tg->se.rq, &tg->se);
+    }
+}
+
+void cfs_dequeue(struct cfs_rq *rq, pcb_t *p) {
+    rq = leaf_rq(rq, p);
+    if (!dequeue_entity(rq, p)) return;
+    while (rq->tg && rq->nr_running == 0 && dequeue_entity(rq->tg->se.rq, &rq->tg->se))
+        rq = rq->tg->se.rq;
+}
+
+pcb_t *cfs_pick_next(struct cfs_rq *rq) {
+    pcb_t *se = cfs_tree_first(&rq->tree);
+    if (se) OPREC(OPQ_RUN, OP_MIN, rq, se, se->vruntime, cfs_tie(se));
+    while (se && se->my_q) {
+        struct cfs_rq *q = se->my_q;
+        se = cfs_tree_first(&q->tree);
+        if (se) OPREC(OPQ_RUN, OP_MIN, q, se, se->vruntime, cfs_tie(se));
+    }
+    return se;
+}
+
+uint64_t cfs_timeslice(struct cfs_rq *rq, pcb_t *p, uint32_t extern_weight) {
+    uint64_t total = (rq->total_weight + extern_weight) ? (rq->total_weight + extern_weight) : 1;
+    uint64_t slice = (rq->tun->sched_latency * p->weight) / total;
+    return (slice < rq->tun->min_granularity ? rq->tun->min_granularity : slice);
+}
+
+/*
+ * Weight a grouped task has in the root queue: its share of its group's
+ * queue, times the group's share of the level above, up to the root. The
+ * entity on the path counts even while it is off its queue running.
+ */
+static uint64_t group_weight(const pcb_t *p) {
+    uint64_t w = p->weight;
+    const pcb_t *se = p;
+    for (struct task_group *tg = p->group; tg; tg = tg->parent) {
+        uint64_t load = tg->rq.total_weight + (se->on_rq ? 0 : se->weight);
+        w = w * tg->se.weight / load;
+        se = &tg->se;
+    }
+    return w ? w : 1;
+}
+
+/**
+ * min(cfs_timeslice(), cap) for a queued-plus-extern weight of `total`, and
+ * the range [*lo, *hi] of totals that give the same value. The slice is
+ * floor(latency * w / total), so it only changes when total leaves that
+ * range; once clamped to min_granularity or cap it may never change.
+ * A grouped task's slice uses group_weight() instead of its own weight.
+ */
+uint64_t cfs_timeslice_range(const struct cfs_rq *rq, const pcb_t *p, uint64_t total,
+                             uint64_t cap, uint64_t *lo, uint64_t *hi) {
+    uint64_t x = rq->tun->sched_latency * group_weight(p);
+    uint64_t gran = rq->tun->min_granularity;
+    uint64_t s = x / (total ? total : 1);
+    if (cap <= gran) {
+        *lo = 0;
+        *hi = UINT64_MAX;
+        return cap;
+    }
+    if (p->group) {
+        // Also depends on the group queues: an empty range, so every
+        // change of load recomputes it.
+        *lo = UINT64_MAX;
+        *hi = 0;
+        return s < gran ? gran : s > cap ? cap : s;
+    }
+    if (s >= cap) {
+        *lo = 0;
+        *hi = x / cap;
+        return cap;
+    }
+    if (s <= gran) {
+        *lo = x / (gran + 1) + 1;
+        *hi = UINT64_MAX;
+        return gran;
+    }
+    *lo = x / (s + 1) + 1;
+    *hi = x / s;
+    return s;
+}
+
+/**
+ * delta_ns * WEIGHT_NORM / weight in vruntime units, as a multiply-shift.
+ * The denominators are sums of task weights, so rather than a fixed table
+ * the inverse of each one is computed on first use and kept in a small
+ * direct-mapped cache; a long run only ever sees a handful of them.
+ */
+uint64_t cfs_calc_delta(struct cfs_rq *rq, uint64_t delta_ns, uint64_t weight) {
+    cfs_inv_weight *e = &rq->inv_cache[(weight * 0x9E3779B97F4A7C15ULL) >> (64 - CFS_INV_CACHE_BITS)];
+    if (e->weight != weight) {
+        e->weight = weight;
+        e->inv = UINT64_MAX / weight + 1;       // weight >= 2, so this is the ceiling
+    }
+    return (uint64_t)(((unsigned __int128)delta_ns * e->inv) >> (64 - WEIGHT_NORM_SHIFT - VRUNTIME_SHIFT));
+}
+
+void cfs_update_vruntime(struct cfs_rq *rq, pcb_t *p, uint64_t delta_ns, uint32_t extern_weight) {
+    p->vruntime += cfs_calc_delta(rq, delta_ns, (uint64_t)p->weight + extern_weight);
+}
+
+void cfs_task_tick(struct cfs_rq *rq, pcb_t *p, uint64_t elapsed_ns, uint32_t extern_weight) {
+    if (!p) return;
+    // cfs_dequeue(p);
+    cfs_update_vruntime(leaf_rq(rq, p), p, elapsed_ns, extern_weight);
+    // Every group above p ran too; a queued one is re-keyed in place.
+    for (struct task_group *tg = p->group; tg; tg = tg->parent) {
+        pcb_t *se = &tg->se;
+        bool queued = dequeue_entity(se->rq, se);
+        cfs_update_vruntime(se->rq, se, elapsed_ns, extern_weight);
+        if (queued) enqueue_entity(se->rq, se);
+        tg->cpu_time += elapsed_ns;
+    }
+    cfs_enqueue(rq, p);
+}
+
+uint64_t cfs_top_vruntime(const pcb_t *p) {
+    const pcb_t *se = p;
+    for (struct task_group *tg = p->group; tg; tg = tg->parent)
+        se = &tg->se;
+    return se->vruntime;
+}
+
+// A newly arrived task starts at the queue's min_vruntime, not at 0.
+void cfs_place_entity(struct cfs_rq *rq, pcb_t *p) {
+    rq = leaf_rq(rq, p);
+    if (p->vruntime < rq->min_vruntime) p->vruntime = rq->min_vruntime;
+}
+
+/**
+ * A task waking from sleep keeps its own vruntime, but no less than half a
+ * latency period behind min_vruntime: it gets a head start on the tasks
+ * that kept running without banking credit for the whole time it slept.
+ * One that last ran on another queue is first carried over like cfs_move().
+ */
+void cfs_place_wakeup(struct cfs_rq *rq, pcb_t *p) {
+    rq = leaf_rq(rq, p);
+    struct cfs_rq *prev = p->rq;
+    if (prev && prev != rq) {
+        uint64_t lag = p->vruntime > prev->min_vruntime ? p->vruntime - prev->min_vruntime : 0;
+        p->vruntime = rq->min_vruntime + lag;
+    }
+    uint64_t thresh = (rq->tun->sched_latency / 2) << VRUNTIME_SHIFT;
+    uint64_t floor = rq->min_vruntime > thresh ? rq->min_vruntime - thresh : 0;
+    if (p->vruntime < floor) p->vruntime = floor;
+}
+
+static const pcb_t *parent_entity(const pcb_t *se) {
+    return se->group ? &se->group->se : NULL;
+}
+
+static int entity_depth(const pcb_t *se) {
+    int d = 0;
+    while ((se = parent_entity(se))) d++;
+    return d;
+}
+
+/**
+ * Should woken p take the CPU from curr? Only if it leads by the wakeup
+ * granularity. Tasks in different groups are compared through their
+ * ancestors that share a queue.
+ */
+bool cfs_wakeup_preempt(struct cfs_rq *rq, const pcb_t *curr, const pcb_t *p) {
+    if (curr->group || p->group) {
+        int dc = entity_depth(curr), dp = entity_depth(p);
+        for (; dc > dp; dc--) curr = parent_entity(curr);
+        for (; dp > dc; dp--) p = parent_entity(p);
+        while (parent_entity(curr) != parent_entity(p)) {
+            curr = parent_entity(curr);
+            p = parent_entity(p);
+        }
+        rq = p->rq;
+    }
+    uint64_t gran = cfs_calc_delta(rq, rq->tun->wakeup_granularity, p->weight);
+    return curr->vruntime > p->vruntime && curr->vruntime - p->vruntime > gran;
+}
+
+// Move a queued task between queues, keeping its lead over min_vruntime.
+void cfs_move(struct cfs_rq *src, struct cfs_rq *dst, pcb_t *p) {
+    uint64_t lag = p->vruntime > src->min_vruntime ? p->vruntime - src->min_vruntime : 0;
+    cfs_dequeue(src, p);
+    p->vruntime = dst->min_vruntime + lag;
+    cfs_enqueue(dst, p);
+}
+
+void cfs_group_init(struct task_group *tg, uint32_t id, uint32_t shares,
+                    struct task_group *parent, struct cfs_rq *root) {
+    memset(tg, 0, sizeof(*tg));
+    tg->id = id;
+    tg->parent = parent;
+    cfs_init_rq(&tg->rq, root->tun);
+    tg->rq.tg = tg;
+    tg->se.pid = id;
+    tg->se.weight = shares;
+    tg->se.my_q = &tg->rq;
+    tg->se.group = parent;
+    tg->se.rq = parent ? &parent->rq : root;
+}
+
+void cfs_group_destroy(struct task_group *tg) {
+    cfs_destroy_rq(&tg->rq);
+}
+
+/* ---- policy ---- */
+
+static void cfs_policy_enqueue(struct cfs_rq *rq, pcb_t *p, bool wakeup) {
+    if (wakeup) cfs_place_wakeup(rq, p);
+    else        cfs_place_entity(rq, p);
+    cfs_enqueue(rq, p);
+}
+
+/*
+ * In order, descending into each group's queue where its entity sits. Every
+ * queue is then refilled in vruntime order, so placing a task on the way
+ * back never moves it: min_vruntime stays at or below what is queued.
+ */
+static void cfs_for_each(struct cfs_rq *rq, void (*fn)(pcb_t *p, void *arg), void *arg) {
+    for (pcb_t *se = cfs_tree_first(&rq->tree); se; se = cfs_tree_next(se)) {
+        if (se->my_q) cfs_for_each(se->my_q, fn, arg);
+        else          fn(se, arg);
+    }
+}
+
+const sched_policy cfs_policy = {
+    .name           = "cfs",
+    .groups         = true,
+    .preemptive     = true,
+    .init_rq        = cfs_init_rq,
+    .destroy_rq     = cfs_destroy_rq,
+    .enqueue        = cfs_policy_enqueue,
+    .dequeue        = cfs_dequeue,
+    .pick_next      = cfs_pick_next,
+    .timeslice      = cfs_timeslice_range,
+    .tick           = cfs_task_tick,
+    .move           = cfs_move,
+    .wakeup_preempt = cfs_wakeup_preempt,
+    .for_each       = cfs_for_each,
+};
@@ -1,69 +1,400 @@
-#include <stdlib.h>
-#include "cpu.h"
-#include "heap.h"
-
-cpu_manager cpu_m;
-
-void cpu_init(int n) {
-    cpu_m.n = n;
-    cpu_m.total_weight_proc = 0;
-
-    // Cấp phát mảng cpu_t
-    cpu_m.cpu_list = malloc(n * sizeof(cpu_t));
-
-    // Khởi tạo heap lưu con trỏ cpu_t*
-    heap_init(&cpu_m.cpu_heap, sizeof(cpu_t *), n, cpu_freecmp);
-
-    for (int i = 0; i < n; ++i) {
-        cpu_t *ptr = &cpu_m.cpu_list[i];
-        ptr->cpu_id          = i + 1;
-        ptr->running_time    = 0;
-        ptr->running_process = NULL;
-        ptr->last_dispatch   = 0;
-        heap_push(&cpu_m.cpu_heap, &ptr);  
-    }
-}
-
-void cpu_destroy(void) {
-    heap_free(&cpu_m.cpu_heap);
-    free(cpu_m.cpu_list);
-    cpu_m.cpu_list = NULL;
-    cpu_m.n = 0;
-    cpu_m.total_weight_proc = 0;
-}
-
-cpu_t *cpu_peek(void) {
-    cpu_t *c;
-    return heap_peek(&cpu_m.cpu_heap, &c) == 0 ? c : NULL;
-}
-
-cpu_t *cpu_pop(void) {
-    cpu_t *c;
-    return heap_pop(&cpu_m.cpu_heap, &c) == 0 ? c : NULL;
-}
-
-void cpu_push(cpu_t *c) {
-    heap_push(&cpu_m.cpu_heap, &c);  // push địa chỉ của cpu_t*
-}
-
-int cpu_dispatch(pcb_t *p, int current_time) {
-    cpu_t *c;
-    if (heap_pop(&cpu_m.cpu_heap, &c) != 0) {
-        return -1;
-    }
-    c->running_process = p;
-    c->last_dispatch   = current_time;
-    cpu_m.total_weight_proc += p->weight;
-    return 0;
-}
-
-int cpu_release(cpu_t *c, int current_time) {
-    c->running_time += (current_time - c->last_dispatch);
-    pcb_t *p = c->running_process;
-    if (p) {
-        cpu_m.total_weight_proc -= p->weight;
-    }
-    c->running_process = NULL;
-    cpu_push(c);  // đưa CPU trở lại heap
-    return 0;
-}
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include "cpu.h"
+#include "cfs.h"
+#include "trace.h"
+#include "oprec.h"
+
+#define OPREC_CPU(op, cm, c) OPREC(OPQ_CPU, op, &(cm)->cpu_heap, c, (c)->running_time, (c)->cpu_id)
+
+void cpu_init(cpu_manager *cm, int n, bool per_cpu_rq, struct cfs_rq *shared_rq,
+              const sched_policy *pol, const cfs_tunables *tun,
+              const cpu_topology *topo, bool affinity, trace_t *trace) {
+    cm->n = n;
+    cm->total_weight_proc = 0;
+    cm->per_cpu_rq = per_cpu_rq;
+    cm->nr_migrations = 0;
+    cm->last_balance = 0;
+    cm->shared_rq = shared_rq;
+    cm->pol = pol;
+    cm->trace = trace;
+    cm->topo = *topo;
+    cm->affinity = affinity;
+
+    // Cấp phát mảng cpu_t
+    cm->cpu_list = malloc(n * sizeof(cpu_t));
+    cm->rqs = per_cpu_rq ? malloc(n * sizeof(struct cfs_rq)) : NULL;
+
+    // Khởi tạo heap lưu con trỏ cpu_t*
+    cpu_heap_init(&cm->cpu_heap, n);
+    cpu_slice_lo_init(&cm->slice_lo, n);
+    cpu_slice_hi_init(&cm->slice_hi, n);
+    cm->young_head = cm->young_tail = NULL;
+    cpu_victims_init(&cm->victims, n);
+    cm->stale = malloc(n * sizeof(cpu_t *));
+    size_t words = ((size_t)n + 63) / 64;
+    cm->idle_mask = malloc(words * sizeof(uint64_t));
+    if (!cm->cpu_list || (per_cpu_rq && !cm->rqs) || !cm->stale || !cm->idle_mask) {
+        perror("malloc");
+        exit(EXIT_FAILURE);
+    }
+    memset(cm->idle_mask, 0xff, words * sizeof(uint64_t));
+
+    for (int i = 0; i < n; ++i) {
+        cpu_t *ptr = &cm->cpu_list[i];
+        ptr->cpu_id          = i + 1;
+        ptr->running_time    = 0;
+        ptr->running_process = NULL;
+        ptr->last_dispatch   = 0;
+        ptr->warmup          = 0;
+        ptr->heap_idx        = HEAP_NONE;
+        ptr->end_ev          = NULL;
+        ptr->slice_lo        = 0;
+        ptr->slice_hi        = UINT64_MAX;
+        ptr->slice_lo_idx    = HEAP_NONE;
+        ptr->slice_hi_idx    = HEAP_NONE;
+        ptr->young_prev      = NULL;
+        ptr->young_next      = NULL;
+        ptr->young           = false;
+        ptr->victim_vruntime = 0;
+        ptr->victim_idx      = HEAP_NONE;
+        if (per_cpu_rq) {
+            pol->init_rq(&cm->rqs[i], tun);
+            ptr->rq = &cm->rqs[i];
+        } else {
+            ptr->rq = shared_rq;
+        }
+        cpu_heap_push(&cm->cpu_heap, ptr);
+        OPREC_CPU(OP_INSERT, cm, ptr);
+    }
+}
+
+void cpu_destroy(cpu_manager *cm) {
+    cpu_heap_free(&cm->cpu_heap);
+    cpu_slice_lo_free(&cm->slice_lo);
+    cpu_slice_hi_free(&cm->slice_hi);
+    cpu_victims_free(&cm->victims);
+    free(cm->stale);
+    cm->stale = NULL;
+    free(cm->idle_mask);
+    cm->idle_mask = NULL;
+    if (cm->rqs) {
+        for (int i = 0; i < cm->n; ++i)
+            cm->pol->destroy_rq(&cm->rqs[i]);
+        free(cm->rqs);
+        cm->rqs = NULL;
+    }
+    free(cm->cpu_list);
+    cm->cpu_list = NULL;
+    cm->n = 0;
+    cm->total_weight_proc = 0;
+}
+
+static void cpu_mark_idle(cpu_manager *cm, const cpu_t *c, bool idle) {
+    uint32_t i = c->cpu_id - 1;
+    uint64_t bit = 1ULL << (i & 63);
+    if (idle) cm->idle_mask[i >> 6] |= bit;
+    else      cm->idle_mask[i >> 6] &= ~bit;
+}
+
+// Idle, and in per-CPU mode with nothing queued: a task placed here runs now.
+static bool cpu_free(const cpu_manager *cm, const cpu_t *c) {
+    uint32_t i = c->cpu_id - 1;
+    return (cm->idle_mask[i >> 6] >> (i & 63) & 1) && (!cm->per_cpu_rq || c->rq->nr_running == 0);
+}
+
+/*
+ * Least used free CPU closest to CPU index prev: prev itself, then its SMT
+ * siblings, its LLC and its node. NULL if the whole node is busy.
+ */
+static cpu_t *cpu_near_free(cpu_manager *cm, uint32_t prev) {
+    cpu_t *c = &cm->cpu_list[prev];
+    if (cpu_free(cm, c)) return c;
+    cpu_t *top = cpu_heap_peek(&cm->cpu_heap);
+    if (top) OPREC_CPU(OP_MIN, cm, top);
+    uint32_t span = 1;
+    for (topo_level l = TOPO_SMT; l <= TOPO_NODE; l++) {
+        uint32_t lo, hi;
+        topology_domain(&cm->topo, prev, l, &lo, &hi);
+        if (hi - lo == span) continue;      // same CPUs as the level below
+        span = hi - lo;
+        // The least used idle CPU overall is also the least used of any domain it is in.
+        if (top && top->cpu_id - 1 >= lo && top->cpu_id - 1 < hi && cpu_free(cm, top))
+            return top;
+        cpu_t *best = NULL;
+        for (int i = cpu_next_idle(cm, (int)lo); i < (int)hi; i = cpu_next_idle(cm, i + 1)) {
+            c = &cm->cpu_list[i];
+            if (cpu_free(cm, c) && (!best || cpu_freecmp(c, best) < 0)) best = c;
+        }
+        if (best) return best;
+    }
+    return NULL;
+}
+
+cpu_t *cpu_affine_idle(cpu_manager *cm, const pcb_t *p, cpu_t *fallback) {
+    if (!cm->affinity || cm->per_cpu_rq || !p->last_cpu || !fallback) return fallback;
+    cpu_t *c = cpu_near_free(cm, p->last_cpu - 1);
+    return c ? c : fallback;
+}
+
+cpu_t *cpu_peek(cpu_manager *cm) {
+    cpu_t *c = cpu_heap_peek(&cm->cpu_heap);
+    if (c) OPREC_CPU(OP_MIN, cm, c);
+    return c;
+}
+
+cpu_t *cpu_pop(cpu_manager *cm) {
+    cpu_t *c = cpu_heap_pop(&cm->cpu_heap);
+    if (c) {
+        OPREC_CPU(OP_POP_MIN, cm, c);
+        cpu_mark_idle(cm, c, false);
+    }
+    return c;
+}
+
+void cpu_push(cpu_manager *cm, cpu_t *c) {
+    if (cpu_heap_contains(c)) return;   // already idle
+    cpu_heap_push(&cm->cpu_heap, c);
+    OPREC_CPU(OP_INSERT, cm, c);
+    cpu_mark_idle(cm, c, true);
+}
+
+// Dispatch times never decrease, so appending keeps the young list sorted.
+static void cpu_young_append(cpu_manager *cm, cpu_t *c) {
+    c->young = true;
+    c->young_next = NULL;
+    c->young_prev = cm->young_tail;
+    if (cm->young_tail) cm->young_tail->young_next = c;
+    else                cm->young_head = c;
+    cm->young_tail = c;
+}
+
+static void cpu_young_unlink(cpu_manager *cm, cpu_t *c) {
+    if (!c->young) return;
+    if (c->young_prev) c->young_prev->young_next = c->young_next;
+    else               cm->young_head = c->young_next;
+    if (c->young_next) c->young_next->young_prev = c->young_prev;
+    else               cm->young_tail = c->young_prev;
+    c->young = false;
+}
+
+static void cpu_assign(cpu_manager *cm, cpu_t *c, pcb_t *p, uint64_t current_time) {
+    c->running_process = p;
+    c->last_dispatch   = current_time;
+    cm->total_weight_proc += p->weight;
+    c->victim_vruntime = cfs_top_vruntime(p);
+    if (!cm->per_cpu_rq) cpu_young_append(cm, c);
+}
+
+int cpu_dispatch(cpu_manager *cm, pcb_t *p, uint64_t current_time) {
+    cpu_t *c = cpu_pop(cm);
+    if (!c) {
+        return -1;
+    }
+    cpu_assign(cm, c, p, current_time);
+    return 0;
+}
+
+// Dispatch onto a specific idle CPU rather than the least-used one.
+int cpu_dispatch_on(cpu_manager *cm, cpu_t *c, pcb_t *p, uint64_t current_time) {
+    if (cpu_heap_remove(&cm->cpu_heap, c) != 0) {
+        return -1;
+    }
+    OPREC_CPU(OP_ERASE, cm, c);
+    cpu_mark_idle(cm, c, false);
+    cpu_assign(cm, c, p, current_time);
+    return 0;
+}
+
+void cpu_restore(cpu_manager *cm, cpu_t *c, pcb_t *p, uint64_t last_dispatch,
+                 uint64_t victim_vruntime, bool young) {
+    cpu_dispatch_on(cm, c, p, last_dispatch);
+    c->victim_vruntime = victim_vruntime;
+    if (cm->per_cpu_rq || young) return;
+    cpu_young_unlink(cm, c);
+    cpu_victims_push(&cm->victims, c);
+}
+
+// Charge ran to c and re-sift it if it is sitting in the idle heap.
+void cpu_account(cpu_manager *cm, cpu_t *c, uint64_t ran) {
+    c->running_time += ran;
+    if (cpu_heap_contains(c)) OPREC_CPU(OP_UPDATE, cm, c);
+    cpu_heap_update(&cm->cpu_heap, c);
+}
+
+// ran: time the task on c has been running since its dispatch
+int cpu_release(cpu_manager *cm, cpu_t *c, uint64_t ran) {
+    cpu_account(cm, c, ran);
+    pcb_t *p = c->running_process;
+    if (p) {
+        cm->total_weight_proc -= p->weight;
+    }
+    c->running_process = NULL;
+    cpu_slice_lo_remove(&cm->slice_lo, c);
+    cpu_slice_hi_remove(&cm->slice_hi, c);
+    cpu_young_unlink(cm, c);
+    cpu_victims_remove(&cm->victims, c);
+    cpu_push(cm, c);  // đưa CPU trở lại heap
+    return 0;
+}
+
+void cpu_slice_set(cpu_manager *cm, cpu_t *c, uint64_t lo, uint64_t hi) {
+    c->slice_lo = lo;
+    c->slice_hi = hi;
+    if (cm->per_cpu_rq) return;     // each queue has its own total; checked in place
+    // An open end can never be crossed, so only finite bounds are tracked.
+    if (lo == 0)                       cpu_slice_lo_remove(&cm->slice_lo, c);
+    else if (cpu_slice_lo_contains(c)) cpu_slice_lo_update(&cm->slice_lo, c);
+    else                               cpu_slice_lo_push(&cm->slice_lo, c);
+    if (hi == UINT64_MAX)              cpu_slice_hi_remove(&cm->slice_hi, c);
+    else if (cpu_slice_hi_contains(c)) cpu_slice_hi_update(&cm->slice_hi, c);
+    else                               cpu_slice_hi_push(&cm->slice_hi, c);
+}
+
+int cpu_slice_stale(cpu_manager *cm, uint64_t total, cpu_t ***out) {
+    int n = 0;
+    cpu_t *c;
+    while ((c = cpu_slice_hi_peek(&cm->slice_hi)) && c->slice_hi < total) {
+        cpu_slice_hi_pop(&cm->slice_hi);
+        cpu_slice_lo_remove(&cm->slice_lo, c);
+        cm->stale[n++] = c;
+    }
+    while ((c = cpu_slice_lo_peek(&cm->slice_lo)) && c->slice_lo > total) {
+        cpu_slice_lo_pop(&cm->slice_lo);
+        cpu_slice_hi_remove(&cm->slice_hi, c);
+        cm->stale[n++] = c;
+    }
+    // Usually only a few: insertion sort beats qsort's call overhead.
+    for (int i = 1; i < n; i++) {
+        cpu_t *x = cm->stale[i];
+        int j = i;
+        for (; j > 0 && cm->stale[j - 1]->cpu_id > x->cpu_id; j--)
+            cm->stale[j] = cm->stale[j - 1];
+        cm->stale[j] = x;
+    }
+    *out = cm->stale;
+    return n;
+}
+
+/*
+ * A running task's vruntime and dispatch time stay fixed until its CPU is
+ * released, so CPUs only ever move from the young list to the heap, oldest
+ * dispatch first. (A group's vruntime moves while one of its tasks runs
+ * elsewhere, hence the key taken at dispatch.) Dispatch itself is O(1);
+ * only CPUs that have become preemptible by the time someone asks pay for
+ * a heap insert.
+ */
+cpu_t *cpu_preempt_victim(cpu_manager *cm, uint64_t now, uint64_t min_gran) {
+    cpu_t *c;
+    while ((c = cm->young_head) && now - c->last_dispatch >= min_gran) {
+        cpu_young_unlink(cm, c);
+        cpu_victims_push(&cm->victims, c);
+    }
+    return cpu_victims_peek(&cm->victims);
+}
+
+uint32_t cpu_extern_weight(const cpu_manager *cm, const cpu_t *c) {
+    if (!cm->per_cpu_rq) return cm->total_weight_proc;
+    return c->running_process ? c->running_process->weight : 0;
+}
+
+// Queued weight plus the weight of whatever is running on c.
+static uint64_t cpu_load(const cpu_t *c) {
+    uint64_t load = c->rq->total_weight;
+    if (c->running_process) load += c->running_process->weight;
+    return load;
+}
+
+static void cpu_migrate(cpu_manager *cm, pcb_t *p, cpu_t *src, cpu_t *dst, uint64_t now) {
+    cm->pol->move(src->rq, dst->rq, p);
+    cm->nr_migrations++;
+    trace_migrate(cm->trace, now, p->pid, src->cpu_id, dst->cpu_id);
+}
+
+/**
+ * Pick the queue a newly runnable task goes to: with affinity, a free CPU
+ * close to the one p last ran on; otherwise the least loaded CPU, ties
+ * broken the same way as the idle heap so arrivals land where dispatch looks.
+ */
+struct cfs_rq *cpu_select_rq(cpu_manager *cm, const pcb_t *p) {
+    if (!cm->per_cpu_rq) return cm->shared_rq;
+    if (cm->affinity && p->last_cpu) {
+        // Nothing free nearby: wait for the cache-hot CPU, balancing permitting.
+        cpu_t *near = cpu_near_free(cm, p->last_cpu - 1);
+        return near ? near->rq : cm->cpu_list[p->last_cpu - 1].rq;
+    }
+    // An idle CPU with an empty queue has load 0, and the idle heap already
+    // orders those by cpu_freecmp: if the least used one qualifies, it wins.
+    cpu_t *idle = cpu_heap_peek(&cm->cpu_heap);
+    if (idle) OPREC_CPU(OP_MIN, cm, idle);
+    if (idle && cpu_load(idle) == 0) return idle->rq;
+    cpu_t *best = &cm->cpu_list[0];
+    uint64_t best_load = cpu_load(best);
+    for (int i = 1; i < cm->n; ++i) {
+        cpu_t *c = &cm->cpu_list[i];
+        uint64_t load = cpu_load(c);
+        if (load < best_load || (load == best_load && cpu_freecmp(c, best) < 0)) {
+            best = c;
+            best_load = load;
+        }
+    }
+    return best->rq;
+}
+
+// CPU other than c with the heaviest non-empty queue among indices [lo, hi).
+static cpu_t *cpu_busiest(cpu_manager *cm, const cpu_t *c, uint32_t lo, uint32_t hi) {
+    cpu_t *busiest = NULL;
+    for (uint32_t i = lo; i < hi; ++i) {
+        cpu_t *src = &cm->cpu_list[i];
+        if (src == c || src->rq->nr_running == 0) continue;
+        if (!busiest || src->rq->total_weight > busiest->rq->total_weight)
+            busiest = src;
+    }
+    return busiest;
+}
+
+/**
+ * Called when c found its own queue empty: pull the next task of the CPU with
+ * the heaviest queue, looking within c's LLC and then its node first under
+ * affinity. Returns the pulled task (now on c->rq) or NULL.
+ */
+pcb_t *cpu_idle_balance(cpu_manager *cm, cpu_t *c, uint64_t now) {
+    if (!cm->per_cpu_rq) return NULL;
+    cpu_t *busiest = NULL;
+    for (topo_level l = cm->affinity ? TOPO_LLC : TOPO_REMOTE; !busiest && l <= TOPO_REMOTE; l++) {
+        uint32_t lo, hi;
+        topology_domain(&cm->topo, c->cpu_id - 1, l, &lo, &hi);
+        busiest = cpu_busiest(cm, c, lo, hi);
+    }
+    if (!busiest) return NULL;
+    pcb_t *p = cm->pol->pick_next(busiest->rq);
+    cpu_migrate(cm, p, busiest, c, now);
+    return p;
+}
+
+/**
+ * Periodic pass: repeatedly move one queued task from the most to the least
+ * loaded CPU while that narrows the gap. Returns the number of migrations.
+ */
+int cpu_load_balance(cpu_manager *cm, uint64_t now) {
+    if (!cm->per_cpu_rq) return 0;
+    cm->last_balance = now;
+    int moved = 0;
+    while (moved < cm->n) {
+        cpu_t *busiest = NULL, *idlest = NULL;
+        for (int i = 0; i < cm->n; ++i) {
+            cpu_t *c = &cm->cpu_list[i];
+            if (!idlest || cpu_load(c) < cpu_load(idlest))
+                idlest = c;
+            if (c->rq->nr_running && (!busiest || cpu_load(c) > cpu_load(busiest)))
+                busiest = c;
+        }
+        if (!busiest || busiest == idlest) break;
+        pcb_t *p = cm->pol->pick_next(busiest->rq);
+        if (p->weight >= cpu_load(busiest) - cpu_load(idlest)) break;
+        cpu_migrate(cm, p, busiest, idlest, now);
+        moved++;
+    }
+    return moved;
+}
@@ -1,76 +1,370 @@
-#include <stdlib.h>
-#include <string.h>
-#include "event.h"
-
-static int ev_cmp(void *a, void *b) {
-    const event_t *A = a, *B = b;
-    if (A->time < B->time) return -1;
-    if (A->time > B->time) return +1;
-    if (A->ev != B->ev)
-      return (A->ev == EVENT_END ? -1 : +1);
-    if (A->ev == EVENT_ARRIVAL) {
-        if (A->proc < B->proc) return -1;
-        if (A->proc > B->proc) return +1;
-        return 0;
-    } else {
-        if (A->cpu < B->cpu) return -1;
-        if (A->cpu > B->cpu) return +1;
-        return 0;
-    }
-}
-
-
-static void *clone_event(void *data) {
-    event_t *src = data;
-    event_t *dst = malloc(sizeof(*dst));
-    memcpy(dst, src, sizeof(*dst));
-    return dst;
-}
-
-static void free_event(void *data) {
-    free(data);
-}
-
-void event_tree_init(event_tree *et) {
-    et->tree = new_rbtree(ev_cmp, clone_event, free_event);
-}
-
-void event_tree_destroy(event_tree *et) {
-    destroy_rbtree(et->tree);
-    et->tree = NULL;
-}
-
-void event_tree_insert(event_tree *et, const event_t *ev) {
-    rbtree_insert(et->tree, (void*)ev);
-}
-
-static void *rbtree_find_min_node(RBTree *tr) {
-    RBNode *n = tr->root;
-    if (!n) return NULL;
-    while (n->left) n = n->left;
-    return n->data;
-}
-
-bool event_tree_peek(const event_tree *et, event_t *out_ev) {
-    void *d = rbtree_find_min_node(et->tree);
-    if (!d) return false;
-    *out_ev = *(event_t*)d;
-    return true;
-}
-
-bool event_tree_pop(event_tree *et, event_t *out_ev) {
-    void *d = rbtree_find_min_node(et->tree);
-    if (!d) return false;
-    *out_ev = *(event_t*)d;
-    rbtree_delete(et->tree, d);
-    return true;
-}
-
-int event_delete(event_tree *et, const event_t *to_del) {
-    event_t *found = (event_t *)rbtree_search(et->tree, (void *)to_del);
-    if (found) {
-        rbtree_delete(et->tree, found);
-        return 0;
-    }
-    return -1;
-}
\ No newline at end of file
+#include <stdlib.h>
+#include <stdio.h>
+#include "event.h"
+#include "oprec.h"
+#include "prof.h"
+
+#define EVENT_CHUNK_NODES 256
+
+struct event_chunk {
+    event_chunk *next;
+    event_node   nodes[EVENT_CHUNK_NODES];
+};
+
+/*
+ * At equal times CPUs are freed first, then woken tasks and arrivals come
+ * in. END and SLEEP share a rank so a stint can change kind while queued.
+ */
+static const int ev_rank[] = {
+    [EVENT_END] = 0, [EVENT_SLEEP] = 0, [EVENT_WAKEUP] = 1, [EVENT_ARRIVAL] = 2
+};
+
+static inline int ev_cmp(const event_node *a, const event_node *b) {
+    const event_t *A = &a->ev, *B = &b->ev;
+    if (A->time < B->time) return -1;
+    if (A->time > B->time) return +1;
+    if (ev_rank[A->ev] != ev_rank[B->ev])
+      return (ev_rank[A->ev] < ev_rank[B->ev] ? -1 : +1);
+    if (A->ev == EVENT_ARRIVAL || A->ev == EVENT_WAKEUP) {
+        if (A->proc->seq < B->proc->seq) return -1;
+        if (A->proc->seq > B->proc->seq) return +1;
+        return 0;
+    } else {
+        if (A->cpu < B->cpu) return -1;
+        if (A->cpu > B->cpu) return +1;
+        return 0;
+    }
+}
+
+RB_GENERATE(event_rb, event_node, link, ev_cmp)
+
+// ev_cmp() past the time, for the operation recorder.
+static inline uint64_t ev_tie(const event_t *e) {
+    uint64_t rank = (uint64_t)ev_rank[e->ev] << 56;
+    if (e->ev == EVENT_ARRIVAL || e->ev == EVENT_WAKEUP) return rank | e->proc->seq;
+    return rank | e->cpu->cpu_id;
+}
+
+/*
+ * Hierarchical timing wheel.
+ *
+ * An event sits at the level of the highest 6-bit digit in which its time
+ * differs from `now`, in the slot given by that digit. Level 0 slots therefore
+ * hold a single time value each. When level 0 runs dry, the first occupied
+ * slot of the lowest occupied level is cascaded down after moving `now` to its
+ * start. Events sharing a time are ordered by ev_cmp when their level-0 slot
+ * is first looked at, so both backends pop in exactly the same order.
+ */
+
+static inline unsigned wheel_level(uint64_t now, uint64_t time) {
+    uint64_t diff = now ^ time;
+    return diff ? (unsigned)((63 - __builtin_clzll(diff)) / WHEEL_BITS) : 0;
+}
+
+static inline unsigned wheel_index(uint64_t time, unsigned level) {
+    return (unsigned)((time >> (level * WHEEL_BITS)) & (WHEEL_SLOTS - 1));
+}
+
+static void slot_push_front(timing_wheel *w, struct wheel_slot *s, event_node *n) {
+    n->wl.prev = NULL;
+    n->wl.next = s->head;
+    n->wl.slot = s;
+    if (s->head) s->head->wl.prev = n;
+    s->head = n;
+    w->occupied[s->level] |= 1ULL << s->index;
+}
+
+// Equal keys go after existing ones, like the tree.
+static void slot_insert_sorted(timing_wheel *w, struct wheel_slot *s, event_node *n) {
+    event_node *prev = NULL, *cur = s->head;
+    while (cur && ev_cmp(cur, n) <= 0) {
+        prev = cur;
+        cur = cur->wl.next;
+    }
+    if (!prev) {
+        slot_push_front(w, s, n);
+        return;
+    }
+    n->wl.prev = prev;
+    n->wl.next = cur;
+    n->wl.slot = s;
+    prev->wl.next = n;
+    if (cur) cur->wl.prev = n;
+}
+
+static void slot_unlink(timing_wheel *w, event_node *n) {
+    struct wheel_slot *s = n->wl.slot;
+    if (n->wl.prev) n->wl.prev->wl.next = n->wl.next;
+    else            s->head = n->wl.next;
+    if (n->wl.next) n->wl.next->wl.prev = n->wl.prev;
+    if (!s->head) w->occupied[s->level] &= ~(1ULL << s->index);
+}
+
+// Stable merge sort over the next links; prev links are rebuilt by the caller.
+static event_node *merge_sort(event_node *head) {
+    if (!head || !head->wl.next) return head;
+    event_node *slow = head, *fast = head->wl.next;
+    while (fast && fast->wl.next) {
+        slow = slow->wl.next;
+        fast = fast->wl.next->wl.next;
+    }
+    event_node *b = slow->wl.next;
+    slow->wl.next = NULL;
+    event_node *a = merge_sort(head);
+    b = merge_sort(b);
+
+    event_node dummy, *tail = &dummy;
+    while (a && b) {
+        if (ev_cmp(a, b) <= 0) { tail->wl.next = a; a = a->wl.next; }
+        else                   { tail->wl.next = b; b = b->wl.next; }
+        tail = tail->wl.next;
+    }
+    tail->wl.next = a ? a : b;
+    return dummy.wl.next;
+}
+
+static void slot_sort(struct wheel_slot *s) {
+    s->head = merge_sort(s->head);
+    event_node *prev = NULL;
+    for (event_node *n = s->head; n; n = n->wl.next) {
+        n->wl.prev = prev;
+        prev = n;
+    }
+    s->sorted = true;
+}
+
+// bulk: cascading, defer ordering of level-0 slots until they are looked at
+static void wheel_add(timing_wheel *w, event_node *n, bool bulk) {
+    unsigned l = wheel_level(w->now, n->ev.time);
+    struct wheel_slot *s = &w->slots[l][wheel_index(n->ev.time, l)];
+    if (!s->head) {
+        s->sorted = true;
+        slot_push_front(w, s, n);
+    } else if (l == 0 && s->sorted && !bulk) {
+        slot_insert_sorted(w, s, n);
+    } else {
+        s->sorted = false;
+        slot_push_front(w, s, n);
+    }
+}
+
+static void wheel_insert(timing_wheel *w, event_node *n) {
+    wheel_add(w, n, false);
+    if (w->min_cache && ev_cmp(n, w->min_cache) < 0)
+        w->min_cache = n;
+}
+
+static void wheel_remove(timing_wheel *w, event_node *n) {
+    slot_unlink(w, n);
+    if (w->min_cache == n)
+        w->min_cache = NULL;
+}
+
+// Earliest event without advancing `now`, so later inserts stay valid.
+static event_node *wheel_min(timing_wheel *w) {
+    if (w->min_cache) return w->min_cache;
+    for (unsigned l = 0; l < WHEEL_LEVELS; l++) {
+        if (!w->occupied[l]) continue;
+        struct wheel_slot *s = &w->slots[l][__builtin_ctzll(w->occupied[l])];
+        event_node *best = s->head;
+        if (l == 0) {
+            if (!s->sorted) slot_sort(s);
+            best = s->head;
+        } else {
+            for (event_node *n = best->wl.next; n; n = n->wl.next)
+                if (ev_cmp(n, best) < 0) best = n;
+        }
+        return w->min_cache = best;
+    }
+    return NULL;
+}
+
+static event_node *wheel_pop(timing_wheel *w) {
+    while (!w->occupied[0]) {
+        unsigned l = 1;
+        while (l < WHEEL_LEVELS && !w->occupied[l]) l++;
+        if (l == WHEEL_LEVELS) return NULL;
+
+        unsigned idx = __builtin_ctzll(w->occupied[l]);
+        struct wheel_slot *s = &w->slots[l][idx];
+        unsigned shift = (l + 1) * WHEEL_BITS;
+        uint64_t upper = shift >= 64 ? 0 : (w->now >> shift) << shift;
+        w->now = upper | ((uint64_t)idx << (l * WHEEL_BITS));
+
+        event_node *n = s->head;
+        s->head = NULL;
+        w->occupied[l] &= ~(1ULL << idx);
+        PROF_COUNT(PROF_WHEEL_CASCADE);
+        while (n) {
+            event_node *next = n->wl.next;
+            wheel_add(w, n, true);
+            n = next;
+        }
+    }
+    struct wheel_slot *s = &w->slots[0][__builtin_ctzll(w->occupied[0])];
+    if (!s->sorted) slot_sort(s);
+    event_node *n = s->head;
+    slot_unlink(w, n);
+    w->now = n->ev.time;
+    w->min_cache = NULL;
+    return n;
+}
+
+static event_node *wheel_find(timing_wheel *w, const event_node *key) {
+    unsigned l = wheel_level(w->now, key->ev.time);
+    struct wheel_slot *s = &w->slots[l][wheel_index(key->ev.time, l)];
+    for (event_node *n = s->head; n; n = n->wl.next)
+        if (ev_cmp(n, key) == 0) return n;
+    return NULL;
+}
+
+static timing_wheel *wheel_new(void) {
+    timing_wheel *w = calloc(1, sizeof(*w));
+    if (!w) {
+        perror("calloc");
+        exit(EXIT_FAILURE);
+    }
+    for (unsigned l = 0; l < WHEEL_LEVELS; l++) {
+        for (unsigned i = 0; i < WHEEL_SLOTS; i++) {
+            w->slots[l][i].level = (uint8_t)l;
+            w->slots[l][i].index = (uint8_t)i;
+        }
+    }
+    return w;
+}
+
+// Take a record from the free list, growing the pool one slab at a time.
+static event_node *alloc_node(event_tree *et) {
+    if (!et->free_list) {
+        event_chunk *ch = malloc(sizeof(*ch));
+        if (!ch) {
+            perror("malloc");
+            exit(EXIT_FAILURE);
+        }
+        ch->next = et->chunks;
+        et->chunks = ch;
+        for (int i = 0; i < EVENT_CHUNK_NODES; i++) {
+            ch->nodes[i].link.rbe_right = et->free_list;
+            et->free_list = &ch->nodes[i];
+        }
+    }
+    event_node *n = et->free_list;
+    et->free_list = n->link.rbe_right;
+    return n;
+}
+
+static void free_node(event_tree *et, event_node *n) {
+    n->link.rbe_right = et->free_list;
+    et->free_list = n;
+}
+
+// Link / unlink a record in whichever structure backs the queue.
+static void queue_link(event_tree *et, event_node *n) {
+    if (et->backend == EVQ_WHEEL) wheel_insert(et->wheel, n);
+    else                          event_rb_insert(&et->tree, n);
+    et->count++;
+}
+
+static void queue_unlink(event_tree *et, event_node *n) {
+    if (et->backend == EVQ_WHEEL) wheel_remove(et->wheel, n);
+    else                          event_rb_erase(&et->tree, n);
+    et->count--;
+}
+
+void event_tree_init(event_tree *et, evq_backend backend) {
+    et->backend = backend;
+    event_rb_init(&et->tree);
+    et->wheel = backend == EVQ_WHEEL ? wheel_new() : NULL;
+    et->count = 0;
+    et->free_list = NULL;
+    et->chunks = NULL;
+}
+
+void event_tree_destroy(event_tree *et) {
+    while (et->chunks) {
+        event_chunk *next = et->chunks->next;
+        free(et->chunks);
+        et->chunks = next;
+    }
+    free(et->wheel);
+    et->wheel = NULL;
+    event_rb_init(&et->tree);
+    et->count = 0;
+    et->free_list = NULL;
+}
+
+event_handle event_tree_insert(event_tree *et, const event_t *ev) {
+    event_node *n = alloc_node(et);
+    n->ev = *ev;
+    queue_link(et, n);
+    OPREC(OPQ_EVENT, OP_INSERT, et, n, n->ev.time, ev_tie(&n->ev));
+    PROF_COUNT(PROF_EV_INSERT);
+    return n;
+}
+
+bool event_tree_peek(event_tree *et, event_t *out_ev) {
+    event_node *n = et->backend == EVQ_WHEEL ? wheel_min(et->wheel)
+                                             : event_rb_first(&et->tree);
+    if (!n) return false;
+    OPREC(OPQ_EVENT, OP_MIN, et, n, n->ev.time, ev_tie(&n->ev));
+    *out_ev = n->ev;
+    return true;
+}
+
+bool event_tree_pop(event_tree *et, event_t *out_ev) {
+    event_node *n;
+    if (et->backend == EVQ_WHEEL) {
+        n = wheel_pop(et->wheel);
+        if (!n) return false;
+    } else {
+        n = event_rb_first(&et->tree);
+        if (!n) return false;
+        event_rb_erase(&et->tree, n);
+    }
+    et->count--;
+    OPREC(OPQ_EVENT, OP_POP_MIN, et, n, n->ev.time, ev_tie(&n->ev));
+    PROF_COUNT(PROF_EV_POP);
+    *out_ev = n->ev;
+    free_node(et, n);
+    return true;
+}
+
+int event_delete(event_tree *et, const event_t *to_del) {
+    event_node key = { .ev = *to_del };
+    event_node *found = et->backend == EVQ_WHEEL ? wheel_find(et->wheel, &key)
+                                                 : event_rb_find(&et->tree, &key);
+    if (found) {
+        event_cancel(et, found);
+        return 0;
+    }
+    return -1;
+}
+
+// Drop a pending event through its handle: O(1) on the wheel.
+void event_cancel(event_tree *et, event_handle h) {
+    OPREC(OPQ_EVENT, OP_ERASE, et, h, h->ev.time, ev_tie(&h->ev));
+    PROF_COUNT(PROF_EV_CANCEL);
+    queue_unlink(et, h);
+    free_node(et, h);
+}
+
+// Reschedule a pending event in place; the handle stays valid.
+void event_move(event_tree *et, event_handle h, uint64_t new_time) {
+    queue_unlink(et, h);
+    h->ev.time = new_time;
+    queue_link(et, h);
+    OPREC(OPQ_EVENT, OP_UPDATE, et, h, new_time, ev_tie(&h->ev));
+    PROF_COUNT(PROF_EV_MOVE);
+}
+
+void event_tree_walk(const event_tree *et, void (*fn)(const event_t *ev, void *arg), void *arg) {
+    if (et->backend == EVQ_RBTREE) {
+        for (event_node *n = event_rb_first(&et->tree); n; n = event_rb_next(n))
+            fn(&n->ev, arg);
+        return;
+    }
+    for (unsigned l = 0; l < WHEEL_LEVELS; l++)
+        for (unsigned i = 0; i < WHEEL_SLOTS; i++)
+            for (event_node *n = et->wheel->slots[l][i].head; n; n = n->wl.next)
+                fn(&n->ev, arg);
+}
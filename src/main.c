@@ -1,333 +1,440 @@
-#include "common.h"
-#include "cfs.h"
-#include "heap.h"
-#include "event.h"
-#include "cpu.h"
-#include <stdio.h>
-#include <stdlib.h>
-#include <stdint.h>
-#include <stdbool.h>
-#include <limits.h>
-#include <assert.h>
-
-
-
-//Turn on/off how print.
-// #define SHOW_PRINT
-
-static int arrival_cmp(const void *a, const void *b) {
-    const event_t *e1 = a;
-    const event_t *e2 = b;
-    if (e1->time < e2->time) return -1;
-    if (e1->time > e2->time) return  1;
-    return 0;
-}
-
-#define max(x, y) ((x) > (y) ? (x) : (y))
-#define min(x,y) ((x) < (y) ? (x) : (y))
-#define COMPUTE_END_TIME(t, run_done, run_for) \
-    ((run_done) < (run_for) ? (uint64_t)((t) + ((run_for) - (run_done))) : (uint64_t)(t))
-
-static event_t make_event(cpu_t *cpu, event_type ev_type, pcb_t *proc, uint64_t time) {
-    event_t e;
-    e.cpu  = cpu;
-    e.ev   = ev_type;
-    e.proc = proc;
-    e.time = time;
-    return e;
-}
-
-void load_processes(const char *filename,
-                    pcb_t   **out_pcbs,
-                    int     **out_arrival,
-                    int     **out_remain,
-                    int     *out_n,
-                    int     *num_cpu)
-{
-    FILE *fp = fopen(filename, "r");
-    if (!fp) { perror("fopen"); exit(EXIT_FAILURE); }
-
-    int n, cpu;
-    if (fscanf(fp, "%d %d", &cpu, &n) != 2 || n <= 0 || cpu <= 0) {
-        fprintf(stderr, "Error: invalid process count in '%s'\n", filename);
-        if (cpu < n) {
-            fprintf(stderr, "Error: CPU count (%d) cannot be less than process count (%d)\n", cpu, n);
-        } else if (cpu > 12) { // MAX_CPU
-            fprintf(stderr, "Error: CPU count (%d) exceeds maximum (%d)\n", cpu, 12);
-        }
-        fclose(fp);
-        exit(EXIT_FAILURE);
-    }
-    *out_n = n;
-    *num_cpu = cpu;
-    *out_pcbs    = malloc(sizeof(pcb_t) * n);
-    *out_arrival = malloc(sizeof(int)   * n);
-    *out_remain  = malloc(sizeof(int)   * n);
-    if (!*out_pcbs || !*out_arrival || !*out_remain) {
-        perror("malloc"); fclose(fp); exit(EXIT_FAILURE);
-    }
-
-    for (int i = 0; i < n; i++) {
-        int pid, nice, at, bt;
-        if (fscanf(fp, "%d %d %d %d", &pid, &nice, &at, &bt) != 4
-            || nice < -20 || nice > 19) {
-            fprintf(stderr, "Error: bad format or niceness out of range at line %d in '%s'\n", i+2, filename);
-            fclose(fp);
-            exit(EXIT_FAILURE);
-        }
-        (*out_pcbs)[i].pid      = (uint32_t)pid;
-        (*out_pcbs)[i].vruntime = 0;
-        (*out_pcbs)[i].weight   = cfs_compute_weight(nice);
-        (*out_arrival)[i]       = at;
-        (*out_remain)[i]        = bt;
-    }
-    fclose(fp);
-}
-
-void simulate_cfs(pcb_t *pcbs, int *arrival, int *remain, int num_cpu, int num_process) {
-    bool *finished = calloc(num_process, sizeof(bool));
-    if (!finished) { perror("calloc"); exit(EXIT_FAILURE); }
-    int *time_slice = calloc(num_process, sizeof(int));
-    if (!time_slice) { perror("calloc"); exit(EXIT_FAILURE); }
-
-    // CPU Initialization
-    cpu_init(num_cpu);
-
-    // Event-driven tree Initialization
-    event_tree ev_t;
-    event_tree_init(&ev_t);
-    for (int i = 0; i < num_process; i++) {
-        event_t ev_insert = make_event(NULL, EVENT_ARRIVAL, &pcbs[i], arrival[i]);
-        // printf("[t=%llu] enqueue PID=%u\n", (unsigned long long)0, i);
-        event_tree_insert(&ev_t, &ev_insert);
-    }
-
-    uint64_t t = 0;
-    int done = 0;
-    while (done < num_process) {
-        event_t ev;
-        event_tree_pop(&ev_t, &ev);
-        t = ev.time;
-
-        #ifdef SHOW_PRINT
-            printf("================================================\n");
-            printf("Time stamp: %llu \n", (unsigned long long)t);
-        #endif
-
-        if (ev.ev == EVENT_ARRIVAL) {
-            // Step 1: Enqueue all process and dispatch the needed process;
-            int entering_proc = 1;
-            cfs_enqueue(ev.proc);
-
-            #ifdef SHOW_PRINT
-                printf("Enqueue PID=%u\n", ev.proc->pid);
-            #else
-                printf("[t = %llu] Enqueue PID=%u \n", t, ev.proc->pid);
-            #endif
-
-            event_t start_ev;
-            while (event_tree_peek(&ev_t, &start_ev) && start_ev.ev == EVENT_ARRIVAL && start_ev.time == t) {
-                entering_proc++;
-                event_tree_pop(&ev_t, &start_ev);
-                cfs_enqueue(start_ev.proc);
-
-                #ifdef SHOW_PRINT
-                    printf("Enqueue PID=%u\n", start_ev.proc->pid);
-                #else
-                    printf("[t = %llu] Enqueue PID=%u \n", t, start_ev.proc->pid);
-                #endif
-            }
-            //Step 2: Preempt some CPU that expired new timeslice:
-            for (int i = 0; i < num_cpu; i++) {
-                cpu_t *c = &cpu_m.cpu_list[i];
-                pcb_t *p = c->running_process;
-                if (!p) continue;
-                int idx = (int)(p - pcbs);
-                uint32_t new_timeslice = min(cfs_timeslice(p, cpu_m.total_weight_proc), remain[idx]);
-                uint32_t old_timeslice = time_slice[idx];
-                uint32_t run_for = t - c->last_dispatch;
-                uint32_t remains = remain[idx];
-                event_t old_end = make_event(c, EVENT_END, p, c->last_dispatch + old_timeslice);
-                event_delete(&ev_t, &old_end);
-                if (run_for >= new_timeslice) {
-                    remain[idx] -= (int)run_for;
-                    cfs_task_tick(p, run_for, cpu_m.total_weight_proc);
-                    cpu_release(c, run_for);
-                    if (remain[p - pcbs] <= 0) {
-                        cfs_dequeue(p);
-                    }
-                    c->running_process = NULL;
-
-                    #ifdef SHOW_PRINT
-                        printf("Expired time-slice of PID=%u in CPU %u due to new process arrival\n", p->pid, i + 1);
-                    #else
-                        printf("[t = %llu] Stopped PID=%u in CPU %u\n", t, p->pid, i + 1);
-                    #endif
-                }
-                else {
-                    event_t new_end = make_event(c, EVENT_END, p, c->last_dispatch + new_timeslice); 
-                    event_tree_insert(&ev_t, &new_end);
-                    time_slice[idx] = new_timeslice;
-                }
-            }
-            //Step 2: Try to assigned it to CPU
-            while (1) {
-                cpu_t *c = cpu_peek();
-                pcb_t *p = cfs_pick_next();          
-                if (!p || !c) break;
-                entering_proc--;
-                cpu_dispatch(p, t);
-                cfs_dequeue(p);
-                #ifdef SHOW_PRINT
-                    printf("Assigned process with PID=%u to CPU %u\n", p->pid, c->cpu_id);
-                #else
-                    printf("[t = %llu] Assigned process with PID=%u to CPU %u\n", t , p->pid, c->cpu_id);
-                #endif
-                uint64_t slice = cfs_timeslice(p, cpu_m.total_weight_proc);
-                int    idx   = (int)(p - pcbs);
-                uint64_t run = slice < (uint64_t)remain[idx] ? slice : (uint64_t)remain[idx];
-                event_t ev_end = make_event(c, EVENT_END, p, t + run);
-                event_tree_insert(&ev_t, &ev_end);
-                time_slice[idx] = (int)run;
-                c->last_dispatch = t;
-            }
-
-            if (entering_proc <= 0) continue; 
-
-            // Step 3: Try to assigned it by preempt other process in CPUs.
-            for (int idx = 1; idx <= entering_proc; idx++) {
-                int best_idx = -1;
-                double best_vruntime = -1;
-
-                for (int i = 0; i < num_cpu; i++) {
-                    cpu_t *c = &cpu_m.cpu_list[i];
-                    pcb_t *p = c->running_process;
-                    if (!p) continue;
-                    if (t - c->last_dispatch >= MIN_GRANULARITY_NSEC && 
-                        p->vruntime >= best_vruntime) {
-                        best_vruntime = p->vruntime;
-                        best_idx = i;  
-                    }
-                }
-                if (best_idx != -1) {
-                    //Preempt current process on CPU.
-                    cpu_t *c = &cpu_m.cpu_list[best_idx];
-                    pcb_t *p1 = c->running_process;
-                    event_t old_end = make_event(c, EVENT_END, p1, c->last_dispatch + time_slice[p1 - pcbs]);
-                    event_delete(&ev_t, &old_end);
-                    uint64_t ran = t - c->last_dispatch;
-                    remain[p1 - pcbs] -= (int) ran;
-                    cfs_task_tick(p1, ran, cpu_m.total_weight_proc);
-                    cpu_release(c, ran);
-                    if (remain[p1 - pcbs] <= 0) {
-                        cfs_dequeue(p1);
-                    }
-                    c->running_process = NULL;
-                    
-                    pcb_t *p2 = cfs_pick_next();
-                    cpu_dispatch(p2, t);
-                    cfs_dequeue(p2);
-                    #ifdef SHOW_PRINT
-                        printf("Preempt process PID=%u and entering process PID=%u to CPU %u\n", 
-                        p1->pid, p2->pid, c->cpu_id);
-                    #else
-                        printf("[t = %llu] Stopped PID=%u in CPU %u\n", t, p1->pid, c->cpu_id);
-                        printf("[t = %llu] Assigned process with PID=%u to CPU %u\n", t, p2->pid, c->cpu_id);
-                    #endif
-                    uint64_t slice = cfs_timeslice(p2, cpu_m.total_weight_proc);
-                    int    idx   = (int)(p2 - pcbs);
-                    uint64_t run = slice < (uint64_t)remain[idx] ? slice : (uint64_t)remain[idx];
-                    event_t ev_end = make_event(c, EVENT_END, p2, t + run);
-                    event_tree_insert(&ev_t, &ev_end);
-                    time_slice[idx] = (int)run;
-                    c->last_dispatch = t;
-                }
-            }
-        } else if (ev.ev == EVENT_END) {
-            cpu_t *c = ev.cpu;
-            pcb_t *p = ev.proc;
-            if (c->running_process != p) continue;
-
-            uint64_t run_done = t - c->last_dispatch;
-            int idx = (int)(p - pcbs);
-            remain[idx] -= (int)run_done;
-            cfs_task_tick(p, run_done, cpu_m.total_weight_proc);
-            cpu_release(c, run_done);
-
-            if (remain[idx] == 0) {
-                cfs_dequeue(p);
-                done++;
-                #ifdef SHOW_PRINT
-                    printf("Finish PID=%u\n", p->pid);
-                #else
-                    printf("[t = %llu] Finish PID=%u\n", t, p->pid);
-                #endif
-            }
-            else {
-                #ifdef SHOW_PRINT
-                    printf("Expired time-slice of PID=%u in CPU %u\n", p->pid, c->cpu_id);
-                #else
-                    printf("[t = %llu] Stopped PID=%u in CPU %u\n", t, p->pid, c->cpu_id);
-                #endif
-
-            }
-
-            pcb_t *next2 = cfs_pick_next();
-            if (next2) {
-                cpu_dispatch(next2, t);
-                cfs_dequeue(next2);
-                int idx = 0;
-                for (; idx < num_cpu; idx++) {
-                    if (cpu_m.cpu_list[idx].running_process == next2) break;
-                }
-                int ni = (int)(next2 - pcbs);
-                uint64_t slice3 = cfs_timeslice(next2, cpu_m.total_weight_proc);
-                uint64_t run3 = min(slice3, (uint64_t)remain[ni]);
-                event_t ne2 = make_event(&cpu_m.cpu_list[idx], EVENT_END, next2, t + run3);
-                event_tree_insert(&ev_t, &ne2);
-                time_slice[ni] = (int)run3;
-                cpu_m.cpu_list[idx].last_dispatch = t;
-                #ifdef SHOW_PRINT
-                    printf("Assigned process with PID=%u to CPU %u\n", next2->pid, idx+1);
-                #else
-                    printf("[t = %llu] Assigned process with PID=%u to CPU %u\n", t , next2->pid, idx+1);
-                #endif
-            }
-        }
-    }
-    #ifdef SHOW_PRINT
-        printf("================================================\n");
-        printf("All done at Time stamp = %llu\n", (unsigned long long)t);
-    #else
-        printf("All done at t = %llu\n", (unsigned long long)t);
-    #endif
-
-    event_tree_destroy(&ev_t);
-    cpu_destroy();
-    free(finished);
-    free(time_slice);
-}
-
-int main(int argc, char *argv[]) {
-    if (argc != 2) {
-        fprintf(stderr, "Usage: %s <input-file>\n", argv[0]);
-        return EXIT_FAILURE;
-    }
-
-    pcb_t *pcbs;
-    int   *arrival, *remain;
-    int    num_process, num_cpu;
-
-    load_processes(argv[1], &pcbs, &arrival, &remain, &num_process, &num_cpu);
-    cfs_init_rq();
-    simulate_cfs(pcbs, arrival, remain, num_cpu, num_process);
-
-    free(pcbs);
-    free(arrival);
-    free(remain);
-    return EXIT_SUCCESS;
-}
-
-
-
-            
+#define _DEFAULT_SOURCE             // clock_gettime (clock.h), getrusage
+#include "sim.h"
+#include "sweep.h"
+#include "pool.h"
+#include "alloc_stats.h"
+#include "runtime.h"
+#include "snapshot.h"
+#include "oprec.h"
+#include "prof.h"
+#include "clock.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <getopt.h>
+#include <sys/resource.h>
+
+/*
+ * One JSON line on stderr for tools/bench.py: wall time of the simulation
+ * (including the trace drain), events, scheduling decisions, peak RSS and,
+ * in bench builds, heap allocations.
+ */
+static void print_run_stats(const metrics_t *m, uint64_t wall_ns) {
+    struct rusage ru;
+    getrusage(RUSAGE_SELF, &ru);
+    uint64_t allocs = alloc_count();
+    fprintf(stderr, "{\"wall_ns\": %llu, \"events\": %llu, \"decisions\": %llu, "
+                    "\"tasks\": %llu, \"peak_rss_kb\": %ld, \"allocs\": ",
+            (unsigned long long)wall_ns, (unsigned long long)m->events,
+            (unsigned long long)m->context_switches, (unsigned long long)m->tasks,
+            ru.ru_maxrss);
+    if (allocs == ALLOC_COUNT_NONE)
+        fprintf(stderr, "null}\n");
+    else
+        fprintf(stderr, "%llu}\n", (unsigned long long)allocs);
+}
+
+static void print_runtime_stats(const rt_stats *st, uint64_t wall_ns) {
+    const histogram_t *h = &st->dispatch_latency;
+    fprintf(stderr, "{\"wall_ns\": %llu, \"tasks\": %llu, \"dispatches\": %llu, "
+                    "\"yields\": %llu, \"preemptions\": %llu, \"steals\": %llu, "
+                    "\"lock_acquisitions\": %llu, \"lock_contended\": %llu, "
+                    "\"lock_wait_ns\": %llu, \"dispatch_latency\": { \"mean\": %.3f, "
+                    "\"p50\": %llu, \"p99\": %llu, \"max\": %llu }}\n",
+            (unsigned long long)wall_ns, (unsigned long long)st->tasks,
+            (unsigned long long)st->dispatches, (unsigned long long)st->yields,
+            (unsigned long long)st->preemptions, (unsigned long long)st->steals,
+            (unsigned long long)st->lock.acquisitions, (unsigned long long)st->lock.contended,
+            (unsigned long long)st->lock.wait_ns, hist_mean(h),
+            (unsigned long long)hist_percentile(h, 0.5),
+            (unsigned long long)hist_percentile(h, 0.99), (unsigned long long)h->max);
+}
+
+/*
+ * --runtime: replay the workload on real worker threads, with time units of
+ * unit ns. The tunables are in the same units as the input, so scale them.
+ */
+static void run_runtime(const sim_params *params, workload_t *wl, uint64_t unit,
+                        metrics_t *metrics, bool stats) {
+    cfs_tunables tun = params->tun;
+    tun.sched_latency *= unit;
+    tun.min_granularity *= unit;
+    tun.wakeup_granularity *= unit;
+    int n = (int)(params->num_cpu ? params->num_cpu : wl->num_cpu);
+
+    uint64_t t0 = clock_ns();
+    rt_runtime rt;
+    rt_init(&rt, n, &tun, metrics);
+    rt_replay(&rt, wl, unit);
+    rt_wait(&rt);
+    rt_stats st;
+    memset(&st, 0, sizeof(st));
+    rt_destroy(&rt, &st);
+    if (stats) print_runtime_stats(&st, clock_ns() - t0);
+}
+
+// Text on stdout by default; a --trace file ending in ".json" gets Chrome trace JSON.
+static trace_mode trace_mode_for(const char *path) {
+    if (!path) return TRACE_TEXT;
+    size_t len = strlen(path);
+    return len >= 5 && strcmp(path + len - 5, ".json") == 0 ? TRACE_CHROME : TRACE_BINARY;
+}
+
+static void usage(const char *prog) {
+    fprintf(stderr, "Usage: %s [--per-cpu] [--event-queue=wheel|rbtree] [--trace=FILE]\n"
+                    "          [--metrics=FILE] [--task-metrics=FILE] [--stats]\n"
+                    "          [--latency=NS] [--granularity=NS] [--wakeup-granularity=NS]\n"
+                    "          [--cpus=N] [--topology=NxLxCxT] [--migration-cost=NS,NS,NS,NS]\n"
+                    "          [--affinity] [--policy=cfs|mlq] [--quantum=NS]\n"
+                    "          [--checkpoint=PREFIX --checkpoint-every=NS] [--restore=FILE]\n"
+                    "          [--sample=FILE --sample-every=NS] [--record-ops=FILE] [--profile=FILE]\n"
+                    "          [--runtime [--time-unit=NS]] <input-file>\n"
+                    "       %s --sweep [--latency=NS,...] [--granularity=NS,...] [--cpus=N,...]\n"
+                    "          [--policy=cfs,mlq] [--jobs=N] [--per-cpu] [--event-queue=...]\n"
+                    "          [--topology=...] [--migration-cost=...] [--affinity] [--quantum=NS]\n"
+                    "          [--restore=FILE] <input-file>...\n",
+            prog, prog);
+}
+
+// Comma-separated list of positive integers; false on anything else.
+static bool parse_list(const char *arg, uint64_t **out, int *n) {
+    int cap = 1;
+    for (const char *c = arg; *c; c++) cap += *c == ',';
+    uint64_t *v = malloc((size_t)cap * sizeof(uint64_t));
+    if (!v) return false;
+    int k = 0;
+    const char *p = arg;
+    while (*p) {
+        char *end;
+        unsigned long long x = strtoull(p, &end, 10);
+        if (end == p || x == 0 || (*end && *end != ',')) { free(v); return false; }
+        v[k++] = x;
+        p = *end ? end + 1 : end;
+    }
+    if (k == 0) { free(v); return false; }
+    free(*out);
+    *out = v;
+    *n = k;
+    return true;
+}
+
+// Migration cost per distance: SMT sibling, same LLC, same node, other node.
+static bool parse_costs(const char *arg, uint64_t cost[TOPO_LEVELS]) {
+    const char *p = arg;
+    cost[TOPO_SAME] = 0;
+    for (int l = TOPO_SMT; l < TOPO_LEVELS; l++) {
+        char *end;
+        if (*p < '0' || *p > '9') return false;
+        cost[l] = strtoull(p, &end, 10);
+        if (*end != (l < TOPO_REMOTE ? ',' : '\0')) return false;
+        p = end + 1;
+    }
+    return true;
+}
+
+// Comma-separated policy names; false on an unknown one.
+static bool parse_policies(const char *arg, const sched_policy ***out, int *n) {
+    int cap = 1;
+    for (const char *c = arg; *c; c++) cap += *c == ',';
+    const sched_policy **v = malloc((size_t)cap * sizeof(*v));
+    char *names = strdup(arg);
+    if (!v || !names) {
+        perror("malloc");
+        exit(EXIT_FAILURE);
+    }
+    int k = 0;
+    char *save = NULL;
+    for (char *name = strtok_r(names, ",", &save); name; name = strtok_r(NULL, ",", &save)) {
+        if (!(v[k++] = policy_find(name))) { k = 0; break; }
+    }
+    free(names);
+    if (k == 0) { free(v); return false; }
+    free(*out);
+    *out = v;
+    *n = k;
+    return true;
+}
+
+static void list_default(uint64_t **list, int *n, uint64_t def) {
+    if (*list) return;
+    *list = malloc(sizeof(uint64_t));
+    if (!*list) {
+        perror("malloc");
+        exit(EXIT_FAILURE);
+    }
+    (*list)[0] = def;
+    *n = 1;
+}
+
+int main(int argc, char *argv[]) {
+    static const struct option long_opts[] = {
+        { "per-cpu",     no_argument,       NULL, 'P' },
+        { "event-queue", required_argument, NULL, 'e' },
+        { "trace",       required_argument, NULL, 't' },
+        { "metrics",     required_argument, NULL, 'm' },
+        { "task-metrics", required_argument, NULL, 'T' },
+        { "stats",       no_argument,       NULL, 's' },
+        { "latency",     required_argument, NULL, 'L' },
+        { "granularity", required_argument, NULL, 'G' },
+        { "wakeup-granularity", required_argument, NULL, 'W' },
+        { "cpus",        required_argument, NULL, 'c' },
+        { "sweep",       no_argument,       NULL, 'S' },
+        { "jobs",        required_argument, NULL, 'j' },
+        { "topology",    required_argument, NULL, 'o' },
+        { "migration-cost", required_argument, NULL, 'M' },
+        { "affinity",    no_argument,       NULL, 'A' },
+        { "policy",      required_argument, NULL, 'p' },
+        { "quantum",     required_argument, NULL, 'Q' },
+        { "runtime",     no_argument,       NULL, 'R' },
+        { "time-unit",   required_argument, NULL, 'U' },
+        { "checkpoint",  required_argument, NULL, 'k' },
+        { "checkpoint-every", required_argument, NULL, 'K' },
+        { "restore",     required_argument, NULL, 'r' },
+        { "record-ops",  required_argument, NULL, 'O' },
+        { "profile",     required_argument, NULL, 'f' },
+        { "sample",      required_argument, NULL, 'y' },
+        { "sample-every", required_argument, NULL, 'Y' },
+        { NULL,          0,                 NULL,  0  }
+    };
+    sim_params params;
+    sim_params_default(&params);
+    uint64_t *latencies = NULL, *granularities = NULL, *cpus = NULL;
+    int num_latencies = 0, num_granularities = 0, num_cpus = 0;
+    const sched_policy **policies = NULL;
+    int num_policies = 0;
+    bool sweep = false;
+    int jobs = pool_default_threads();
+    const char *trace_path = NULL;
+    const char *metrics_path = NULL;
+    const char *task_metrics_path = NULL;
+    bool stats = false;
+    bool runtime = false;
+    uint64_t time_unit = 1000;
+    const char *restore_path = NULL;
+    const char *record_path = NULL;
+    const char *profile_path = NULL;
+    bool wakeup_set = false, quantum_set = false, costs_set = false;
+    int opt;
+    while ((opt = getopt_long(argc, argv, "Pe:t:m:T:sL:G:W:c:Sj:o:M:Ap:Q:RU:k:K:r:O:f:y:Y:", long_opts, NULL)) != -1) {
+        switch (opt) {
+        case 'P': params.per_cpu_rq = true; break;
+        case 'e':
+            if (strcmp(optarg, "wheel") == 0)       params.evq = EVQ_WHEEL;
+            else if (strcmp(optarg, "rbtree") == 0) params.evq = EVQ_RBTREE;
+            else { usage(argv[0]); return EXIT_FAILURE; }
+            break;
+        case 't': trace_path = optarg; break;
+        case 'm': metrics_path = optarg; break;
+        case 'T': task_metrics_path = optarg; break;
+        case 's': stats = true; break;
+        case 'L':
+            if (!parse_list(optarg, &latencies, &num_latencies)) { usage(argv[0]); return EXIT_FAILURE; }
+            break;
+        case 'G':
+            if (!parse_list(optarg, &granularities, &num_granularities)) { usage(argv[0]); return EXIT_FAILURE; }
+            break;
+        case 'W': {
+            char *end;
+            params.tun.wakeup_granularity = strtoull(optarg, &end, 10);
+            if (end == optarg || *end) { usage(argv[0]); return EXIT_FAILURE; }
+            wakeup_set = true;
+            break;
+        }
+        case 'c':
+            if (!parse_list(optarg, &cpus, &num_cpus)) { usage(argv[0]); return EXIT_FAILURE; }
+            break;
+        case 'S': sweep = true; break;
+        case 'j': jobs = atoi(optarg); break;
+        case 'o':
+            if (!topology_parse(optarg, &params.topo)) { usage(argv[0]); return EXIT_FAILURE; }
+            break;
+        case 'M':
+            if (!parse_costs(optarg, params.migration_cost)) { usage(argv[0]); return EXIT_FAILURE; }
+            costs_set = true;
+            break;
+        case 'A': params.affinity = true; break;
+        case 'p':
+            if (!parse_policies(optarg, &policies, &num_policies)) { usage(argv[0]); return EXIT_FAILURE; }
+            break;
+        case 'Q': {
+            char *end;
+            params.tun.quantum = strtoull(optarg, &end, 10);
+            if (end == optarg || *end || params.tun.quantum == 0) { usage(argv[0]); return EXIT_FAILURE; }
+            quantum_set = true;
+            break;
+        }
+        case 'R': runtime = true; break;
+        case 'U': {
+            char *end;
+            time_unit = strtoull(optarg, &end, 10);
+            if (end == optarg || *end || time_unit == 0) { usage(argv[0]); return EXIT_FAILURE; }
+            break;
+        }
+        case 'k': params.checkpoint_path = optarg; break;
+        case 'K': {
+            char *end;
+            params.checkpoint_every = strtoull(optarg, &end, 10);
+            if (end == optarg || *end || params.checkpoint_every == 0) { usage(argv[0]); return EXIT_FAILURE; }
+            break;
+        }
+        case 'r': restore_path = optarg; break;
+        case 'O': record_path = optarg; break;
+        case 'f': profile_path = optarg; break;
+        case 'y': params.sample_path = optarg; break;
+        case 'Y': {
+            char *end;
+            params.sample_every = strtoull(optarg, &end, 10);
+            if (end == optarg || *end || params.sample_every == 0) { usage(argv[0]); return EXIT_FAILURE; }
+            break;
+        }
+        default:  usage(argv[0]); return EXIT_FAILURE;
+        }
+    }
+    for (int i = 0; i < num_cpus; i++) {
+        if (cpus[i] > MAX_CPU) {
+            fprintf(stderr, "Error: --cpus %llu exceeds MAX_CPU (%d)\n",
+                    (unsigned long long)cpus[i], MAX_CPU);
+            return EXIT_FAILURE;
+        }
+    }
+    if (params.topo.nodes) {
+        uint64_t n = topology_cpus(&params.topo);
+        if (n > MAX_CPU) {
+            fprintf(stderr, "Error: topology has %llu CPUs, more than MAX_CPU (%d)\n",
+                    (unsigned long long)n, MAX_CPU);
+            return EXIT_FAILURE;
+        }
+        for (int i = 0; i < num_cpus; i++) {
+            if (cpus[i] != n) {
+                fprintf(stderr, "Error: --cpus %llu does not match the topology (%llu CPUs)\n",
+                        (unsigned long long)cpus[i], (unsigned long long)n);
+                return EXIT_FAILURE;
+            }
+        }
+    }
+    if (!params.checkpoint_path != !params.checkpoint_every) {
+        fprintf(stderr, "Error: --checkpoint and --checkpoint-every go together\n");
+        return EXIT_FAILURE;
+    }
+    if (params.checkpoint_every && (sweep || runtime)) {
+        fprintf(stderr, "Error: --checkpoint needs a single simulated run\n");
+        return EXIT_FAILURE;
+    }
+    if (!params.sample_path != !params.sample_every) {
+        fprintf(stderr, "Error: --sample and --sample-every go together\n");
+        return EXIT_FAILURE;
+    }
+    if (params.sample_every && (sweep || runtime)) {
+        fprintf(stderr, "Error: --sample needs a single simulated run\n");
+        return EXIT_FAILURE;
+    }
+    if (record_path && (sweep || runtime)) {
+        fprintf(stderr, "Error: --record-ops needs a single simulated run\n");
+        return EXIT_FAILURE;
+    }
+    if (profile_path && (sweep || runtime)) {
+        fprintf(stderr, "Error: --profile needs a single simulated run\n");
+        return EXIT_FAILURE;
+    }
+
+    // A restored run keeps the snapshot's setup; tunables given here override it.
+    sim_snapshot snap;
+    if (restore_path) {
+        if (runtime) {
+            fprintf(stderr, "Error: --restore cannot be used with --runtime\n");
+            return EXIT_FAILURE;
+        }
+        if (num_cpus || policies || params.per_cpu_rq || params.topo.nodes) {
+            fprintf(stderr, "Error: with --restore, the CPUs, policy, queue layout "
+                            "and topology come from the snapshot\n");
+            return EXIT_FAILURE;
+        }
+        snapshot_load(&snap, restore_path);
+        sim_params given = params;
+        snapshot_params(&snap, &params);
+        if (wakeup_set) params.tun.wakeup_granularity = given.tun.wakeup_granularity;
+        if (quantum_set) params.tun.quantum = given.tun.quantum;
+        if (costs_set) memcpy(params.migration_cost, given.migration_cost, sizeof(params.migration_cost));
+        params.affinity |= given.affinity;
+        list_default(&latencies, &num_latencies, params.tun.sched_latency);
+        list_default(&granularities, &num_granularities, params.tun.min_granularity);
+    }
+    list_default(&latencies, &num_latencies, SCHED_LATENCY_NSEC);
+    list_default(&granularities, &num_granularities, MIN_GRANULARITY_NSEC);
+
+    if (runtime && (sweep || (policies && policies[0] != &cfs_policy))) {
+        fprintf(stderr, "Error: --runtime runs the cfs policy only and cannot sweep\n");
+        return EXIT_FAILURE;
+    }
+
+    if (sweep) {
+        if (optind >= argc) {
+            usage(argv[0]);
+            return EXIT_FAILURE;
+        }
+        sweep_spec spec = {
+            .paths = (const char **)&argv[optind], .num_paths = argc - optind,
+            .latencies = latencies, .num_latencies = num_latencies,
+            .granularities = granularities, .num_granularities = num_granularities,
+            .cpus = cpus, .num_cpus = num_cpus,
+            .policies = policies, .num_policies = num_policies,
+            .base = params, .snap = restore_path ? &snap : NULL, .threads = jobs,
+        };
+        sweep_run(&spec, stdout);
+        if (restore_path) snapshot_free(&snap);
+        free(policies);
+        free(latencies);
+        free(granularities);
+        free(cpus);
+        return EXIT_SUCCESS;
+    }
+
+    if (optind != argc - 1 || num_latencies > 1 || num_granularities > 1 || num_cpus > 1
+        || num_policies > 1) {
+        usage(argv[0]);
+        return EXIT_FAILURE;
+    }
+    if (num_policies) params.policy = policies[0];
+    free(policies);
+    params.tun.sched_latency = latencies[0];
+    params.tun.min_granularity = granularities[0];
+    if (num_cpus) params.num_cpu = (uint32_t)cpus[0];
+    free(latencies);
+    free(granularities);
+    free(cpus);
+
+    workload_t wl;
+    workload_open(&wl, argv[optind]);
+    if (runtime) {
+        metrics_t metrics;
+        metrics_init(&metrics, task_metrics_path);
+        run_runtime(&params, &wl, time_unit, &metrics, stats);
+        if (metrics_path) metrics_report(&metrics, metrics_path);
+        metrics_destroy(&metrics);
+        workload_close(&wl);
+        return EXIT_SUCCESS;
+    }
+    trace_t trace;
+    trace_open(&trace, trace_mode_for(trace_path), trace_path);
+    metrics_t metrics;
+    metrics_init(&metrics, task_metrics_path);
+    if (record_path) oprec_open(record_path);
+    if (profile_path) prof_open(profile_path);
+    uint64_t t0 = clock_ns();
+    sim_t sim;
+    sim_init(&sim, &params, &trace, &metrics);
+    if (restore_path) sim_resume(&sim, &wl, &snap);
+    else              sim_run(&sim, &wl);
+    sim_destroy(&sim);
+    oprec_close();
+    prof_close();
+    trace_close(&trace);
+    if (stats) print_run_stats(&metrics, clock_ns() - t0);
+    if (metrics_path) metrics_report(&metrics, metrics_path);
+    metrics_destroy(&metrics);
+    if (restore_path) snapshot_free(&snap);
+    workload_close(&wl);
+    return EXIT_SUCCESS;
+}
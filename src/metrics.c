@@ -0,0 +1,316 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "metrics.h"
+#include "cfs.h"
+
+#define TASK_CSV_BUF (1 << 16)
+
+/* ---- streaming histogram ---- */
+
+static size_t hist_index(uint64_t v) {
+    if (v < HIST_SUB) return (size_t)v;
+    int e = 63 - __builtin_clzll(v);                        // e >= HIST_SUB_BITS
+    uint64_t sub = (v >> (e - HIST_SUB_BITS)) & (HIST_SUB - 1);
+    return (size_t)(e - HIST_SUB_BITS + 1) * HIST_SUB + sub;
+}
+
+// Largest value that falls into bucket i.
+static uint64_t hist_upper(size_t i) {
+    if (i < HIST_SUB) return i;
+    int e = (int)(i / HIST_SUB) + HIST_SUB_BITS - 1;
+    uint64_t lo = (uint64_t)(HIST_SUB + i % HIST_SUB) << (e - HIST_SUB_BITS);
+    return lo + ((1ULL << (e - HIST_SUB_BITS)) - 1);
+}
+
+void hist_add(histogram_t *h, uint64_t v) {
+    h->buckets[hist_index(v)]++;
+    h->count++;
+    h->sum += (double)v;
+    if (v > h->max) h->max = v;
+}
+
+void hist_merge(histogram_t *dst, const histogram_t *src) {
+    for (size_t i = 0; i < HIST_BUCKETS; i++)
+        dst->buckets[i] += src->buckets[i];
+    dst->count += src->count;
+    dst->sum += src->sum;
+    if (src->max > dst->max) dst->max = src->max;
+}
+
+uint64_t hist_percentile(const histogram_t *h, double q) {
+    if (h->count == 0) return 0;
+    uint64_t rank = (uint64_t)(q * (double)(h->count - 1)) + 1;
+    uint64_t seen = 0;
+    for (size_t i = 0; i < HIST_BUCKETS; i++) {
+        seen += h->buckets[i];
+        if (seen >= rank) {
+            uint64_t v = hist_upper(i);
+            return v < h->max ? v : h->max;
+        }
+    }
+    return h->max;
+}
+
+/* ---- collection ---- */
+
+void metrics_init(metrics_t *m, const char *task_csv_path) {
+    memset(m, 0, sizeof(*m));
+    if (!task_csv_path) return;
+    m->task_csv = strcmp(task_csv_path, "-") == 0 ? stdout : fopen(task_csv_path, "w");
+    if (!m->task_csv) {
+        perror("fopen");
+        exit(EXIT_FAILURE);
+    }
+    if (m->task_csv != stdout) {
+        m->task_csv_buf = malloc(TASK_CSV_BUF);
+        if (m->task_csv_buf) setvbuf(m->task_csv, m->task_csv_buf, _IOFBF, TASK_CSV_BUF);
+    }
+    fprintf(m->task_csv, "pid,weight,arrival,burst,first_run,finish,"
+                         "response,waiting,turnaround,dispatches,"
+                         "io_time,wakeups,wakeup_mean,wakeup_max,group,migration_cost\n");
+}
+
+static void wakeup_latency(metrics_t *m, pcb_t *p, uint64_t now) {
+    uint64_t lat = now - p->wake_time;
+    p->wake_time = UINT64_MAX;
+    p->nr_wakeups++;
+    p->wake_sum += lat;
+    if (lat > p->wake_max) p->wake_max = lat;
+    hist_add(&m->wakeup, lat);
+
+    histogram_t **h = &m->wakeup_by_nice[p->nice + 20];
+    if (!*h && !(*h = calloc(1, sizeof(histogram_t)))) {
+        perror("calloc");
+        exit(EXIT_FAILURE);
+    }
+    hist_add(*h, lat);
+}
+
+void metrics_dispatch(metrics_t *m, pcb_t *p, uint64_t now) {
+    if (p->first_run == UINT64_MAX) p->first_run = now;
+    if (p->wake_time != UINT64_MAX) wakeup_latency(m, p, now);
+    p->nr_dispatch++;
+    m->context_switches++;
+}
+
+void metrics_finish(metrics_t *m, const pcb_t *p, uint64_t now) {
+    uint64_t turnaround = now - p->arrival;
+    uint64_t response = p->first_run - p->arrival;
+    uint64_t waiting = turnaround - p->burst - p->io_time;
+    hist_add(&m->response, response);
+    hist_add(&m->waiting, waiting);
+    hist_add(&m->turnaround, turnaround);
+    m->tasks++;
+
+    // Service rate per unit of weight; equal for every task under ideal CFS.
+    double x = turnaround ? (double)p->burst / (double)turnaround * WEIGHT_NORM / p->weight : 0;
+    m->fair_sum += x;
+    m->fair_sum_sq += x * x;
+
+    if (m->task_csv) {
+        fprintf(m->task_csv, "%u,%u,%llu,%llu,%llu,%llu,%llu,%llu,%llu,%u,%llu,%u,%.3f,%llu,%u,%llu\n",
+                p->pid, p->weight, (unsigned long long)p->arrival,
+                (unsigned long long)p->burst, (unsigned long long)p->first_run,
+                (unsigned long long)now, (unsigned long long)response,
+                (unsigned long long)waiting, (unsigned long long)turnaround,
+                p->nr_dispatch, (unsigned long long)p->io_time, p->nr_wakeups,
+                p->nr_wakeups ? (double)p->wake_sum / p->nr_wakeups : 0.0,
+                (unsigned long long)p->wake_max, p->group ? p->group->id : 0u,
+                (unsigned long long)p->mig_cost);
+    }
+}
+
+void metrics_end_busy(metrics_t *m, int num_cpu, uint64_t now) {
+    m->makespan = now;
+    m->num_cpu = num_cpu;
+    m->cpu_busy = calloc((size_t)num_cpu, sizeof(uint64_t));
+    if (!m->cpu_busy) {
+        perror("calloc");
+        exit(EXIT_FAILURE);
+    }
+}
+
+void metrics_end(metrics_t *m, const cpu_manager *cm, uint64_t now) {
+    metrics_end_busy(m, cm->n, now);
+    for (int i = 0; i < cm->n; i++)
+        m->cpu_busy[i] = cm->cpu_list[i].running_time;
+    m->migrations = cm->nr_migrations;
+}
+
+void metrics_groups(metrics_t *m, const struct task_group *groups, uint32_t n) {
+    m->num_groups = n;
+    if (n == 0) return;
+    m->groups = malloc(n * sizeof(metrics_group));
+    if (!m->groups) {
+        perror("malloc");
+        exit(EXIT_FAILURE);
+    }
+    for (uint32_t i = 0; i < n; i++) {
+        const struct task_group *tg = &groups[i];
+        m->groups[i] = (metrics_group){ tg->id, tg->parent ? tg->parent->id : 0,
+                                        tg->se.weight, tg->nr_tasks, tg->cpu_time };
+    }
+}
+
+/* ---- reporting ---- */
+
+double metrics_jain(const metrics_t *m) {
+    if (m->tasks == 0 || m->fair_sum_sq == 0) return 1.0;
+    return m->fair_sum * m->fair_sum / ((double)m->tasks * m->fair_sum_sq);
+}
+
+static double utilization(const metrics_t *m, int i) {
+    return m->makespan ? (double)m->cpu_busy[i] / (double)m->makespan : 0;
+}
+
+// Fraction of all CPU time handed out over the run that went to group i.
+static double group_share(const metrics_t *m, uint32_t i) {
+    uint64_t busy = 0;
+    for (int c = 0; c < m->num_cpu; c++) busy += m->cpu_busy[c];
+    return busy ? (double)m->groups[i].cpu_time / (double)busy : 0.0;
+}
+
+double metrics_avg_utilization(const metrics_t *m) {
+    double sum = 0;
+    for (int i = 0; i < m->num_cpu; i++) sum += utilization(m, i);
+    return m->num_cpu ? sum / m->num_cpu : 0.0;
+}
+
+double hist_mean(const histogram_t *h) {
+    return h->count ? h->sum / (double)h->count : 0.0;
+}
+
+const double      hist_pct_q[HIST_NUM_PCT]    = { 0.5, 0.9, 0.99, 0.999 };
+const char *const hist_pct_name[HIST_NUM_PCT] = { "p50", "p90", "p99", "p999" };
+
+static void hist_json(FILE *out, const histogram_t *h) {
+    fprintf(out, "{ \"mean\": %.3f", hist_mean(h));
+    for (size_t j = 0; j < HIST_NUM_PCT; j++)
+        fprintf(out, ", \"%s\": %llu", hist_pct_name[j],
+                (unsigned long long)hist_percentile(h, hist_pct_q[j]));
+    fprintf(out, ", \"max\": %llu }", (unsigned long long)h->max);
+}
+
+static void hist_csv(FILE *out, const char *name, const histogram_t *h) {
+    fprintf(out, "%s_mean,%.3f\n", name, hist_mean(h));
+    for (size_t j = 0; j < HIST_NUM_PCT; j++)
+        fprintf(out, "%s_%s,%llu\n", name, hist_pct_name[j],
+                (unsigned long long)hist_percentile(h, hist_pct_q[j]));
+    fprintf(out, "%s_max,%llu\n", name, (unsigned long long)h->max);
+}
+
+static void report_json(FILE *out, const metrics_t *m) {
+    const histogram_t *hs[] = { &m->response, &m->waiting, &m->turnaround, &m->wakeup };
+    const char *names[] = { "response", "waiting", "turnaround", "wakeup" };
+
+    fprintf(out, "{\n");
+    fprintf(out, "  \"tasks\": %llu,\n", (unsigned long long)m->tasks);
+    fprintf(out, "  \"makespan\": %llu,\n", (unsigned long long)m->makespan);
+    fprintf(out, "  \"context_switches\": %llu,\n", (unsigned long long)m->context_switches);
+    fprintf(out, "  \"migrations\": %llu,\n", (unsigned long long)m->migrations);
+    fprintf(out, "  \"migration_cost\": %llu,\n", (unsigned long long)m->migration_cost);
+    fprintf(out, "  \"dispatch_distance\": {");
+    for (int l = 0; l < TOPO_LEVELS; l++)
+        fprintf(out, "%s \"%s\": %llu", l ? "," : "", topo_level_name[l],
+                (unsigned long long)m->dispatch_distance[l]);
+    fprintf(out, " },\n");
+    fprintf(out, "  \"wakeups\": %llu,\n", (unsigned long long)m->wakeup.count);
+    fprintf(out, "  \"lock_waits\": %llu,\n", (unsigned long long)m->lock_waits);
+    for (size_t k = 0; k < 4; k++) {
+        fprintf(out, "  \"%s\": ", names[k]);
+        hist_json(out, hs[k]);
+        fprintf(out, ",\n");
+    }
+    fprintf(out, "  \"wakeup_by_nice\": {");
+    bool first = true;
+    for (int i = 0; i < 40; i++) {
+        if (!m->wakeup_by_nice[i]) continue;
+        fprintf(out, "%s\n    \"%d\": ", first ? "" : ",", i - 20);
+        hist_json(out, m->wakeup_by_nice[i]);
+        first = false;
+    }
+    fprintf(out, "%s},\n", first ? "" : "\n  ");
+    fprintf(out, "  \"groups\": [");
+    for (uint32_t i = 0; i < m->num_groups; i++) {
+        const metrics_group *g = &m->groups[i];
+        fprintf(out, "%s\n    { \"id\": %u, \"parent\": %u, \"shares\": %u, \"tasks\": %llu, "
+                     "\"cpu_time\": %llu, \"cpu_share\": %.6f }",
+                i ? "," : "", g->id, g->parent, g->shares, (unsigned long long)g->tasks,
+                (unsigned long long)g->cpu_time, group_share(m, i));
+    }
+    fprintf(out, "%s],\n", m->num_groups ? "\n  " : "");
+    fprintf(out, "  \"cpu_utilization\": [");
+    for (int i = 0; i < m->num_cpu; i++)
+        fprintf(out, "%s%.6f", i ? ", " : "", utilization(m, i));
+    fprintf(out, "],\n");
+    fprintf(out, "  \"avg_utilization\": %.6f,\n", metrics_avg_utilization(m));
+    fprintf(out, "  \"jain_fairness\": %.6f\n", metrics_jain(m));
+    fprintf(out, "}\n");
+}
+
+static void report_csv(FILE *out, const metrics_t *m) {
+    const histogram_t *hs[] = { &m->response, &m->waiting, &m->turnaround, &m->wakeup };
+    const char *names[] = { "response", "waiting", "turnaround", "wakeup" };
+
+    fprintf(out, "metric,value\n");
+    fprintf(out, "tasks,%llu\n", (unsigned long long)m->tasks);
+    fprintf(out, "makespan,%llu\n", (unsigned long long)m->makespan);
+    fprintf(out, "context_switches,%llu\n", (unsigned long long)m->context_switches);
+    fprintf(out, "migrations,%llu\n", (unsigned long long)m->migrations);
+    fprintf(out, "migration_cost,%llu\n", (unsigned long long)m->migration_cost);
+    for (int l = 0; l < TOPO_LEVELS; l++)
+        fprintf(out, "dispatch_%s,%llu\n", topo_level_name[l],
+                (unsigned long long)m->dispatch_distance[l]);
+    fprintf(out, "wakeups,%llu\n", (unsigned long long)m->wakeup.count);
+    fprintf(out, "lock_waits,%llu\n", (unsigned long long)m->lock_waits);
+    for (size_t k = 0; k < 4; k++)
+        hist_csv(out, names[k], hs[k]);
+    for (int i = 0; i < 40; i++) {
+        if (!m->wakeup_by_nice[i]) continue;
+        char name[32];
+        snprintf(name, sizeof(name), "wakeup_nice%d", i - 20);
+        hist_csv(out, name, m->wakeup_by_nice[i]);
+    }
+    for (uint32_t i = 0; i < m->num_groups; i++) {
+        fprintf(out, "group%u_cpu_time,%llu\n", m->groups[i].id,
+                (unsigned long long)m->groups[i].cpu_time);
+        fprintf(out, "group%u_cpu_share,%.6f\n", m->groups[i].id, group_share(m, i));
+    }
+    for (int i = 0; i < m->num_cpu; i++)
+        fprintf(out, "cpu%d_utilization,%.6f\n", i + 1, utilization(m, i));
+    fprintf(out, "avg_utilization,%.6f\n", metrics_avg_utilization(m));
+    fprintf(out, "jain_fairness,%.6f\n", metrics_jain(m));
+}
+
+void metrics_report(const metrics_t *m, const char *path) {
+    size_t len = strlen(path);
+    bool csv = len >= 4 && strcmp(path + len - 4, ".csv") == 0;
+    FILE *out = strcmp(path, "-") == 0 ? stdout : fopen(path, "w");
+    if (!out) {
+        perror("fopen");
+        exit(EXIT_FAILURE);
+    }
+    if (csv)
+        report_csv(out, m);
+    else
+        report_json(out, m);
+    if (out != stdout) fclose(out);
+}
+
+void metrics_destroy(metrics_t *m) {
+    if (m->task_csv && m->task_csv != stdout) fclose(m->task_csv);
+    else if (m->task_csv) fflush(m->task_csv);
+    free(m->cpu_busy);
+    free(m->groups);
+    free(m->task_csv_buf);
+    for (int i = 0; i < 40; i++) {
+        free(m->wakeup_by_nice[i]);
+        m->wakeup_by_nice[i] = NULL;
+    }
+    m->task_csv = NULL;
+    m->task_csv_buf = NULL;
+    m->cpu_busy = NULL;
+    m->groups = NULL;
+    m->num_groups = 0;
+}
@@ -0,0 +1,114 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include "policy.h"
+
+/*
+ * Multi-level queue: one FIFO per nice level, the lowest non-empty level
+ * first. A picked task runs for a fixed quantum and goes to the back of its
+ * level, so each level is round robin and lower levels starve under load.
+ * Bit i of mask is set while level i has tasks, so picking is a ctz.
+ */
+struct mlq_levels {
+    uint64_t mask;
+    pcb_t   *head[MLQ_LEVELS];
+    pcb_t   *tail[MLQ_LEVELS];
+};
+
+static int mlq_level(const pcb_t *p) {
+    int l = p->nice + 20;
+    return l < 0 ? 0 : l >= MLQ_LEVELS ? MLQ_LEVELS - 1 : l;
+}
+
+static void mlq_init_rq(struct cfs_rq *rq, const cfs_tunables *tun) {
+    cfs_init_rq(rq, tun);
+    rq->mlq = calloc(1, sizeof(*rq->mlq));
+    if (!rq->mlq) {
+        perror("calloc");
+        exit(EXIT_FAILURE);
+    }
+}
+
+static void mlq_destroy_rq(struct cfs_rq *rq) {
+    free(rq->mlq);
+    rq->mlq = NULL;
+    cfs_destroy_rq(rq);
+}
+
+static void mlq_enqueue(struct cfs_rq *rq, pcb_t *p, bool wakeup) {
+    (void)wakeup;
+    struct mlq_levels *q = rq->mlq;
+    int l = mlq_level(p);
+    p->fifo.next = NULL;
+    p->fifo.prev = q->tail[l];
+    if (q->tail[l]) q->tail[l]->fifo.next = p;
+    else            q->head[l] = p;
+    q->tail[l] = p;
+    q->mask |= 1ULL << l;
+    rq->total_weight += p->weight;
+    rq->nr_running++;
+    p->rq = rq;
+    p->on_rq = true;
+}
+
+static void mlq_dequeue(struct cfs_rq *rq, pcb_t *p) {
+    struct mlq_levels *q = rq->mlq;
+    int l = mlq_level(p);
+    if (p->on_rq) {
+        if (p->fifo.prev) p->fifo.prev->fifo.next = p->fifo.next;
+        else              q->head[l] = p->fifo.next;
+        if (p->fifo.next) p->fifo.next->fifo.prev = p->fifo.prev;
+        else              q->tail[l] = p->fifo.prev;
+        if (!q->head[l]) q->mask &= ~(1ULL << l);
+        rq->total_weight -= p->weight;
+        rq->nr_running--;
+        p->on_rq = false;
+    }
+}
+
+static pcb_t *mlq_pick_next(struct cfs_rq *rq) {
+    uint64_t mask = rq->mlq->mask;
+    return mask ? rq->mlq->head[__builtin_ctzll(mask)] : NULL;
+}
+
+// The quantum does not depend on the load.
+static uint64_t mlq_timeslice(const struct cfs_rq *rq, const pcb_t *p, uint64_t total,
+                              uint64_t cap, uint64_t *lo, uint64_t *hi) {
+    (void)p;
+    (void)total;
+    *lo = 0;
+    *hi = UINT64_MAX;
+    return rq->tun->quantum < cap ? rq->tun->quantum : cap;
+}
+
+static void mlq_tick(struct cfs_rq *rq, pcb_t *p, uint64_t ran, uint32_t extern_weight) {
+    (void)ran;
+    (void)extern_weight;
+    mlq_enqueue(rq, p, false);
+}
+
+static void mlq_move(struct cfs_rq *src, struct cfs_rq *dst, pcb_t *p) {
+    mlq_dequeue(src, p);
+    mlq_enqueue(dst, p, false);
+}
+
+static void mlq_for_each(struct cfs_rq *rq, void (*fn)(pcb_t *p, void *arg), void *arg) {
+    for (int l = 0; l < MLQ_LEVELS; l++)
+        for (pcb_t *p = rq->mlq->head[l]; p; p = p->fifo.next)
+            fn(p, arg);
+}
+
+const sched_policy mlq_policy = {
+    .name           = "mlq",
+    .groups         = false,
+    .preemptive     = false,
+    .init_rq        = mlq_init_rq,
+    .destroy_rq     = mlq_destroy_rq,
+    .enqueue        = mlq_enqueue,
+    .dequeue        = mlq_dequeue,
+    .pick_next      = mlq_pick_next,
+    .timeslice      = mlq_timeslice,
+    .tick           = mlq_tick,
+    .move           = mlq_move,
+    .wakeup_preempt = NULL,
+    .for_each       = mlq_for_each,
+};
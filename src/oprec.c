@@ -0,0 +1,128 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "oprec.h"
+
+#ifdef SIM_RECORD_OPS
+
+// Address → dense number, open addressing; numbers are never given back.
+typedef struct {
+    const void **keys;
+    uint32_t    *vals;
+    size_t       mask;
+    uint32_t     n;
+} ptr_ids;
+
+typedef struct {
+    FILE   *out;
+    ptr_ids elems[OPQ_KINDS];
+    ptr_ids queues[OPQ_KINDS];
+} recorder;
+
+static recorder rec;
+
+static size_t ptr_hash(const void *p, size_t mask) {
+    return (size_t)(((uintptr_t)p >> 3) * 0x9E3779B97F4A7C15ULL >> 32) & mask;
+}
+
+static void ids_init(ptr_ids *m) {
+    m->mask = 1023;
+    m->n = 0;
+    m->keys = calloc(m->mask + 1, sizeof(*m->keys));
+    m->vals = malloc((m->mask + 1) * sizeof(*m->vals));
+    if (!m->keys || !m->vals) {
+        perror("malloc");
+        exit(EXIT_FAILURE);
+    }
+}
+
+static void ids_free(ptr_ids *m) {
+    free(m->keys);
+    free(m->vals);
+    memset(m, 0, sizeof(*m));
+}
+
+static uint32_t ids_get(ptr_ids *m, const void *p) {
+    size_t h = ptr_hash(p, m->mask);
+    for (; m->keys[h]; h = (h + 1) & m->mask)
+        if (m->keys[h] == p) return m->vals[h];
+    uint32_t id = m->n++;
+    m->keys[h] = p;
+    m->vals[h] = id;
+    if ((size_t)m->n * 2 > m->mask + 1) {
+        ptr_ids big = { NULL, NULL, m->mask * 2 + 1, m->n };
+        big.keys = calloc(big.mask + 1, sizeof(*big.keys));
+        big.vals = malloc((big.mask + 1) * sizeof(*big.vals));
+        if (!big.keys || !big.vals) {
+            perror("malloc");
+            exit(EXIT_FAILURE);
+        }
+        for (size_t i = 0; i <= m->mask; i++) {
+            if (!m->keys[i]) continue;
+            size_t j = ptr_hash(m->keys[i], big.mask);
+            while (big.keys[j]) j = (j + 1) & big.mask;
+            big.keys[j] = m->keys[i];
+            big.vals[j] = m->vals[i];
+        }
+        ids_free(m);
+        *m = big;
+    }
+    return id;
+}
+
+void oprec_open(const char *path) {
+    rec.out = fopen(path, "wb");
+    if (!rec.out) {
+        perror("fopen");
+        exit(EXIT_FAILURE);
+    }
+    static char buf[1 << 20];
+    setvbuf(rec.out, buf, _IOFBF, sizeof(buf));
+    oprec_header h;
+    memset(&h, 0, sizeof(h));
+    memcpy(h.magic, OPREC_MAGIC, sizeof(OPREC_MAGIC));
+    h.version = OPREC_VERSION;
+    h.rec_size = sizeof(oprec);
+    fwrite(&h, sizeof(h), 1, rec.out);
+    for (int k = 0; k < OPQ_KINDS; k++) {
+        ids_init(&rec.elems[k]);
+        ids_init(&rec.queues[k]);
+    }
+}
+
+void oprec_close(void) {
+    if (!rec.out) return;
+    if (fclose(rec.out) != 0) {
+        perror("fclose");
+        exit(EXIT_FAILURE);
+    }
+    rec.out = NULL;
+    for (int k = 0; k < OPQ_KINDS; k++) {
+        ids_free(&rec.elems[k]);
+        ids_free(&rec.queues[k]);
+    }
+}
+
+void oprec_log(opq_kind kind, op_type op, const void *queue, const void *elem,
+               uint64_t key, uint64_t tie) {
+    if (!rec.out) return;
+    oprec r = { (uint8_t)kind, (uint8_t)op, (uint16_t)ids_get(&rec.queues[kind], queue),
+                ids_get(&rec.elems[kind], elem), key, tie };
+    if (fwrite(&r, sizeof(r), 1, rec.out) != 1) {
+        perror("fwrite");
+        exit(EXIT_FAILURE);
+    }
+}
+
+#else
+
+void oprec_open(const char *path) {
+    (void)path;
+    fprintf(stderr, "Error: --record-ops needs the record build (make simulate_cfs_record)\n");
+    exit(EXIT_FAILURE);
+}
+
+void oprec_close(void) {
+}
+
+#endif
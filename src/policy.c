@@ -0,0 +1,10 @@
+#include <string.h>
+#include "policy.h"
+
+static const sched_policy *const policies[] = { &cfs_policy, &mlq_policy };
+
+const sched_policy *policy_find(const char *name) {
+    for (size_t i = 0; i < sizeof(policies) / sizeof(policies[0]); i++)
+        if (strcmp(policies[i]->name, name) == 0) return policies[i];
+    return NULL;
+}
@@ -0,0 +1,168 @@
+#define _DEFAULT_SOURCE             // sysconf(_SC_NPROCESSORS_ONLN)
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include "pool.h"
+
+int pool_default_threads(void) {
+    long n = sysconf(_SC_NPROCESSORS_ONLN);
+    return n > 0 ? (int)n : 1;
+}
+
+static void deque_push(pool_deque *d, pool_job job) {
+    pthread_mutex_lock(&d->lock);
+    if (d->size == d->cap) {
+        size_t newcap = d->cap ? d->cap * 2 : 16;
+        pool_job *jobs = malloc(newcap * sizeof(pool_job));
+        if (!jobs) {
+            perror("malloc");
+            exit(EXIT_FAILURE);
+        }
+        for (size_t i = 0; i < d->size; i++)
+            jobs[i] = d->jobs[(d->head + i) % d->cap];
+        free(d->jobs);
+        d->jobs = jobs;
+        d->head = 0;
+        d->cap = newcap;
+    }
+    d->jobs[(d->head + d->size) % d->cap] = job;
+    d->size++;
+    pthread_mutex_unlock(&d->lock);
+}
+
+// Owner end: newest job.
+static bool deque_pop(pool_deque *d, pool_job *out) {
+    pthread_mutex_lock(&d->lock);
+    bool ok = d->size > 0;
+    if (ok) *out = d->jobs[(d->head + --d->size) % d->cap];
+    pthread_mutex_unlock(&d->lock);
+    return ok;
+}
+
+// Thief end: oldest job.
+static bool deque_steal(pool_deque *d, pool_job *out) {
+    pthread_mutex_lock(&d->lock);
+    bool ok = d->size > 0;
+    if (ok) {
+        *out = d->jobs[d->head];
+        d->head = (d->head + 1) % d->cap;
+        d->size--;
+    }
+    pthread_mutex_unlock(&d->lock);
+    return ok;
+}
+
+typedef struct {
+    pool_t *pool;
+    int     id;
+} worker_arg;
+
+static bool find_job(pool_t *p, int id, pool_job *job) {
+    if (deque_pop(&p->deques[id], job)) return true;
+    for (int k = 1; k < p->nthreads; k++)
+        if (deque_steal(&p->deques[(id + k) % p->nthreads], job)) return true;
+    return false;
+}
+
+static void *worker_main(void *arg) {
+    worker_arg *wa = arg;
+    pool_t *p = wa->pool;
+    int id = wa->id;
+    free(wa);
+
+    while (1) {
+        pool_job job;
+        if (find_job(p, id, &job)) {
+            pthread_mutex_lock(&p->lock);
+            p->queued--;
+            pthread_mutex_unlock(&p->lock);
+
+            job.fn(job.arg);
+
+            pthread_mutex_lock(&p->lock);
+            if (--p->pending == 0) pthread_cond_broadcast(&p->done_cv);
+            pthread_mutex_unlock(&p->lock);
+            continue;
+        }
+        pthread_mutex_lock(&p->lock);
+        while (p->queued == 0 && !p->shutdown)
+            pthread_cond_wait(&p->work_cv, &p->lock);
+        bool stop = p->shutdown && p->queued == 0;
+        pthread_mutex_unlock(&p->lock);
+        if (stop) break;
+    }
+    return NULL;
+}
+
+void pool_init(pool_t *p, int nthreads) {
+    p->nthreads = nthreads > 0 ? nthreads : 1;
+    p->threads = malloc((size_t)p->nthreads * sizeof(pthread_t));
+    p->deques = calloc((size_t)p->nthreads, sizeof(pool_deque));
+    if (!p->threads || !p->deques) {
+        perror("malloc");
+        exit(EXIT_FAILURE);
+    }
+    pthread_mutex_init(&p->lock, NULL);
+    pthread_cond_init(&p->work_cv, NULL);
+    pthread_cond_init(&p->done_cv, NULL);
+    p->queued = p->pending = p->next = 0;
+    p->shutdown = false;
+
+    for (int i = 0; i < p->nthreads; i++)
+        pthread_mutex_init(&p->deques[i].lock, NULL);
+    for (int i = 0; i < p->nthreads; i++) {
+        worker_arg *wa = malloc(sizeof(*wa));
+        if (!wa) {
+            perror("malloc");
+            exit(EXIT_FAILURE);
+        }
+        wa->pool = p;
+        wa->id = i;
+        if (pthread_create(&p->threads[i], NULL, worker_main, wa) != 0) {
+            fprintf(stderr, "Failed to start pool worker %d\n", i);
+            exit(EXIT_FAILURE);
+        }
+    }
+}
+
+void pool_submit(pool_t *p, pool_fn fn, void *arg) {
+    pool_job job = { fn, arg };
+    // Count the job first so a worker that grabs it never sees the counters underflow.
+    pthread_mutex_lock(&p->lock);
+    p->queued++;
+    p->pending++;
+    pthread_mutex_unlock(&p->lock);
+
+    deque_push(&p->deques[p->next], job);
+    p->next = (p->next + 1) % (size_t)p->nthreads;
+
+    pthread_mutex_lock(&p->lock);
+    pthread_cond_signal(&p->work_cv);
+    pthread_mutex_unlock(&p->lock);
+}
+
+void pool_wait(pool_t *p) {
+    pthread_mutex_lock(&p->lock);
+    while (p->pending > 0)
+        pthread_cond_wait(&p->done_cv, &p->lock);
+    pthread_mutex_unlock(&p->lock);
+}
+
+void pool_destroy(pool_t *p) {
+    pthread_mutex_lock(&p->lock);
+    p->shutdown = true;
+    pthread_cond_broadcast(&p->work_cv);
+    pthread_mutex_unlock(&p->lock);
+    for (int i = 0; i < p->nthreads; i++)
+        pthread_join(p->threads[i], NULL);
+
+    for (int i = 0; i < p->nthreads; i++) {
+        pthread_mutex_destroy(&p->deques[i].lock);
+        free(p->deques[i].jobs);
+    }
+    pthread_mutex_destroy(&p->lock);
+    pthread_cond_destroy(&p->work_cv);
+    pthread_cond_destroy(&p->done_cv);
+    free(p->deques);
+    free(p->threads);
+}
@@ -0,0 +1,103 @@
+#define _DEFAULT_SOURCE             // clock_gettime
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "prof.h"
+#include "clock.h"
+
+#ifdef SIM_PROFILE
+#include "metrics.h"
+
+static const char *phase_name[PROF_PHASES] = {
+    [PH_POP] = "event_pop", [PH_BALANCE] = "load_balance", [PH_ENTER] = "enqueue",
+    [PH_RESLICE] = "reslice", [PH_DISPATCH] = "dispatch_idle", [PH_PREEMPT] = "preempt",
+    [PH_VICTIM] = "victim_search", [PH_END] = "end",
+};
+
+static const char *counter_name[PROF_COUNTERS] = {
+    [PROF_RQ_INSERT] = "rq_insert", [PROF_RQ_ERASE] = "rq_erase",
+    [PROF_EV_INSERT] = "event_insert", [PROF_EV_POP] = "event_pop",
+    [PROF_EV_CANCEL] = "event_cancel", [PROF_EV_MOVE] = "event_move",
+    [PROF_RB_ROTATE] = "rb_rotations", [PROF_WHEEL_CASCADE] = "wheel_cascades",
+};
+
+_Thread_local uint64_t prof_counters[PROF_COUNTERS];
+
+// Phase histograms are in ticks; the report scales them to ns.
+static _Thread_local struct {
+    const char *path;
+    histogram_t phases[PROF_PHASES];
+    uint64_t    tick0, ns0;
+} prof;
+
+#if !defined(__x86_64__) && !defined(__i386__)
+uint64_t prof_ticks(void) {
+    return clock_ns();
+}
+#endif
+
+void prof_phase_add(prof_phase ph, uint64_t ticks) {
+    hist_add(&prof.phases[ph], ticks);
+}
+
+void prof_open(const char *path) {
+    prof.path = path;
+    prof.ns0 = clock_ns();
+    prof.tick0 = prof_ticks();
+}
+
+void prof_close(void) {
+    if (!prof.path) return;
+    uint64_t ticks = prof_ticks() - prof.tick0;
+    uint64_t ns = clock_ns() - prof.ns0;
+    double ns_per_tick = ticks ? (double)ns / (double)ticks : 1.0;
+    FILE *out = strcmp(prof.path, "-") == 0 ? stdout : fopen(prof.path, "w");
+    if (!out) {
+        perror("fopen");
+        exit(EXIT_FAILURE);
+    }
+    fprintf(out, "{\n");
+#if defined(__x86_64__) || defined(__i386__)
+    fprintf(out, "  \"clock\": \"tsc\",\n");
+#else
+    fprintf(out, "  \"clock\": \"clock_gettime\",\n");
+#endif
+    fprintf(out, "  \"ns_per_tick\": %.6f,\n", ns_per_tick);
+    fprintf(out, "  \"wall_ns\": %llu,\n", (unsigned long long)ns);
+    fprintf(out, "  \"phases\": {");
+    for (int i = 0; i < PROF_PHASES; i++) {
+        const histogram_t *h = &prof.phases[i];
+        fprintf(out, "%s\n    \"%s\": { \"calls\": %llu, \"total_ns\": %.0f, \"mean_ns\": %.1f",
+                i ? "," : "", phase_name[i], (unsigned long long)h->count,
+                h->sum * ns_per_tick, hist_mean(h) * ns_per_tick);
+        for (size_t j = 0; j < HIST_NUM_PCT; j++)
+            fprintf(out, ", \"%s_ns\": %.0f", hist_pct_name[j],
+                    (double)hist_percentile(h, hist_pct_q[j]) * ns_per_tick);
+        fprintf(out, ", \"max_ns\": %.0f }", (double)h->max * ns_per_tick);
+    }
+    fprintf(out, "\n  },\n");
+    fprintf(out, "  \"counters\": {");
+    for (int i = 0; i < PROF_COUNTERS; i++)
+        fprintf(out, "%s\n    \"%s\": %llu", i ? "," : "", counter_name[i],
+                (unsigned long long)prof_counters[i]);
+    fprintf(out, "\n  }\n");
+    fprintf(out, "}\n");
+    if (out != stdout && fclose(out) != 0) {
+        perror("fclose");
+        exit(EXIT_FAILURE);
+    }
+    prof.path = NULL;
+}
+
+#else
+
+void prof_open(const char *path) {
+    (void)path;
+    fprintf(stderr, "Error: --profile needs the profiling build (make simulate_cfs_prof)\n");
+    exit(EXIT_FAILURE);
+}
+
+void prof_close(void) {
+}
+
+#endif
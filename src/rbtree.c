@@ -61,57 +61,60 @@ static RBNode* minimum(RBNode* node) {
     return node;
 }
 
-// Fix-up after deletion to restore red-black properties
-static void fix_delete(RBTree* tree, RBNode* x) {
-    while (x && x != tree->root && x->color == BLACK) {
-        if (x == x->parent->left) {
-            RBNode* w = x->parent->right;
-            if (w && w->color == RED) {
+// Fix-up after deletion to restore red-black properties.
+// x may be NULL (an empty leaf), so its parent is passed explicitly.
+static void fix_delete(RBTree* tree, RBNode* x, RBNode* parent) {
+    while (x != tree->root && (!x || x->color == BLACK)) {
+        if (x == parent->left) {
+            RBNode* w = parent->right;
+            if (w->color == RED) {
                 w->color = BLACK;
-                x->parent->color = RED;
-                left_rotate(tree, x->parent);
-                w = x->parent->right;
+                parent->color = RED;
+                left_rotate(tree, parent);
+                w = parent->right;
             }
             if ((!w->left || w->left->color == BLACK) &&
                 (!w->right || w->right->color == BLACK)) {
                 w->color = RED;
-                x = x->parent;
+                x = parent;
+                parent = x->parent;
             } else {
                 if (!w->right || w->right->color == BLACK) {
                     if (w->left) w->left->color = BLACK;
                     w->color = RED;
                     right_rotate(tree, w);
-                    w = x->parent->right;
+                    w = parent->right;
                 }
-                w->color = x->parent->color;
-                x->parent->color = BLACK;
+                w->color = parent->color;
+                parent->color = BLACK;
                 if (w->right) w->right->color = BLACK;
-                left_rotate(tree, x->parent);
+                left_rotate(tree, parent);
                 x = tree->root;
             }
         } else {
-            RBNode* w = x->parent->left;
-            if (w && w->color == RED) {
+            RBNode* w = parent->left;
+            if (w->color == RED) {
                 w->color = BLACK;
-                x->parent->color = RED;
-                right_rotate(tree, x->parent);
-                w = x->parent->left;
+                parent->color = RED;
+                right_rotate(tree, parent);
+                w = parent->left;
             }
             if ((!w->left || w->left->color == BLACK) &&
                 (!w->right || w->right->color == BLACK)) {
                 w->color = RED;
-                x = x->parent;
+                x = parent;
+                parent = x->parent;
             } else {
                 if (!w->left || w->left->color == BLACK) {
                     if (w->right) w->right->color = BLACK;
                     w->color = RED;
                     left_rotate(tree, w);
-                    w = x->parent->left;
+                    w = parent->left;
                 }
-                w->color = x->parent->color;
-                x->parent->color = BLACK;
+                w->color = parent->color;
+                parent->color = BLACK;
                 if (w->left) w->left->color = BLACK;
-                right_rotate(tree, x->parent);
+                right_rotate(tree, parent);
                 x = tree->root;
             }
         }
@@ -119,37 +122,39 @@ static void fix_delete(RBTree* tree, RBNode* x) {
     if (x) x->color = BLACK;
 }
 
-// Public delete: removes data if found
-void rbtree_delete(RBTree* tree, void* data) {
-    RBNode* z = tree->root;
-    while (z && tree->cmpop(data, z->data) != 0)
-        z = (tree->cmpop(data, z->data) < 0) ? z->left : z->right;
-    if (!z) return;
+// Unlink a node known to be in the tree and free it
+void rbtree_erase(RBTree* tree, RBNode* z) {
+    if (z == tree->leftmost)
+        tree->leftmost = rb_next(z);
 
     RBNode* y = z;
     Color y_color = y->color;
     RBNode* x = NULL;
+    RBNode* x_parent = NULL;
 
     if (!z->left) {
         x = z->right;
+        x_parent = z->parent;
         transplant(tree, z, z->right);
     } else if (!z->right) {
         x = z->left;
+        x_parent = z->parent;
         transplant(tree, z, z->left);
     } else {
         y = minimum(z->right);
         y_color = y->color;
         x = y->right;
         if (y->parent == z) {
-            if (x) x->parent = y;
+            x_parent = y;
         } else {
+            x_parent = y->parent;
             transplant(tree, y, y->right);
             y->right = z->right;
-            if (y->right) y->right->parent = y;
+            y->right->parent = y;
         }
         transplant(tree, z, y);
         y->left = z->left;
-        if (y->left) y->left->parent = y;
+        y->left->parent = y;
         y->color = z->color;
     }
 
@@ -157,7 +162,18 @@ void rbtree_delete(RBTree* tree, void* data) {
         tree->free_data(z->data);
     free(z);
     if (y_color == BLACK)
-        fix_delete(tree, x);
+        fix_delete(tree, x, x_parent);
+}
+
+// Public delete: removes data if found
+void rbtree_delete(RBTree* tree, void* data) {
+    RBNode* z = tree->root;
+    while (z) {
+        int cmp = tree->cmpop(data, z->data);
+        if (cmp == 0) break;
+        z = (cmp < 0) ? z->left : z->right;
+    }
+    if (z) rbtree_erase(tree, z);
 }
 
 // Fix-up after insertion
@@ -205,31 +221,75 @@ void rbtree_insert(RBTree* tree, void* data) {
     RBNode* z = create_node(tree, data);
     RBNode* y = NULL;
     RBNode* x = tree->root;
+    int cmp = 0;
+    int leftmost = 1;   // stays set while the descent only goes left
     while (x) {
         y = x;
-        x = (tree->cmpop(z->data, x->data) < 0) ? x->left : x->right;
+        cmp = tree->cmpop(z->data, x->data);
+        if (cmp < 0) {
+            x = x->left;
+        } else {
+            x = x->right;
+            leftmost = 0;
+        }
     }
     z->parent = y;
     if (!y)
         tree->root = z;
-    else if (tree->cmpop(z->data, y->data) < 0)
+    else if (cmp < 0)
         y->left = z;
     else
         y->right = z;
+    if (leftmost)
+        tree->leftmost = z;
     fix_insert(tree, z);
 }
 
-// In-order traversal
-static void inorder(RBNode* node, PrintFunc print) {
-    if (!node) return;
-    inorder(node->left, print);
-    print(node->data);
-    inorder(node->right, print);
+// Leftmost node, cached so peeking the minimum never walks the tree
+RBNode* rb_first(const RBTree* tree) {
+    return tree->leftmost;
+}
+
+RBNode* rb_last(const RBTree* tree) {
+    RBNode* node = tree->root;
+    if (!node) return NULL;
+    while (node->right)
+        node = node->right;
+    return node;
+}
+
+// In-order successor
+RBNode* rb_next(const RBNode* node) {
+    if (node->right)
+        return minimum(node->right);
+    RBNode* parent = node->parent;
+    while (parent && node == parent->right) {
+        node = parent;
+        parent = parent->parent;
+    }
+    return parent;
+}
+
+// In-order predecessor
+RBNode* rb_prev(const RBNode* node) {
+    if (node->left) {
+        node = node->left;
+        while (node->right)
+            node = node->right;
+        return (RBNode*)node;
+    }
+    RBNode* parent = node->parent;
+    while (parent && node == parent->left) {
+        node = parent;
+        parent = parent->parent;
+    }
+    return parent;
 }
 
-// Public print
+// Public print (in-order)
 void rbtree_print(RBTree* tree, PrintFunc print) {
-    inorder(tree->root, print);
+    for (RBNode* n = rb_first(tree); n; n = rb_next(n))
+        print(n->data);
 }
 
 // Public search: retrieves data if found
@@ -252,6 +312,7 @@ RBTree* new_rbtree(CmpOp cmpop, CloneFunc clone_data, FreeFunc free_data) {
         exit(EXIT_FAILURE);
     }
     tree->root = NULL;
+    tree->leftmost = NULL;
     tree->cmpop = cmpop;
     tree->clone_data = clone_data;
     tree->free_data = free_data;
@@ -0,0 +1,364 @@
+#define _GNU_SOURCE                 // pthread_setaffinity_np, sched_getaffinity
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <sched.h>
+#include <time.h>
+#include "runtime.h"
+#include "clock.h"
+
+struct rt_ctx {
+    rt_worker *w;
+    rt_task   *t;
+    uint64_t   start;
+    uint64_t   deadline;        // end of the slice, or of the budget if sooner
+};
+
+uint64_t rt_now(const rt_runtime *rt) {
+    return clock_ns() - rt->t0;
+}
+
+// Take w's rq_lock, counting whether and how long it had to wait.
+static void rq_lock(rt_worker *w) {
+    pthread_mutex_t *l = &w->rq.rq_lock;
+    uint64_t wait = 0;
+    bool contended = pthread_mutex_trylock(l) != 0;
+    if (contended) {
+        uint64_t t = clock_ns();
+        pthread_mutex_lock(l);
+        wait = clock_ns() - t;
+    }
+    w->lock.acquisitions++;
+    w->lock.contended += contended;
+    w->lock.wait_ns += wait;
+}
+
+static void rq_unlock(rt_worker *w) {
+    pthread_mutex_unlock(&w->rq.rq_lock);
+}
+
+// Wake a sleeping worker, if there is one, for work that just got queued.
+static void kick(rt_runtime *rt) {
+    if (atomic_load(&rt->sleepers) == 0) return;
+    pthread_mutex_lock(&rt->idle_lock);
+    pthread_cond_signal(&rt->idle_cv);
+    pthread_mutex_unlock(&rt->idle_lock);
+}
+
+bool rt_should_yield(rt_ctx *ctx) {
+    return atomic_load_explicit(&ctx->w->resched, memory_order_relaxed)
+        || clock_ns() - ctx->w->rt->t0 >= ctx->deadline;
+}
+
+uint64_t rt_budget_left(rt_ctx *ctx) {
+    if (ctx->t->budget == 0) return UINT64_MAX;
+    uint64_t used = ctx->t->pcb.burst + (rt_now(ctx->w->rt) - ctx->start);
+    return used < ctx->t->budget ? ctx->t->budget - used : 0;
+}
+
+static void submit(rt_runtime *rt, rt_work_fn fn, void *arg, uint32_t pid, uint64_t seq,
+                   int nice, uint64_t budget) {
+    rt_task *t = malloc(sizeof(*t));
+    if (!t) {
+        perror("malloc");
+        exit(EXIT_FAILURE);
+    }
+    memset(t, 0, sizeof(*t));
+    t->fn = fn;
+    t->arg = arg;
+    t->budget = budget;
+    pcb_t *p = &t->pcb;
+    p->pid = pid;
+    p->seq = seq;
+    p->nice = nice < -20 ? -20 : nice > 19 ? 19 : nice;
+    p->weight = cfs_compute_weight(p->nice);
+    p->first_run = UINT64_MAX;
+    p->wake_time = UINT64_MAX;
+    p->lock = -1;
+
+    atomic_fetch_add(&rt->pending, 1);
+    rt_worker *w = &rt->workers[seq % (uint64_t)rt->n];
+    rq_lock(w);
+    p->arrival = t->ready = rt_now(rt);
+    cfs_place_entity(&w->rq, p);
+    cfs_enqueue(&w->rq, p);
+    atomic_fetch_add(&rt->queued, 1);     // before a stealer can see p and take it off
+    pcb_t *curr = w->cpu.running_process;
+    if (curr && cfs_wakeup_preempt(&w->rq, curr, p))
+        atomic_store_explicit(&w->resched, true, memory_order_relaxed);
+    rq_unlock(w);
+    kick(rt);
+}
+
+void rt_submit(rt_runtime *rt, rt_work_fn fn, void *arg, int nice, uint64_t budget_ns) {
+    uint64_t seq = atomic_fetch_add(&rt->next, 1);
+    submit(rt, fn, arg, (uint32_t)(seq + 1), seq, nice, budget_ns);
+}
+
+// Slice for p, about to run on w, if the queue stays as it is. Under rq_lock.
+static void start_stint(rt_worker *w, pcb_t *p) {
+    p->time_slice = cfs_timeslice(&w->rq, p, p->weight);
+    w->cpu.running_process = p;
+    atomic_store_explicit(&w->resched, false, memory_order_relaxed);
+}
+
+static pcb_t *take_own(rt_worker *w) {
+    rq_lock(w);
+    pcb_t *p = cfs_pick_next(&w->rq);
+    if (p) {
+        cfs_dequeue(&w->rq, p);
+        start_stint(w, p);
+    }
+    rq_unlock(w);
+    return p;
+}
+
+/*
+ * Take the leftmost task of the first other queue that has one. Only one
+ * queue is locked at a time, so the task's lead over the source queue's
+ * min_vruntime is carried over by hand rather than with cfs_move().
+ */
+static pcb_t *steal(rt_worker *w) {
+    rt_runtime *rt = w->rt;
+    int self = (int)(w - rt->workers);
+    for (int k = 1; k < rt->n; k++) {
+        rt_worker *src = &rt->workers[(self + k) % rt->n];
+        if (atomic_load(&rt->queued) == 0) return NULL;
+        rq_lock(src);
+        pcb_t *p = cfs_pick_next(&src->rq);
+        uint64_t lag = 0;
+        if (p) {
+            lag = p->vruntime > src->rq.min_vruntime ? p->vruntime - src->rq.min_vruntime : 0;
+            cfs_dequeue(&src->rq, p);
+        }
+        rq_unlock(src);
+        if (!p) continue;
+
+        rq_lock(w);
+        p->vruntime = w->rq.min_vruntime + lag;
+        start_stint(w, p);
+        rq_unlock(w);
+        w->stats.steals++;
+        return p;
+    }
+    return NULL;
+}
+
+static void finish(rt_worker *w, rt_task *t, uint64_t now) {
+    rt_runtime *rt = w->rt;
+    if (rt->metrics) {
+        pthread_mutex_lock(&rt->metrics_lock);
+        metrics_finish(rt->metrics, &t->pcb, now);
+        pthread_mutex_unlock(&rt->metrics_lock);
+    }
+    free(t);
+    w->stats.tasks++;
+    w->last_finish = now;
+    if (atomic_fetch_sub(&rt->pending, 1) == 1) {
+        pthread_mutex_lock(&rt->idle_lock);
+        pthread_cond_broadcast(&rt->done_cv);
+        pthread_mutex_unlock(&rt->idle_lock);
+    }
+}
+
+static void run(rt_worker *w, pcb_t *p) {
+    rt_runtime *rt = w->rt;
+    rt_task *t = (rt_task *)p;
+    struct rt_ctx ctx = { w, t, rt_now(rt), 0 };
+    hist_add(&w->stats.dispatch_latency, ctx.start - t->ready);
+    w->stats.dispatches++;
+    // metrics_dispatch() without the shared counter; rt_destroy() adds it up.
+    if (p->first_run == UINT64_MAX) p->first_run = ctx.start;
+    p->nr_dispatch++;
+
+    uint64_t slice = p->time_slice;
+    if (t->budget && t->budget - p->burst < slice) slice = t->budget - p->burst;
+    ctx.deadline = ctx.start + slice;
+    bool done = t->fn(t->arg, &ctx);
+
+    uint64_t end = rt_now(rt);
+    uint64_t ran = end - ctx.start;
+    p->burst += ran;
+    w->cpu.running_time += ran;
+    done = done || (t->budget && p->burst >= t->budget);
+    bool preempted = atomic_load_explicit(&w->resched, memory_order_relaxed);
+
+    rq_lock(w);
+    w->cpu.running_process = NULL;
+    uint32_t queued = 0;
+    if (!done) {
+        t->ready = end;
+        cfs_task_tick(&w->rq, p, ran, 0);
+        atomic_fetch_add(&rt->queued, 1);
+        queued = w->rq.nr_running;
+    }
+    rq_unlock(w);
+
+    if (done) {
+        finish(w, t, end);
+        return;
+    }
+    w->stats.yields++;
+    w->stats.preemptions += preempted && ran < slice;
+    if (queued > 1) kick(rt);
+}
+
+static void *worker_main(void *arg) {
+    rt_worker *w = arg;
+    rt_runtime *rt = w->rt;
+    while (1) {
+        pcb_t *p = take_own(w);
+        if (!p) p = steal(w);
+        if (p) {
+            atomic_fetch_sub(&rt->queued, 1);
+            run(w, p);
+            continue;
+        }
+        pthread_mutex_lock(&rt->idle_lock);
+        atomic_fetch_add(&rt->sleepers, 1);
+        while (atomic_load(&rt->queued) == 0 && !rt->stop)
+            pthread_cond_wait(&rt->idle_cv, &rt->idle_lock);
+        atomic_fetch_sub(&rt->sleepers, 1);
+        bool stop = rt->stop && atomic_load(&rt->queued) == 0;
+        pthread_mutex_unlock(&rt->idle_lock);
+        if (stop) break;
+    }
+    return NULL;
+}
+
+void rt_init(rt_runtime *rt, int n, const cfs_tunables *tun, metrics_t *m) {
+    rt->n = n > 0 ? n : 1;
+    rt->workers = calloc((size_t)rt->n, sizeof(rt_worker));
+    if (!rt->workers) {
+        perror("calloc");
+        exit(EXIT_FAILURE);
+    }
+    rt->tun = *tun;
+    atomic_init(&rt->next, 0);
+    atomic_init(&rt->queued, 0);
+    atomic_init(&rt->pending, 0);
+    atomic_init(&rt->sleepers, 0);
+    rt->stop = false;
+    pthread_mutex_init(&rt->idle_lock, NULL);
+    pthread_cond_init(&rt->idle_cv, NULL);
+    pthread_cond_init(&rt->done_cv, NULL);
+    pthread_mutex_init(&rt->metrics_lock, NULL);
+    rt->metrics = m;
+    rt->t0 = clock_ns();
+
+    // Worker i goes on the i-th CPU this process may use, round robin.
+    cpu_set_t allowed;
+    int hosts[CPU_SETSIZE], nhosts = 0;
+    if (sched_getaffinity(0, sizeof(allowed), &allowed) == 0)
+        for (int c = 0; c < CPU_SETSIZE; c++)
+            if (CPU_ISSET(c, &allowed)) hosts[nhosts++] = c;
+
+    for (int i = 0; i < rt->n; i++) {
+        rt_worker *w = &rt->workers[i];
+        w->rt = rt;
+        w->cpu.cpu_id = (uint32_t)i + 1;
+        w->cpu.rq = &w->rq;
+        cfs_init_rq(&w->rq, &rt->tun);
+        atomic_init(&w->resched, false);
+        w->host_cpu = -1;
+    }
+    for (int i = 0; i < rt->n; i++) {
+        rt_worker *w = &rt->workers[i];
+        pthread_attr_t attr;
+        pthread_attr_init(&attr);
+        if (nhosts) {
+            cpu_set_t set;
+            CPU_ZERO(&set);
+            CPU_SET(hosts[i % nhosts], &set);
+            if (pthread_attr_setaffinity_np(&attr, sizeof(set), &set) == 0)
+                w->host_cpu = hosts[i % nhosts];
+        }
+        int err = pthread_create(&w->thread, &attr, worker_main, w);
+        if (err == EINVAL && w->host_cpu >= 0) {
+            // The CPU went away since sched_getaffinity(); run unpinned.
+            w->host_cpu = -1;
+            pthread_attr_destroy(&attr);
+            pthread_attr_init(&attr);
+            err = pthread_create(&w->thread, &attr, worker_main, w);
+        }
+        pthread_attr_destroy(&attr);
+        if (err != 0) {
+            fprintf(stderr, "Failed to start runtime worker %d\n", i);
+            exit(EXIT_FAILURE);
+        }
+    }
+}
+
+void rt_wait(rt_runtime *rt) {
+    pthread_mutex_lock(&rt->idle_lock);
+    while (atomic_load(&rt->pending) > 0)
+        pthread_cond_wait(&rt->done_cv, &rt->idle_lock);
+    pthread_mutex_unlock(&rt->idle_lock);
+}
+
+static void stats_add(rt_stats *dst, const rt_stats *src, const rt_lock_stats *lock) {
+    dst->tasks += src->tasks;
+    dst->dispatches += src->dispatches;
+    dst->yields += src->yields;
+    dst->preemptions += src->preemptions;
+    dst->steals += src->steals;
+    dst->lock.acquisitions += lock->acquisitions;
+    dst->lock.contended += lock->contended;
+    dst->lock.wait_ns += lock->wait_ns;
+    hist_merge(&dst->dispatch_latency, &src->dispatch_latency);
+}
+
+void rt_destroy(rt_runtime *rt, rt_stats *out) {
+    pthread_mutex_lock(&rt->idle_lock);
+    rt->stop = true;
+    pthread_cond_broadcast(&rt->idle_cv);
+    pthread_mutex_unlock(&rt->idle_lock);
+    for (int i = 0; i < rt->n; i++)
+        pthread_join(rt->workers[i].thread, NULL);
+
+    uint64_t makespan = 0, dispatches = 0, steals = 0;
+    for (int i = 0; i < rt->n; i++) {
+        rt_worker *w = &rt->workers[i];
+        if (out) stats_add(out, &w->stats, &w->lock);
+        if (w->last_finish > makespan) makespan = w->last_finish;
+        dispatches += w->stats.dispatches;
+        steals += w->stats.steals;
+    }
+    if (rt->metrics) {
+        metrics_end_busy(rt->metrics, rt->n, makespan);
+        for (int i = 0; i < rt->n; i++)
+            rt->metrics->cpu_busy[i] = rt->workers[i].cpu.running_time;
+        rt->metrics->context_switches = dispatches;
+        rt->metrics->migrations = steals;
+    }
+
+    for (int i = 0; i < rt->n; i++)
+        cfs_destroy_rq(&rt->workers[i].rq);
+    pthread_mutex_destroy(&rt->idle_lock);
+    pthread_cond_destroy(&rt->idle_cv);
+    pthread_cond_destroy(&rt->done_cv);
+    pthread_mutex_destroy(&rt->metrics_lock);
+    free(rt->workers);
+    rt->workers = NULL;
+}
+
+/* ---- workload replay ---- */
+
+static bool spin(void *arg, rt_ctx *ctx) {
+    (void)arg;
+    while (!rt_should_yield(ctx)) {}
+    return rt_budget_left(ctx) == 0;
+}
+
+void rt_replay(rt_runtime *rt, workload_t *wl, uint64_t unit) {
+    task_spec_t spec;
+    uint64_t seq;
+    while (workload_next(wl, &spec, &seq)) {
+        uint64_t at = rt->t0 + spec.arrival * unit;
+        struct timespec ts = { (time_t)(at / 1000000000ULL), (long)(at % 1000000000ULL) };
+        while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) == EINTR) {}
+        uint64_t budget = spec.burst * unit;
+        submit(rt, spin, NULL, spec.pid, seq, spec.nice, budget ? budget : 1);
+    }
+}
@@ -0,0 +1,170 @@
+#include <stdlib.h>
+#include <string.h>
+#include "sampler.h"
+
+static void *xcalloc(size_t n, size_t size) {
+    void *p = calloc(n, size);
+    if (!p) {
+        perror("calloc");
+        exit(EXIT_FAILURE);
+    }
+    return p;
+}
+
+static const struct cfs_rq *queue_of(const sampler_t *sp, uint32_t q) {
+    return sp->cm->per_cpu_rq ? &sp->cm->rqs[q] : sp->cm->shared_rq;
+}
+
+// Busy ns of c up to t, the stint in progress included.
+static uint64_t busy_until(const cpu_t *c, uint64_t t) {
+    return c->running_time + (c->running_process ? t - c->last_dispatch : 0);
+}
+
+static void csv_header(sampler_t *sp) {
+    FILE *out = sp->out;
+    fputs("time", out);
+    for (uint32_t i = 0; i < sp->num_cpu; i++)
+        fprintf(out, ",busy_%u", sp->cm->cpu_list[i].cpu_id);
+    static const char *per_queue[] = { "depth", "weight", "min_vruntime" };
+    for (size_t k = 0; k < 3; k++) {
+        if (!sp->cm->per_cpu_rq) {
+            fprintf(out, ",%s", per_queue[k]);
+            continue;
+        }
+        for (uint32_t q = 0; q < sp->nr_queues; q++)
+            fprintf(out, ",%s_%u", per_queue[k], sp->cm->cpu_list[q].cpu_id);
+    }
+    fputs(",spread\n", out);
+}
+
+static void flush_block(sampler_t *sp) {
+    uint32_t n = sp->rows;
+    if (n == 0) return;
+    const size_t B = SAMPLE_BLOCK_ROWS;
+    FILE *out = sp->out;
+    if (sp->csv) {
+        for (uint32_t r = 0; r < n; r++) {
+            fprintf(out, "%llu", (unsigned long long)sp->time[r]);
+            for (uint32_t i = 0; i < sp->num_cpu; i++)
+                fprintf(out, ",%.6f", sp->busy[i * B + r]);
+            for (uint32_t q = 0; q < sp->nr_queues; q++)
+                fprintf(out, ",%u", sp->depth[q * B + r]);
+            for (uint32_t q = 0; q < sp->nr_queues; q++)
+                fprintf(out, ",%llu", (unsigned long long)sp->weight[q * B + r]);
+            for (uint32_t q = 0; q < sp->nr_queues; q++)
+                fprintf(out, ",%llu", (unsigned long long)sp->min_vruntime[q * B + r]);
+            fprintf(out, ",%llu\n", (unsigned long long)sp->spread[r]);
+        }
+    } else {
+        uint32_t hdr[2] = { n, 0 };
+        fwrite(hdr, sizeof(hdr), 1, out);
+        fwrite(sp->time, sizeof(*sp->time), n, out);
+        for (uint32_t i = 0; i < sp->num_cpu; i++)
+            fwrite(&sp->busy[i * B], sizeof(*sp->busy), n, out);
+        for (uint32_t q = 0; q < sp->nr_queues; q++)
+            fwrite(&sp->depth[q * B], sizeof(*sp->depth), n, out);
+        for (uint32_t q = 0; q < sp->nr_queues; q++)
+            fwrite(&sp->weight[q * B], sizeof(*sp->weight), n, out);
+        for (uint32_t q = 0; q < sp->nr_queues; q++)
+            fwrite(&sp->min_vruntime[q * B], sizeof(*sp->min_vruntime), n, out);
+        fwrite(sp->spread, sizeof(*sp->spread), n, out);
+    }
+    if (ferror(out)) {
+        perror("fwrite");
+        exit(EXIT_FAILURE);
+    }
+    sp->rows = 0;
+}
+
+void sampler_open(sampler_t *sp, const char *path, uint64_t every, const cpu_manager *cm,
+                  uint64_t now) {
+    memset(sp, 0, sizeof(*sp));
+    size_t len = strlen(path);
+    sp->csv = len >= 4 && strcmp(path + len - 4, ".csv") == 0;
+    sp->out = fopen(path, sp->csv ? "w" : "wb");
+    if (!sp->out) {
+        perror("fopen");
+        exit(EXIT_FAILURE);
+    }
+    sp->cm = cm;
+    sp->every = every;
+    sp->next = (now / every + 1) * every;
+    sp->last = now;
+    sp->num_cpu = (uint32_t)cm->n;
+    sp->nr_queues = cm->per_cpu_rq ? (uint32_t)cm->n : 1;
+
+    const size_t B = SAMPLE_BLOCK_ROWS;
+    sp->prev_busy    = xcalloc(sp->num_cpu, sizeof(*sp->prev_busy));
+    sp->time         = xcalloc(B, sizeof(*sp->time));
+    sp->busy         = xcalloc(sp->num_cpu * B, sizeof(*sp->busy));
+    sp->depth        = xcalloc(sp->nr_queues * B, sizeof(*sp->depth));
+    sp->weight       = xcalloc(sp->nr_queues * B, sizeof(*sp->weight));
+    sp->min_vruntime = xcalloc(sp->nr_queues * B, sizeof(*sp->min_vruntime));
+    sp->spread       = xcalloc(B, sizeof(*sp->spread));
+    for (uint32_t i = 0; i < sp->num_cpu; i++)
+        sp->prev_busy[i] = busy_until(&cm->cpu_list[i], now);
+
+    if (sp->csv) {
+        csv_header(sp);
+    } else {
+        sample_header h;
+        memset(&h, 0, sizeof(h));
+        memcpy(h.magic, SAMPLE_MAGIC, sizeof(SAMPLE_MAGIC));
+        h.version = SAMPLE_VERSION;
+        h.num_cpu = sp->num_cpu;
+        h.nr_queues = sp->nr_queues;
+        h.block_rows = SAMPLE_BLOCK_ROWS;
+        h.every = every;
+        fwrite(&h, sizeof(h), 1, sp->out);
+    }
+}
+
+// One row per boundary up to t. The queues cannot change in between, so
+// only the busy shares differ from row to row.
+void sampler_take(sampler_t *sp, uint64_t t) {
+    const size_t B = SAMPLE_BLOCK_ROWS;
+    for (; sp->next <= t; sp->next += sp->every) {
+        uint64_t b = sp->next;
+        uint32_t r = sp->rows;
+        sp->time[r] = b;
+        for (uint32_t i = 0; i < sp->num_cpu; i++) {
+            uint64_t busy = busy_until(&sp->cm->cpu_list[i], b);
+            sp->busy[i * B + r] = (float)(busy - sp->prev_busy[i]) / (float)(b - sp->last);
+            sp->prev_busy[i] = busy;
+        }
+        uint64_t lo = UINT64_MAX, hi = 0;
+        for (uint32_t q = 0; q < sp->nr_queues; q++) {
+            const struct cfs_rq *rq = queue_of(sp, q);
+            sp->depth[q * B + r] = rq->nr_running;
+            sp->weight[q * B + r] = rq->total_weight;
+            sp->min_vruntime[q * B + r] = rq->min_vruntime;
+            if (rq->min_vruntime < lo) lo = rq->min_vruntime;
+            if (rq->min_vruntime > hi) hi = rq->min_vruntime;
+        }
+        sp->spread[r] = hi - lo;
+        sp->last = b;
+        if (++sp->rows == SAMPLE_BLOCK_ROWS) flush_block(sp);
+    }
+}
+
+void sampler_close(sampler_t *sp, uint64_t end) {
+    if (!sp->out) return;
+    sampler_advance(sp, end);
+    if (end > sp->last) {       // a short last row, so the busy shares add up to the run
+        sp->next = end;
+        sampler_take(sp, end);
+    }
+    flush_block(sp);
+    if (fclose(sp->out) != 0) {
+        perror("fclose");
+        exit(EXIT_FAILURE);
+    }
+    free(sp->prev_busy);
+    free(sp->time);
+    free(sp->busy);
+    free(sp->depth);
+    free(sp->weight);
+    free(sp->min_vruntime);
+    free(sp->spread);
+    memset(sp, 0, sizeof(*sp));
+}
@@ -0,0 +1,737 @@
+#include "sim.h"
+#include "snapshot.h"
+#include "prof.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <limits.h>
+#include <assert.h>
+
+//Turn on/off how print.
+// #define SHOW_PRINT
+
+#define min(x,y) ((x) < (y) ? (x) : (y))
+
+static event_t make_event(cpu_t *cpu, event_type ev_type, pcb_t *proc, uint64_t time) {
+    event_t e;
+    e.cpu  = cpu;
+    e.ev   = ev_type;
+    e.proc = proc;
+    e.time = time;
+    return e;
+}
+
+/*
+ * Locks. A task with a lock takes it when it is picked at the start of a
+ * run phase and keeps it, across preemptions, until the phase ends. If the
+ * lock is taken the task leaves the run-queue and waits in line.
+ */
+static sim_lock *lock_get(sim_t *s, int32_t id) {
+    if ((uint32_t)id >= s->nr_locks) {
+        uint32_t n = s->nr_locks ? s->nr_locks : 16;
+        while (n <= (uint32_t)id) n *= 2;
+        sim_lock *l = realloc(s->locks, n * sizeof(sim_lock));
+        if (!l) { perror("realloc"); exit(EXIT_FAILURE); }
+        memset(l + s->nr_locks, 0, (n - s->nr_locks) * sizeof(sim_lock));
+        s->locks = l;
+        s->nr_locks = n;
+    }
+    return &s->locks[id];
+}
+
+// Take p's lock, or queue p behind the holder and return false.
+static bool lock_acquire(sim_t *s, pcb_t *p) {
+    sim_lock *l = lock_get(s, p->lock);
+    if (!l->owner) {
+        l->owner = p;
+        p->holds_lock = true;
+        return true;
+    }
+    p->wait_next = NULL;
+    if (l->wait_tail) l->wait_tail->wait_next = p;
+    else              l->wait_head = p;
+    l->wait_tail = p;
+    return false;
+}
+
+// Drop p's lock; the first waiter gets it and wakes up at t.
+static void lock_release(sim_t *s, pcb_t *p, uint64_t t) {
+    if (!p->holds_lock) return;
+    sim_lock *l = &s->locks[p->lock];
+    p->holds_lock = false;
+    pcb_t *w = l->wait_head;
+    l->owner = w;
+    if (!w) return;
+    l->wait_head = w->wait_next;
+    if (!l->wait_head) l->wait_tail = NULL;
+    w->holds_lock = true;
+    event_t ev = make_event(NULL, EVENT_WAKEUP, w, t);
+    event_tree_insert(&s->events, &ev);
+}
+
+// Next task for c: its own queue first, then whatever idle balancing can pull.
+// Tasks whose lock is taken are parked on the lock on the way.
+static pcb_t *pick_next_for(sim_t *s, cpu_t *c, uint64_t t) {
+    while (1) {
+        pcb_t *p = s->pol->pick_next(c->rq);
+        if (!p) p = cpu_idle_balance(&s->cpu, c, t);
+        if (!p || p->lock < 0 || p->holds_lock || lock_acquire(s, p)) return p;
+        s->pol->dequeue(p->rq, p);
+        s->metrics->lock_waits++;
+        #ifdef SHOW_PRINT
+            printf("PID=%u waits for its lock in CPU %u\n", p->pid, c->cpu_id);
+        #else
+            trace_event(s->trace, TRACE_LOCK_WAIT, t, p->pid, c->cpu_id);
+        #endif
+    }
+}
+
+// A stint that runs p to the end of its run phase, with work left, ends in a sleep.
+static event_type stint_kind(const pcb_t *p, uint64_t run) {
+    return run == p->phase_left && run < (uint64_t)p->remain ? EVENT_SLEEP : EVENT_END;
+}
+
+// Queued-plus-extern weight the slice of a stint on c is computed against.
+static uint64_t slice_total(sim_t *s, cpu_t *c) {
+    return c->rq->total_weight + cpu_extern_weight(&s->cpu, c);
+}
+
+// Length of p's stint on c under the current load, capped by its run phase.
+// Also records the load range over which that length holds.
+static uint64_t stint_len(sim_t *s, cpu_t *c, pcb_t *p) {
+    uint64_t lo, hi;
+    uint64_t run = s->pol->timeslice(c->rq, p, slice_total(s, c), p->phase_left, &lo, &hi);
+    cpu_slice_set(&s->cpu, c, lo, hi);
+    return run;
+}
+
+/*
+ * Cache warm-up p pays before it gets work done on c: the configured cost
+ * for the distance from the CPU it last ran on. Every dispatch after the
+ * first is also counted by that distance.
+ */
+static uint64_t migration_cost(sim_t *s, cpu_t *c, pcb_t *p) {
+    uint32_t prev = p->last_cpu;
+    p->last_cpu = c->cpu_id;
+    if (!prev) return 0;
+    topo_level l = topology_distance(&s->cpu.topo, prev - 1, c->cpu_id - 1);
+    uint64_t cost = s->params.migration_cost[l];
+    s->metrics->dispatch_distance[l]++;
+    s->metrics->migration_cost += cost;
+    p->mig_cost += cost;
+    return cost;
+}
+
+// Run p on c from t until its slice or its run phase is over, after any warm-up.
+static void start_stint(sim_t *s, cpu_t *c, pcb_t *p, uint64_t t) {
+    uint64_t run = stint_len(s, c, p);
+    c->warmup = migration_cost(s, c, p);
+    event_t ev_end = make_event(c, stint_kind(p, run), p, t + c->warmup + run);
+    c->end_ev = event_tree_insert(&s->events, &ev_end);
+    p->time_slice = run;
+    c->last_dispatch = t;
+}
+
+// Charge the ran ns of p's stint on c and put p back on the queue. The
+// warm-up counts as CPU time but not as progress.
+static void end_stint(sim_t *s, cpu_t *c, pcb_t *p, uint64_t ran) {
+    uint64_t work = ran > c->warmup ? ran - c->warmup : 0;
+    p->remain -= (int64_t)work;
+    p->phase_left -= work;
+    s->pol->tick(c->rq, p, ran, cpu_extern_weight(&s->cpu, c));
+    cpu_release(&s->cpu, c, ran);
+}
+
+// Give idle CPU c its next task, if there is one.
+static bool dispatch_idle_cpu(sim_t *s, cpu_t *c, uint64_t t) {
+    pcb_t *p = pick_next_for(s, c, t);
+    if (!p) return false;
+    c = cpu_affine_idle(&s->cpu, p, c);
+    cpu_dispatch_on(&s->cpu, c, p, t);
+    s->pol->dequeue(c->rq, p);
+    #ifdef SHOW_PRINT
+        printf("Assigned process with PID=%u to CPU %u\n", p->pid, c->cpu_id);
+    #else
+        trace_event(s->trace, TRACE_ASSIGN, t, p->pid, c->cpu_id);
+    #endif
+    metrics_dispatch(s->metrics, p, t);
+    start_stint(s, c, p, t);
+    return true;
+}
+
+// Hand queued work to idle CPUs, least used first. Returns the number dispatched.
+static int dispatch_idle_cpus(sim_t *s, uint64_t t) {
+    int dispatched = 0;
+    // Under affinity a woken task may be queued on an idle CPU that is not the
+    // least used one: such CPUs run their own queue before anyone pulls from it.
+    if (s->cpu.per_cpu_rq && s->cpu.affinity) {
+        cpu_for_each_idle(&s->cpu, i) {
+            cpu_t *c = &s->cpu.cpu_list[i];
+            if (c->rq->nr_running && dispatch_idle_cpu(s, c, t)) dispatched++;
+        }
+    }
+    cpu_t *c;
+    while ((c = cpu_peek(&s->cpu)) && dispatch_idle_cpu(s, c, t)) dispatched++;
+    return dispatched;
+}
+
+/*
+ * New load at t: the stint on c gets the length its slice has now. If it
+ * has already run that long it stops, otherwise its end event moves.
+ */
+static void reslice_cpu(sim_t *s, cpu_t *c, uint64_t t) {
+    pcb_t *p = c->running_process;
+    uint64_t new_timeslice = stint_len(s, c, p);
+    uint64_t run_for = t - c->last_dispatch;
+    if (run_for >= c->warmup + new_timeslice) {
+        event_cancel(&s->events, c->end_ev);
+        c->end_ev = NULL;
+        end_stint(s, c, p, run_for);
+        if (p->remain <= 0) {
+            s->pol->dequeue(c->rq, p);
+        }
+        c->running_process = NULL;
+
+        #ifdef SHOW_PRINT
+            printf("Expired time-slice of PID=%u in CPU %u due to new process arrival\n", p->pid, c->cpu_id);
+        #else
+            trace_event(s->trace, TRACE_STOP, t, p->pid, c->cpu_id);
+        #endif
+    }
+    else {
+        event_move(&s->events, c->end_ev, c->last_dispatch + c->warmup + new_timeslice);
+        // END and SLEEP rank alike in the queue, so this keeps its place.
+        c->end_ev->ev.ev = stint_kind(p, new_timeslice);
+        p->time_slice = new_timeslice;
+    }
+}
+
+/*
+ * Only stints whose slice actually changed with the load are touched. A
+ * stint stopping here puts its task back on the queue it took it from, so
+ * the total is the same for every CPU visited.
+ */
+static void reslice_cpus(sim_t *s, uint64_t t) {
+    if (s->cpu.per_cpu_rq) {
+        cpu_for_each_busy(&s->cpu, i) {
+            cpu_t *c = &s->cpu.cpu_list[i];
+            uint64_t total = slice_total(s, c);
+            if (total < c->slice_lo || total > c->slice_hi) reslice_cpu(s, c, t);
+        }
+        return;
+    }
+    cpu_t **stale;
+    int n = cpu_slice_stale(&s->cpu, s->rq.total_weight + s->cpu.total_weight_proc, &stale);
+    for (int i = 0; i < n; i++)
+        reslice_cpu(s, stale[i], t);
+}
+
+// Stop the task running on c and give c the next one.
+static void preempt_cpu(sim_t *s, cpu_t *c, uint64_t t) {
+    pcb_t *p1 = c->running_process;
+    event_cancel(&s->events, c->end_ev);
+    c->end_ev = NULL;
+    end_stint(s, c, p1, t - c->last_dispatch);
+    if (p1->remain <= 0) {
+        s->pol->dequeue(c->rq, p1);
+    }
+
+    pcb_t *p2 = pick_next_for(s, c, t);
+    #ifdef SHOW_PRINT
+        if (p2) printf("Preempt process PID=%u and entering process PID=%u to CPU %u\n",
+                       p1->pid, p2->pid, c->cpu_id);
+    #else
+        trace_event(s->trace, TRACE_STOP, t, p1->pid, c->cpu_id);
+    #endif
+    if (!p2) return;            // everything queued was waiting for a lock
+    cpu_dispatch_on(&s->cpu, c, p2, t);
+    s->pol->dequeue(c->rq, p2);
+    #ifndef SHOW_PRINT
+        trace_event(s->trace, TRACE_ASSIGN, t, p2->pid, c->cpu_id);
+    #endif
+    metrics_dispatch(s->metrics, p2, t);
+    start_stint(s, c, p2, t);
+}
+
+// Running task with the largest vruntime that may be preempted now, or NULL.
+static cpu_t *preempt_victim(sim_t *s, uint64_t t) {
+    if (!s->cpu.per_cpu_rq)
+        return cpu_preempt_victim(&s->cpu, t, s->params.tun.min_granularity);
+    cpu_t *best = NULL;
+    cpu_for_each_busy(&s->cpu, i) {
+        cpu_t *c = &s->cpu.cpu_list[i];
+        pcb_t *p = c->running_process;
+        // With per-CPU queues only a CPU with queued work can switch.
+        if (!s->pol->pick_next(c->rq)) continue;
+        if (t - c->last_dispatch >= s->params.tun.min_granularity &&
+            (!best || p->vruntime >= best->running_process->vruntime)) {
+            best = c;
+        }
+    }
+    return best;
+}
+
+/*
+ * PCBs only live from arrival to finish, so they come from a pool of slabs
+ * and go back to it when the task is done. Memory follows the number of
+ * tasks in flight, not the length of the trace.
+ */
+#define PCB_CHUNK 1024
+
+struct pcb_chunk {
+    struct pcb_chunk *next;
+    pcb_t             pcbs[PCB_CHUNK];
+};
+
+static pcb_t *pcb_alloc(pcb_pool *pool) {
+    if (!pool->free_list) {
+        struct pcb_chunk *ch = malloc(sizeof(*ch));
+        if (!ch) { perror("malloc"); exit(EXIT_FAILURE); }
+        ch->next = pool->chunks;
+        pool->chunks = ch;
+        for (int i = PCB_CHUNK - 1; i >= 0; i--) {
+            ch->pcbs[i].rq = (struct cfs_rq *)pool->free_list;
+            pool->free_list = &ch->pcbs[i];
+        }
+    }
+    pcb_t *p = pool->free_list;
+    pool->free_list = (pcb_t *)p->rq;
+    return p;
+}
+
+pcb_t *sim_pcb_alloc(sim_t *s) {
+    return pcb_alloc(&s->pool);
+}
+
+static void pcb_free(pcb_pool *pool, pcb_t *p) {
+    p->rq = (struct cfs_rq *)pool->free_list;
+    pool->free_list = p;
+}
+
+static void pcb_pool_destroy(pcb_pool *pool) {
+    while (pool->chunks) {
+        struct pcb_chunk *next = pool->chunks->next;
+        free(pool->chunks);
+        pool->chunks = next;
+    }
+    pool->free_list = NULL;
+}
+
+// Queue the arrival of the next task of the trace, if any.
+static void feed_arrival(sim_t *s) {
+    task_spec_t ts;
+    uint64_t seq;
+    if (s->set) {
+        if (s->next_task == s->set->num_tasks) return;
+        seq = s->next_task++;
+        ts = s->set->tasks[seq];
+    } else if (!workload_next(s->wl, &ts, &seq)) {
+        return;
+    }
+    pcb_t *p = pcb_alloc(&s->pool);
+    p->pid        = ts.pid;
+    p->vruntime   = 0;
+    p->weight     = cfs_compute_weight(ts.nice);
+    p->rq         = NULL;
+    p->on_rq      = false;
+    p->seq        = seq;
+    p->arrival    = ts.arrival;
+    p->remain     = (int64_t)ts.burst;
+    p->time_slice = 0;
+    p->burst      = ts.burst;
+    p->first_run  = UINT64_MAX;
+    p->nr_dispatch = 0;
+    p->nice       = ts.nice;
+    p->run        = ts.run;
+    p->block      = ts.block;
+    p->phase_left = ts.run ? min(ts.run, ts.burst) : ts.burst;
+    p->io_time    = 0;
+    p->lock       = ts.lock;
+    p->holds_lock = false;
+    p->wait_next  = NULL;
+    p->wake_time  = UINT64_MAX;
+    p->nr_wakeups = 0;
+    p->wake_sum   = 0;
+    p->wake_max   = 0;
+    p->last_cpu   = 0;
+    p->mig_cost   = 0;
+    p->group      = ts.group ? s->group_of[ts.group] : NULL;
+    p->my_q       = NULL;
+    if (p->group) p->group->nr_tasks++;
+    event_t ev = make_event(NULL, EVENT_ARRIVAL, p, ts.arrival);
+    event_tree_insert(&s->events, &ev);
+}
+
+// Place an arriving task at its queue's min_vruntime and queue it.
+static void enqueue_arrival(sim_t *s, pcb_t *p) {
+    struct cfs_rq *rq = cpu_select_rq(&s->cpu, p);
+    s->pol->enqueue(rq, p, false);
+}
+
+// Make a blocked task runnable. Its wakeup latency runs from t, or from the
+// earlier wakeup if it has not run since (it went on to wait for its lock).
+static void wake_task(sim_t *s, pcb_t *p, uint64_t t) {
+    struct cfs_rq *rq = cpu_select_rq(&s->cpu, p);
+    s->pol->enqueue(rq, p, true);
+    if (p->wake_time == UINT64_MAX) p->wake_time = t;
+}
+
+// Queue a task that arrives or wakes up at t. Returns true for a wakeup.
+static bool enter_task(sim_t *s, const event_t *ev, uint64_t t) {
+    if (ev->ev == EVENT_WAKEUP) {
+        wake_task(s, ev->proc, t);
+        #ifdef SHOW_PRINT
+            printf("Wakeup PID=%u\n", ev->proc->pid);
+        #else
+            trace_event(s->trace, TRACE_WAKEUP, t, ev->proc->pid, 0);
+        #endif
+        return true;
+    }
+    enqueue_arrival(s, ev->proc);
+    feed_arrival(s);
+    #ifdef SHOW_PRINT
+        printf("Enqueue PID=%u\n", ev->proc->pid);
+    #else
+        trace_event(s->trace, TRACE_ENQUEUE, t, ev->proc->pid, 0);
+    #endif
+    return false;
+}
+
+// p finished its run phase with work left: release its lock and sleep for p->block.
+static void sleep_task(sim_t *s, cpu_t *c, pcb_t *p, uint64_t t) {
+    s->pol->dequeue(c->rq, p);
+    lock_release(s, p, t);
+    p->phase_left = min(p->run, (uint64_t)p->remain);
+    p->io_time += p->block;
+    event_t ev = make_event(NULL, EVENT_WAKEUP, p, t + p->block);
+    event_tree_insert(&s->events, &ev);
+    #ifdef SHOW_PRINT
+        printf("Sleep PID=%u in CPU %u\n", p->pid, c->cpu_id);
+    #else
+        trace_event(s->trace, TRACE_SLEEP, t, p->pid, c->cpu_id);
+    #endif
+}
+
+// CPUs of the run, laid out by the topology if there is one.
+static void sim_cpus_init(sim_t *s, int num_cpu) {
+    cpu_topology topo;
+    if (s->params.topo.nodes) {
+        topo = s->params.topo;
+        if (topology_cpus(&topo) != (uint64_t)num_cpu) {
+            fprintf(stderr, "Error: topology has %llu CPUs, the run has %d\n",
+                    (unsigned long long)topology_cpus(&topo), num_cpu);
+            exit(EXIT_FAILURE);
+        }
+    } else {
+        topology_flat(&topo, (uint32_t)num_cpu);
+    }
+    cpu_init(&s->cpu, num_cpu, s->params.per_cpu_rq, &s->rq, s->pol, &s->params.tun,
+             &topo, s->params.affinity, s->trace);
+}
+
+// First checkpoint after the event at the head of the queue.
+static void next_checkpoint(sim_t *s) {
+    uint64_t every = s->params.checkpoint_every;
+    event_t next;
+    if (every && event_tree_peek(&s->events, &next))
+        s->next_checkpoint = (next.time / every + 1) * every;
+}
+
+// Between events: snapshot the run if the next one is due at or after the checkpoint.
+static void checkpoint(sim_t *s, uint64_t t, uint64_t done) {
+    event_t next;
+    if (!event_tree_peek(&s->events, &next) || next.time < s->next_checkpoint) return;
+    uint64_t at = next.time / s->params.checkpoint_every * s->params.checkpoint_every;
+    size_t len = strlen(s->params.checkpoint_path) + 24;
+    char *path = malloc(len);
+    if (!path) {
+        perror("malloc");
+        exit(EXIT_FAILURE);
+    }
+    snprintf(path, len, "%s.%llu", s->params.checkpoint_path, (unsigned long long)at);
+    snapshot_write(s, t, done, path);
+    free(path);
+    next_checkpoint(s);
+}
+
+// Run from t, the time of the last event handled, until num_process tasks are done.
+static void sim_loop(sim_t *s, uint64_t num_process, uint64_t t, uint64_t done) {
+    metrics_t *m = s->metrics;
+    if (s->params.sample_every)
+        sampler_open(&s->sampler, s->params.sample_path, s->params.sample_every, &s->cpu, t);
+    while (done < num_process) {
+        if (s->params.checkpoint_every) checkpoint(s, t, done);
+        event_t ev;
+        PROF_START(PH_POP);
+        bool popped = event_tree_pop(&s->events, &ev);
+        PROF_STOP(PH_POP);
+        if (!popped) break;
+        m->events++;
+        t = ev.time;
+        if (s->params.sample_every) sampler_advance(&s->sampler, t);
+
+        if (s->cpu.per_cpu_rq && t - s->cpu.last_balance >= LOAD_BALANCE_INTERVAL_NSEC) {
+            PROF_START(PH_BALANCE);
+            if (cpu_load_balance(&s->cpu, t) > 0) dispatch_idle_cpus(s, t);
+            PROF_STOP(PH_BALANCE);
+        }
+
+        #ifdef SHOW_PRINT
+            printf("================================================\n");
+            printf("Time stamp: %llu \n", (unsigned long long)t);
+        #endif
+
+        if (ev.ev == EVENT_ARRIVAL || ev.ev == EVENT_WAKEUP) {
+            // Step 1: Enqueue all process arriving or waking up now;
+            PROF_START(PH_ENTER);
+            int entering_proc = 0, woken = 0;
+            if (enter_task(s, &ev, t)) woken++; else entering_proc++;
+
+            event_t start_ev;
+            while (event_tree_peek(&s->events, &start_ev) && start_ev.time == t &&
+                   (start_ev.ev == EVENT_ARRIVAL || start_ev.ev == EVENT_WAKEUP)) {
+                event_tree_pop(&s->events, &start_ev);
+                if (enter_task(s, &start_ev, t)) woken++; else entering_proc++;
+            }
+            PROF_STOP(PH_ENTER);
+            //Step 2: Preempt some CPU that expired new timeslice:
+            PROF_START(PH_RESLICE);
+            reslice_cpus(s, t);
+            PROF_STOP(PH_RESLICE);
+            //Step 2: Try to assigned it to CPU
+            PROF_START(PH_DISPATCH);
+            int left = entering_proc + woken - dispatch_idle_cpus(s, t);
+            PROF_STOP(PH_DISPATCH);
+            if (left <= 0 || !s->pol->preemptive) continue;
+            PROF_START(PH_PREEMPT);
+            // Idle CPUs went to arrivals first; what is left over was woken.
+            woken = min(woken, left);
+            entering_proc = left - woken;
+
+            // Step 3: Try to assigned it by preempt other process in CPUs.
+            for (int idx = 1; idx <= entering_proc; idx++) {
+                PROF_START(PH_VICTIM);
+                cpu_t *c = preempt_victim(s, t);
+                PROF_STOP(PH_VICTIM);
+                if (c) preempt_cpu(s, c, t);
+            }
+            // A woken task only preempts a task it leads by the wakeup granularity.
+            for (int idx = 1; idx <= woken; idx++) {
+                PROF_START(PH_VICTIM);
+                cpu_t *c = preempt_victim(s, t);
+                PROF_STOP(PH_VICTIM);
+                pcb_t *next = c ? s->pol->pick_next(c->rq) : NULL;
+                if (!next || !s->pol->wakeup_preempt(c->rq, c->running_process, next)) break;
+                preempt_cpu(s, c, t);
+            }
+            PROF_STOP(PH_PREEMPT);
+        } else if (ev.ev == EVENT_END || ev.ev == EVENT_SLEEP) {
+            cpu_t *c = ev.cpu;
+            pcb_t *p = ev.proc;
+            if (c->running_process != p) continue;
+            c->end_ev = NULL;   // this is the event just popped
+            PROF_START(PH_END);
+
+            end_stint(s, c, p, t - c->last_dispatch);
+
+            if (p->remain == 0) {
+                s->pol->dequeue(c->rq, p);
+                lock_release(s, p, t);
+                done++;
+                #ifdef SHOW_PRINT
+                    printf("Finish PID=%u\n", p->pid);
+                #else
+                    trace_event(s->trace, TRACE_FINISH, t, p->pid, c->cpu_id);
+                #endif
+                metrics_finish(m, p, t);
+                pcb_free(&s->pool, p);
+            }
+            else if (p->phase_left == 0) {
+                sleep_task(s, c, p, t);
+            }
+            else {
+                #ifdef SHOW_PRINT
+                    printf("Expired time-slice of PID=%u in CPU %u\n", p->pid, c->cpu_id);
+                #else
+                    trace_event(s->trace, TRACE_STOP, t, p->pid, c->cpu_id);
+                #endif
+
+            }
+
+            // A shared queue feeds the least-used (or, with affinity, the
+            // nearest) idle CPU; a per-CPU queue feeds c.
+            cpu_t *c2 = s->cpu.per_cpu_rq ? c : cpu_peek(&s->cpu);
+            pcb_t *next2 = pick_next_for(s, c2, t);
+            if (next2) {
+                c2 = cpu_affine_idle(&s->cpu, next2, c2);
+                cpu_dispatch_on(&s->cpu, c2, next2, t);
+                s->pol->dequeue(c2->rq, next2);
+                start_stint(s, c2, next2, t);
+                #ifdef SHOW_PRINT
+                    printf("Assigned process with PID=%u to CPU %u\n", next2->pid, c2->cpu_id);
+                #else
+                    trace_event(s->trace, TRACE_ASSIGN, t, next2->pid, c2->cpu_id);
+                #endif
+                metrics_dispatch(m, next2, t);
+            }
+            PROF_STOP(PH_END);
+        }
+    }
+    #ifdef SHOW_PRINT
+        printf("================================================\n");
+        printf("All done at Time stamp = %llu\n", (unsigned long long)t);
+    #else
+        trace_event(s->trace, TRACE_DONE, t, 0, 0);
+    #endif
+    if (s->cpu.per_cpu_rq) {
+        trace_event(s->trace, TRACE_MIGRATIONS, s->cpu.nr_migrations, 0, 0);
+    }
+
+    if (s->params.sample_every) sampler_close(&s->sampler, t);
+    metrics_end(m, &s->cpu, t);
+    metrics_groups(m, s->groups, s->nr_groups);
+    cpu_destroy(&s->cpu);
+}
+void sim_params_default(sim_params *p) {
+    p->policy = &cfs_policy;
+    p->tun.sched_latency   = SCHED_LATENCY_NSEC;
+    p->tun.min_granularity = MIN_GRANULARITY_NSEC;
+    p->tun.wakeup_granularity = WAKEUP_GRANULARITY_NSEC;
+    p->tun.quantum = MLQ_QUANTUM_NSEC;
+    p->per_cpu_rq = false;
+    p->evq = EVQ_WHEEL;
+    p->num_cpu = 0;
+    p->topo = (cpu_topology){ 0, 0, 0, 0 };
+    memset(p->migration_cost, 0, sizeof(p->migration_cost));
+    p->affinity = false;
+    p->checkpoint_every = 0;
+    p->checkpoint_path = NULL;
+    p->sample_every = 0;
+    p->sample_path = NULL;
+}
+
+void sim_init(sim_t *s, const sim_params *p, trace_t *trace, metrics_t *m) {
+    memset(s, 0, sizeof(*s));
+    s->params = *p;
+    s->pol = p->policy;
+    s->trace = trace;
+    s->metrics = m;
+    s->pol->init_rq(&s->rq, &s->params.tun);
+    event_tree_init(&s->events, s->params.evq);
+    s->next_checkpoint = s->params.checkpoint_every;
+}
+
+void sim_destroy(sim_t *s) {
+    event_tree_destroy(&s->events);
+    pcb_pool_destroy(&s->pool);
+    free(s->locks);
+    s->locks = NULL;
+    s->nr_locks = 0;
+    for (uint32_t i = 0; i < s->nr_groups; i++)
+        cfs_group_destroy(&s->groups[i]);
+    free(s->groups);
+    free(s->group_of);
+    s->groups = NULL;
+    s->group_of = NULL;
+    s->nr_groups = 0;
+    s->pol->destroy_rq(&s->rq);
+}
+
+// The workload defines parents before children, so one pass links them up.
+static void sim_groups_init(sim_t *s, const workload_group *g, uint32_t n) {
+    if (n == 0) return;
+    if (s->params.per_cpu_rq) {
+        fprintf(stderr, "Error: task groups need the shared run queue (no --per-cpu)\n");
+        exit(EXIT_FAILURE);
+    }
+    if (!s->pol->groups) {
+        fprintf(stderr, "Error: the %s policy does not support task groups\n", s->pol->name);
+        exit(EXIT_FAILURE);
+    }
+    uint32_t max_id = 0;
+    for (uint32_t i = 0; i < n; i++)
+        if (g[i].id > max_id) max_id = g[i].id;
+    s->groups = malloc(n * sizeof(*s->groups));
+    s->group_of = calloc((size_t)max_id + 1, sizeof(*s->group_of));
+    if (!s->groups || !s->group_of) {
+        perror("malloc");
+        exit(EXIT_FAILURE);
+    }
+    for (uint32_t i = 0; i < n; i++) {
+        struct task_group *tg = &s->groups[i];
+        cfs_group_init(tg, g[i].id, g[i].shares,
+                       g[i].parent ? s->group_of[g[i].parent] : NULL, &s->rq);
+        s->group_of[g[i].id] = tg;
+    }
+    s->nr_groups = n;
+}
+
+// CPU count of the run: --cpus, else the topology's, else the workload's.
+static int run_cpus(const sim_t *s, uint32_t wl_cpus) {
+    if (s->params.num_cpu) return (int)s->params.num_cpu;
+    if (s->params.topo.nodes) return (int)topology_cpus(&s->params.topo);
+    return (int)wl_cpus;
+}
+
+void sim_run(sim_t *s, workload_t *wl) {
+    s->wl = wl;
+    sim_groups_init(s, wl->groups, wl->num_groups);
+    sim_cpus_init(s, run_cpus(s, wl->num_cpu));
+    // Arrivals are fed into the event queue one at a time
+    feed_arrival(s);
+    sim_loop(s, wl->num_tasks, 0, 0);
+}
+
+void sim_run_set(sim_t *s, const workload_set *set) {
+    s->set = set;
+    s->next_task = 0;
+    sim_groups_init(s, set->groups, set->num_groups);
+    sim_cpus_init(s, run_cpus(s, set->num_cpu));
+    feed_arrival(s);
+    sim_loop(s, set->num_tasks, 0, 0);
+}
+
+// Rebuild the state of snap over the groups of its workload. Returns the
+// number of tasks the run had read from the workload.
+static uint64_t resume_state(sim_t *s, const sim_snapshot *snap, uint64_t num_tasks,
+                             const workload_group *g, uint32_t ng, uint64_t *t, uint64_t *done) {
+    if (snap->hdr.wl_tasks != num_tasks || snap->hdr.nr_groups != ng) {
+        fprintf(stderr, "Error: the snapshot was not taken with this workload\n");
+        exit(EXIT_FAILURE);
+    }
+    sim_groups_init(s, g, ng);
+    sim_cpus_init(s, (int)snap->hdr.num_cpu);
+    snapshot_apply(snap, s, t, done);
+    next_checkpoint(s);
+    return snap->hdr.fed;
+}
+
+// The workload must also agree on the last task the snapshot's run had read.
+static void resume_check(const sim_snapshot *snap, uint64_t last_arrival) {
+    if (snap->hdr.fed && last_arrival != snap->hdr.last_arrival) {
+        fprintf(stderr, "Error: the snapshot was not taken with this workload\n");
+        exit(EXIT_FAILURE);
+    }
+}
+
+void sim_resume(sim_t *s, workload_t *wl, const sim_snapshot *snap) {
+    uint64_t t, done;
+    s->wl = wl;
+    uint64_t fed = resume_state(s, snap, wl->num_tasks, wl->groups, wl->num_groups, &t, &done);
+    task_spec_t ts;
+    uint64_t seq;
+    for (uint64_t i = 0; i < fed; i++)
+        workload_next(wl, &ts, &seq);
+    resume_check(snap, wl->last_arrival);
+    sim_loop(s, wl->num_tasks, t, done);
+}
+
+void sim_resume_set(sim_t *s, const workload_set *set, const sim_snapshot *snap) {
+    uint64_t t, done;
+    s->set = set;
+    s->next_task = resume_state(s, snap, set->num_tasks, set->groups, set->num_groups, &t, &done);
+    resume_check(snap, s->next_task ? set->tasks[s->next_task - 1].arrival : 0);
+    sim_loop(s, set->num_tasks, t, done);
+}
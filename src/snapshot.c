@@ -0,0 +1,657 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "snapshot.h"
+
+static void *xmalloc(size_t n) {
+    void *p = malloc(n ? n : 1);
+    if (!p) {
+        perror("malloc");
+        exit(EXIT_FAILURE);
+    }
+    return p;
+}
+
+static void put(FILE *f, const void *buf, size_t size) {
+    if (size && fwrite(buf, size, 1, f) != 1) {
+        perror("fwrite");
+        exit(EXIT_FAILURE);
+    }
+}
+
+static void get(FILE *f, void *buf, size_t size, const char *path) {
+    if (size && fread(buf, size, 1, f) != 1) {
+        fprintf(stderr, "Error: snapshot %s is truncated\n", path);
+        exit(EXIT_FAILURE);
+    }
+}
+
+/* ---- queue references ---- */
+
+static uint32_t rq_ref(const sim_t *s, const struct cfs_rq *rq) {
+    if (!rq) return SNAPSHOT_NONE;
+    if (rq == &s->rq) return 0;
+    if (rq->tg) return SNAPSHOT_GROUP_RQ | (uint32_t)(rq->tg - s->groups);
+    return 1 + (uint32_t)(rq - s->cpu.rqs);
+}
+
+static struct cfs_rq *rq_deref(sim_t *s, uint32_t ref) {
+    if (ref == SNAPSHOT_NONE) return NULL;
+    if (ref == 0) return &s->rq;
+    if (ref & SNAPSHOT_GROUP_RQ) return &s->groups[ref & ~SNAPSHOT_GROUP_RQ].rq;
+    return &s->cpu.rqs[ref - 1];
+}
+
+/* ---- writing ---- */
+
+/*
+ * Tasks in flight get indices in the order they are first met: queued ones
+ * queue by queue, then running ones, then those only an event or a lock
+ * knows about. An open-addressing map from PCB address finds the ones
+ * already numbered.
+ */
+typedef struct {
+    pcb_t   **keys;
+    uint32_t *vals;
+    size_t    mask;
+    pcb_t   **tasks;        // by index
+    uint32_t *queue;        // root queue reference of each, SNAPSHOT_NONE if not queued
+    uint32_t  n;
+    size_t    cap;
+    uint32_t  walk_queue;   // queue being walked
+} task_index;
+
+static size_t ptr_hash(const pcb_t *p, size_t mask) {
+    return (size_t)(((uintptr_t)p >> 4) * 0x9E3779B97F4A7C15ULL) & mask;
+}
+
+static void index_grow(task_index *ix) {
+    size_t slots = (ix->mask + 1) * 2;
+    pcb_t **keys = calloc(slots, sizeof(*keys));
+    uint32_t *vals = xmalloc(slots * sizeof(*vals));
+    if (!keys) {
+        perror("calloc");
+        exit(EXIT_FAILURE);
+    }
+    for (size_t i = 0; i <= ix->mask; i++) {
+        if (!ix->keys[i]) continue;
+        size_t h = ptr_hash(ix->keys[i], slots - 1);
+        while (keys[h]) h = (h + 1) & (slots - 1);
+        keys[h] = ix->keys[i];
+        vals[h] = ix->vals[i];
+    }
+    free(ix->keys);
+    free(ix->vals);
+    ix->keys = keys;
+    ix->vals = vals;
+    ix->mask = slots - 1;
+}
+
+static uint32_t index_of(task_index *ix, pcb_t *p, uint32_t queue) {
+    size_t h = ptr_hash(p, ix->mask);
+    for (; ix->keys[h]; h = (h + 1) & ix->mask)
+        if (ix->keys[h] == p) return ix->vals[h];
+    if (ix->n == ix->cap) {
+        ix->cap *= 2;
+        ix->tasks = realloc(ix->tasks, ix->cap * sizeof(*ix->tasks));
+        ix->queue = realloc(ix->queue, ix->cap * sizeof(*ix->queue));
+        if (!ix->tasks || !ix->queue) {
+            perror("realloc");
+            exit(EXIT_FAILURE);
+        }
+    }
+    ix->keys[h] = p;
+    ix->vals[h] = ix->n;
+    ix->tasks[ix->n] = p;
+    ix->queue[ix->n] = queue;
+    if ((size_t)++ix->n * 2 > ix->mask + 1) index_grow(ix);
+    return ix->n - 1;
+}
+
+static void add_queued(pcb_t *p, void *arg) {
+    task_index *ix = arg;
+    index_of(ix, p, ix->walk_queue);
+}
+
+typedef struct {
+    task_index     *ix;
+    snapshot_event *events;
+    size_t          n;
+} event_list;
+
+static void add_event(const event_t *ev, void *arg) {
+    event_list *el = arg;
+    snapshot_event *e = &el->events[el->n++];
+    e->time = ev->time;
+    e->type = ev->ev;
+    e->task = index_of(el->ix, ev->proc, SNAPSHOT_NONE);
+    e->cpu = ev->cpu ? ev->cpu->cpu_id - 1 : SNAPSHOT_NONE;
+    e->reserved = 0;
+}
+
+static void task_record(const sim_t *s, const pcb_t *p, uint32_t queue, snapshot_task *r) {
+    memset(r, 0, sizeof(*r));
+    r->seq = p->seq;
+    r->arrival = p->arrival;
+    r->vruntime = p->vruntime;
+    r->remain = p->remain;
+    r->time_slice = p->time_slice;
+    r->burst = p->burst;
+    r->first_run = p->first_run;
+    r->run = p->run;
+    r->block = p->block;
+    r->phase_left = p->phase_left;
+    r->io_time = p->io_time;
+    r->wake_time = p->wake_time;
+    r->wake_sum = p->wake_sum;
+    r->wake_max = p->wake_max;
+    r->mig_cost = p->mig_cost;
+    r->pid = p->pid;
+    r->weight = p->weight;
+    r->nice = p->nice;
+    r->lock = p->lock;
+    r->nr_dispatch = p->nr_dispatch;
+    r->nr_wakeups = p->nr_wakeups;
+    r->last_cpu = p->last_cpu;
+    r->group = p->group ? p->group->id : 0;
+    r->rq = rq_ref(s, p->rq);
+    r->queue = queue;
+    r->holds_lock = p->holds_lock;
+}
+
+static void put_hist(FILE *f, const histogram_t *h) {
+    snapshot_hist sh = { h->count, h->max, h->sum, 0, 0 };
+    for (size_t i = 0; i < HIST_BUCKETS; i++) sh.nr_buckets += h->buckets[i] != 0;
+    put(f, &sh, sizeof(sh));
+    for (size_t i = 0; i < HIST_BUCKETS; i++) {
+        if (!h->buckets[i]) continue;
+        snapshot_bucket b = { (uint32_t)i, 0, h->buckets[i] };
+        put(f, &b, sizeof(b));
+    }
+}
+
+static void put_metrics(FILE *f, const metrics_t *m) {
+    snapshot_metrics sm;
+    memset(&sm, 0, sizeof(sm));
+    sm.lock_waits = m->lock_waits;
+    sm.tasks = m->tasks;
+    sm.events = m->events;
+    sm.context_switches = m->context_switches;
+    memcpy(sm.dispatch_distance, m->dispatch_distance, sizeof(sm.dispatch_distance));
+    sm.migration_cost = m->migration_cost;
+    sm.fair_sum = m->fair_sum;
+    sm.fair_sum_sq = m->fair_sum_sq;
+    for (int i = 0; i < 40; i++)
+        if (m->wakeup_by_nice[i]) sm.nice_mask |= 1ULL << i;
+    put(f, &sm, sizeof(sm));
+    put_hist(f, &m->response);
+    put_hist(f, &m->waiting);
+    put_hist(f, &m->turnaround);
+    put_hist(f, &m->wakeup);
+    for (int i = 0; i < 40; i++)
+        if (m->wakeup_by_nice[i]) put_hist(f, m->wakeup_by_nice[i]);
+}
+
+void snapshot_write(sim_t *s, uint64_t t, uint64_t done, const char *path) {
+    cpu_manager *cm = &s->cpu;
+    task_index ix = { .mask = 1023, .cap = 1024 };
+    ix.keys = calloc(ix.mask + 1, sizeof(*ix.keys));
+    ix.vals = xmalloc((ix.mask + 1) * sizeof(*ix.vals));
+    ix.tasks = xmalloc(ix.cap * sizeof(*ix.tasks));
+    ix.queue = xmalloc(ix.cap * sizeof(*ix.queue));
+    if (!ix.keys) {
+        perror("calloc");
+        exit(EXIT_FAILURE);
+    }
+
+    // Queued tasks first, so restoring can refill the queues in order.
+    ix.walk_queue = 0;
+    s->pol->for_each(&s->rq, add_queued, &ix);
+    for (int i = 0; cm->per_cpu_rq && i < cm->n; i++) {
+        ix.walk_queue = 1 + (uint32_t)i;
+        s->pol->for_each(&cm->rqs[i], add_queued, &ix);
+    }
+
+    snapshot_cpu *cpus = xmalloc((size_t)cm->n * sizeof(*cpus));
+    uint32_t young = 0;
+    for (int i = 0; i < cm->n; i++) {
+        cpu_t *c = &cm->cpu_list[i];
+        cpus[i] = (snapshot_cpu){ c->running_time, c->last_dispatch, c->warmup, c->slice_lo,
+                                  c->slice_hi, c->victim_vruntime, SNAPSHOT_NONE, SNAPSHOT_NONE };
+        if (c->running_process)
+            cpus[i].task = index_of(&ix, c->running_process, SNAPSHOT_NONE);
+    }
+    for (cpu_t *c = cm->young_head; c; c = c->young_next)
+        cpus[c->cpu_id - 1].young = young++;
+
+    event_list el = { &ix, xmalloc(s->events.count * sizeof(snapshot_event)), 0 };
+    event_tree_walk(&s->events, add_event, &el);
+
+    uint32_t nr_lock_recs = 0;
+    for (uint32_t i = 0; i < s->nr_locks; i++) {
+        const sim_lock *l = &s->locks[i];
+        if (!l->owner && !l->wait_head) continue;
+        nr_lock_recs++;
+        if (l->owner) index_of(&ix, l->owner, SNAPSHOT_NONE);
+        for (pcb_t *w = l->wait_head; w; w = w->wait_next)
+            index_of(&ix, w, SNAPSHOT_NONE);
+    }
+
+    FILE *f = fopen(path, "wb");
+    if (!f) {
+        perror("fopen");
+        exit(EXIT_FAILURE);
+    }
+    snapshot_header h;
+    memset(&h, 0, sizeof(h));
+    memcpy(h.magic, SNAPSHOT_MAGIC, sizeof(SNAPSHOT_MAGIC));
+    h.version = SNAPSHOT_VERSION;
+    h.num_cpu = (uint32_t)cm->n;
+    strncpy(h.policy, s->pol->name, sizeof(h.policy) - 1);
+    h.tun = s->params.tun;
+    memcpy(h.migration_cost, s->params.migration_cost, sizeof(h.migration_cost));
+    h.topo = cm->topo;
+    h.per_cpu_rq = cm->per_cpu_rq;
+    h.affinity = cm->affinity;
+    h.time = t;
+    h.done = done;
+    h.fed = s->set ? s->next_task : s->wl->emitted;
+    h.wl_tasks = s->set ? s->set->num_tasks : s->wl->num_tasks;
+    if (h.fed) h.last_arrival = s->set ? s->set->tasks[h.fed - 1].arrival : s->wl->last_arrival;
+    h.nr_tasks = ix.n;
+    h.nr_events = el.n;
+    h.nr_groups = s->nr_groups;
+    h.nr_queues = 1 + (cm->per_cpu_rq ? (uint32_t)cm->n : 0);
+    h.nr_locks = s->nr_locks;
+    h.nr_lock_recs = nr_lock_recs;
+    h.nr_migrations = cm->nr_migrations;
+    h.last_balance = cm->last_balance;
+    put(f, &h, sizeof(h));
+    put(f, cpus, (size_t)cm->n * sizeof(*cpus));
+
+    for (uint32_t i = 0; i < s->nr_groups; i++) {
+        const struct task_group *tg = &s->groups[i];
+        snapshot_group g = { tg->se.vruntime, tg->rq.min_vruntime, tg->cpu_time,
+                             tg->nr_tasks, tg->placed, 0 };
+        put(f, &g, sizeof(g));
+    }
+    put(f, &s->rq.min_vruntime, sizeof(uint64_t));
+    for (int i = 0; cm->per_cpu_rq && i < cm->n; i++)
+        put(f, &cm->rqs[i].min_vruntime, sizeof(uint64_t));
+
+    for (uint32_t i = 0; i < ix.n; i++) {
+        snapshot_task r;
+        task_record(s, ix.tasks[i], ix.queue[i], &r);
+        put(f, &r, sizeof(r));
+    }
+    put(f, el.events, el.n * sizeof(snapshot_event));
+
+    for (uint32_t i = 0; i < s->nr_locks; i++) {
+        const sim_lock *l = &s->locks[i];
+        if (!l->owner && !l->wait_head) continue;
+        snapshot_lock r = { i, l->owner ? index_of(&ix, l->owner, SNAPSHOT_NONE) : SNAPSHOT_NONE, 0, 0 };
+        for (pcb_t *w = l->wait_head; w; w = w->wait_next) r.nr_waiters++;
+        put(f, &r, sizeof(r));
+        for (pcb_t *w = l->wait_head; w; w = w->wait_next) {
+            uint32_t k = index_of(&ix, w, SNAPSHOT_NONE);
+            put(f, &k, sizeof(k));
+        }
+    }
+    put_metrics(f, s->metrics);
+
+    if (fclose(f) != 0) {
+        perror("fclose");
+        exit(EXIT_FAILURE);
+    }
+    free(el.events);
+    free(cpus);
+    free(ix.keys);
+    free(ix.vals);
+    free(ix.tasks);
+    free(ix.queue);
+}
+
+/* ---- loading ---- */
+
+static void get_hist(FILE *f, histogram_t *h, const char *path) {
+    snapshot_hist sh;
+    get(f, &sh, sizeof(sh), path);
+    memset(h, 0, sizeof(*h));
+    h->count = sh.count;
+    h->max = sh.max;
+    h->sum = sh.sum;
+    for (uint32_t i = 0; i < sh.nr_buckets; i++) {
+        snapshot_bucket b;
+        get(f, &b, sizeof(b), path);
+        if (b.index >= HIST_BUCKETS) {
+            fprintf(stderr, "Error: snapshot %s is corrupt\n", path);
+            exit(EXIT_FAILURE);
+        }
+        h->buckets[b.index] = b.n;
+    }
+}
+
+static void get_metrics(FILE *f, metrics_t *m, const char *path) {
+    snapshot_metrics sm;
+    get(f, &sm, sizeof(sm), path);
+    metrics_init(m, NULL);
+    m->lock_waits = sm.lock_waits;
+    m->tasks = sm.tasks;
+    m->events = sm.events;
+    m->context_switches = sm.context_switches;
+    memcpy(m->dispatch_distance, sm.dispatch_distance, sizeof(m->dispatch_distance));
+    m->migration_cost = sm.migration_cost;
+    m->fair_sum = sm.fair_sum;
+    m->fair_sum_sq = sm.fair_sum_sq;
+    get_hist(f, &m->response, path);
+    get_hist(f, &m->waiting, path);
+    get_hist(f, &m->turnaround, path);
+    get_hist(f, &m->wakeup, path);
+    for (int i = 0; i < 40; i++) {
+        if (!(sm.nice_mask >> i & 1)) continue;
+        m->wakeup_by_nice[i] = xmalloc(sizeof(histogram_t));
+        get_hist(f, m->wakeup_by_nice[i], path);
+    }
+}
+
+// A queue reference the header allows: none, the shared queue, a group's
+// (checked against the workload on restore) or, with per-CPU queues, a CPU's.
+static bool rq_ref_valid(const snapshot_header *h, uint32_t ref) {
+    if (ref == SNAPSHOT_NONE || ref == 0) return true;
+    if (ref & SNAPSHOT_GROUP_RQ) return (ref & ~SNAPSHOT_GROUP_RQ) < h->nr_groups;
+    return h->per_cpu_rq && ref <= h->num_cpu;
+}
+
+static bool task_valid(const snapshot_header *h, uint32_t task) {
+    return task < h->nr_tasks;
+}
+
+// Every index in the file within its table, so restoring cannot go out of
+// bounds. Young CPUs must be ranked 0..n-1, each once, and be running.
+static bool snapshot_valid(const sim_snapshot *snap, size_t nr_waiters) {
+    const snapshot_header *h = &snap->hdr;
+    for (uint64_t i = 0; i < h->nr_tasks; i++)
+        if (!rq_ref_valid(h, snap->tasks[i].queue) || !rq_ref_valid(h, snap->tasks[i].rq))
+            return false;
+    for (uint64_t i = 0; i < h->nr_events; i++) {
+        const snapshot_event *e = &snap->events[i];
+        if (!task_valid(h, e->task) || (e->cpu != SNAPSHOT_NONE && e->cpu >= h->num_cpu))
+            return false;
+    }
+    for (uint32_t i = 0; i < h->nr_lock_recs; i++)
+        if (snap->locks[i].owner != SNAPSHOT_NONE && !task_valid(h, snap->locks[i].owner))
+            return false;
+    for (size_t i = 0; i < nr_waiters; i++)
+        if (!task_valid(h, snap->waiters[i])) return false;
+
+    bool *ranked = calloc(h->num_cpu, sizeof(*ranked));
+    if (!ranked) {
+        perror("calloc");
+        exit(EXIT_FAILURE);
+    }
+    uint32_t nr_young = 0;
+    bool ok = true;
+    for (uint32_t i = 0; ok && i < h->num_cpu; i++) {
+        const snapshot_cpu *c = &snap->cpus[i];
+        if (c->task != SNAPSHOT_NONE && !task_valid(h, c->task)) {
+            ok = false;
+        } else if (c->young != SNAPSHOT_NONE) {
+            if (c->task == SNAPSHOT_NONE || c->young >= h->num_cpu || ranked[c->young]) {
+                ok = false;
+            } else {
+                ranked[c->young] = true;
+                nr_young++;
+            }
+        }
+    }
+    for (uint32_t k = 0; ok && k < nr_young; k++)
+        if (!ranked[k]) ok = false;
+    free(ranked);
+    return ok;
+}
+
+void snapshot_load(sim_snapshot *snap, const char *path) {
+    FILE *f = fopen(path, "rb");
+    if (!f) {
+        perror("fopen");
+        exit(EXIT_FAILURE);
+    }
+    snapshot_header *h = &snap->hdr;
+    get(f, h, sizeof(*h), path);
+    if (memcmp(h->magic, SNAPSHOT_MAGIC, sizeof(SNAPSHOT_MAGIC)) != 0
+        || h->version != SNAPSHOT_VERSION) {
+        fprintf(stderr, "Error: %s is not a version %d snapshot\n", path, SNAPSHOT_VERSION);
+        exit(EXIT_FAILURE);
+    }
+    h->policy[sizeof(h->policy) - 1] = '\0';
+    if (!policy_find(h->policy) || h->num_cpu == 0 || h->num_cpu > MAX_CPU
+        || h->nr_queues != 1 + (h->per_cpu_rq ? h->num_cpu : 0)) {
+        fprintf(stderr, "Error: snapshot %s is corrupt\n", path);
+        exit(EXIT_FAILURE);
+    }
+
+    snap->cpus = xmalloc(h->num_cpu * sizeof(*snap->cpus));
+    snap->groups = xmalloc(h->nr_groups * sizeof(*snap->groups));
+    snap->min_vruntime = xmalloc(h->nr_queues * sizeof(uint64_t));
+    snap->tasks = xmalloc(h->nr_tasks * sizeof(*snap->tasks));
+    snap->events = xmalloc(h->nr_events * sizeof(*snap->events));
+    snap->locks = xmalloc(h->nr_lock_recs * sizeof(*snap->locks));
+    get(f, snap->cpus, h->num_cpu * sizeof(*snap->cpus), path);
+    get(f, snap->groups, h->nr_groups * sizeof(*snap->groups), path);
+    get(f, snap->min_vruntime, h->nr_queues * sizeof(uint64_t), path);
+    get(f, snap->tasks, h->nr_tasks * sizeof(*snap->tasks), path);
+    get(f, snap->events, h->nr_events * sizeof(*snap->events), path);
+
+    // Waiters follow their lock in the file; keep them in one array.
+    size_t nw = 0, capw = 16;
+    snap->waiters = xmalloc(capw * sizeof(uint32_t));
+    for (uint32_t i = 0; i < h->nr_lock_recs; i++) {
+        snapshot_lock *l = &snap->locks[i];
+        get(f, l, sizeof(*l), path);
+        if (l->id >= h->nr_locks) {
+            fprintf(stderr, "Error: snapshot %s is corrupt\n", path);
+            exit(EXIT_FAILURE);
+        }
+        if (nw + l->nr_waiters > capw) {
+            while (nw + l->nr_waiters > capw) capw *= 2;
+            snap->waiters = realloc(snap->waiters, capw * sizeof(uint32_t));
+            if (!snap->waiters) {
+                perror("realloc");
+                exit(EXIT_FAILURE);
+            }
+        }
+        get(f, snap->waiters + nw, l->nr_waiters * sizeof(uint32_t), path);
+        nw += l->nr_waiters;
+    }
+    get_metrics(f, &snap->metrics, path);
+    fclose(f);
+    if (!snapshot_valid(snap, nw)) {
+        fprintf(stderr, "Error: snapshot %s is corrupt\n", path);
+        exit(EXIT_FAILURE);
+    }
+}
+
+void snapshot_free(sim_snapshot *snap) {
+    free(snap->cpus);
+    free(snap->groups);
+    free(snap->min_vruntime);
+    free(snap->tasks);
+    free(snap->events);
+    free(snap->locks);
+    free(snap->waiters);
+    metrics_destroy(&snap->metrics);
+    memset(snap, 0, sizeof(*snap));
+}
+
+void snapshot_params(const sim_snapshot *snap, sim_params *p) {
+    const snapshot_header *h = &snap->hdr;
+    p->policy = policy_find(h->policy);
+    p->num_cpu = h->num_cpu;
+    p->per_cpu_rq = h->per_cpu_rq;
+    p->topo = h->topo;
+    p->tun = h->tun;
+    memcpy(p->migration_cost, h->migration_cost, sizeof(p->migration_cost));
+    p->affinity = h->affinity;
+}
+
+/* ---- restoring ---- */
+
+static void restore_task(sim_t *s, pcb_t *p, const snapshot_task *r) {
+    memset(p, 0, sizeof(*p));
+    p->pid = r->pid;
+    p->vruntime = r->vruntime;
+    p->weight = r->weight;
+    p->rq = rq_deref(s, r->rq);
+    p->seq = r->seq;
+    p->arrival = r->arrival;
+    p->remain = r->remain;
+    p->time_slice = r->time_slice;
+    p->burst = r->burst;
+    p->first_run = r->first_run;
+    p->nr_dispatch = r->nr_dispatch;
+    p->nice = r->nice;
+    p->group = r->group ? s->group_of[r->group] : NULL;
+    p->run = r->run;
+    p->block = r->block;
+    p->phase_left = r->phase_left;
+    p->io_time = r->io_time;
+    p->lock = r->lock;
+    p->holds_lock = r->holds_lock;
+    p->wake_time = r->wake_time;
+    p->nr_wakeups = r->nr_wakeups;
+    p->wake_sum = r->wake_sum;
+    p->wake_max = r->wake_max;
+    p->last_cpu = r->last_cpu;
+    p->mig_cost = r->mig_cost;
+}
+
+static void restore_metrics(metrics_t *m, const metrics_t *src) {
+    m->lock_waits = src->lock_waits;
+    m->tasks = src->tasks;
+    m->events = src->events;
+    m->context_switches = src->context_switches;
+    memcpy(m->dispatch_distance, src->dispatch_distance, sizeof(m->dispatch_distance));
+    m->migration_cost = src->migration_cost;
+    m->fair_sum = src->fair_sum;
+    m->fair_sum_sq = src->fair_sum_sq;
+    m->response = src->response;
+    m->waiting = src->waiting;
+    m->turnaround = src->turnaround;
+    m->wakeup = src->wakeup;
+    for (int i = 0; i < 40; i++) {
+        if (!src->wakeup_by_nice[i]) continue;
+        if (!m->wakeup_by_nice[i]) m->wakeup_by_nice[i] = xmalloc(sizeof(histogram_t));
+        *m->wakeup_by_nice[i] = *src->wakeup_by_nice[i];
+    }
+}
+
+void snapshot_apply(const sim_snapshot *snap, sim_t *s, uint64_t *t, uint64_t *done) {
+    const snapshot_header *h = &snap->hdr;
+    cpu_manager *cm = &s->cpu;
+    if (strcmp(h->policy, s->pol->name) != 0 || h->per_cpu_rq != cm->per_cpu_rq
+        || h->num_cpu != (uint32_t)cm->n || memcmp(&h->topo, &cm->topo, sizeof(h->topo)) != 0) {
+        fprintf(stderr, "Error: the snapshot has another policy, queue layout or topology\n");
+        exit(EXIT_FAILURE);
+    }
+    for (uint64_t i = 0; i < h->nr_tasks; i++) {
+        const snapshot_task *r = &snap->tasks[i];
+        if ((r->group && (r->group >= WORKLOAD_MAX_GROUPS || !s->group_of || !s->group_of[r->group]))
+            || ((r->rq & SNAPSHOT_GROUP_RQ) && r->rq != SNAPSHOT_NONE
+                && (r->rq & ~SNAPSHOT_GROUP_RQ) >= s->nr_groups)) {
+            fprintf(stderr, "Error: the snapshot's groups do not match the workload\n");
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    pcb_t **task = xmalloc(h->nr_tasks * sizeof(*task));
+    for (uint64_t i = 0; i < h->nr_tasks; i++) {
+        task[i] = sim_pcb_alloc(s);
+        restore_task(s, task[i], &snap->tasks[i]);
+    }
+    for (uint32_t i = 0; i < h->nr_groups; i++) {
+        struct task_group *tg = &s->groups[i];
+        tg->se.vruntime = snap->groups[i].vruntime;
+        tg->placed = snap->groups[i].placed;
+        tg->cpu_time = snap->groups[i].cpu_time;
+        tg->nr_tasks = snap->groups[i].nr_tasks;
+    }
+
+    // Refill the queues while every min_vruntime is still at its floor, so
+    // placement leaves the recorded vruntimes alone, then restore them.
+    for (uint64_t i = 0; i < h->nr_tasks; i++)
+        if (snap->tasks[i].queue != SNAPSHOT_NONE)
+            s->pol->enqueue(rq_deref(s, snap->tasks[i].queue), task[i], false);
+    s->rq.min_vruntime = snap->min_vruntime[0];
+    for (int i = 0; cm->per_cpu_rq && i < cm->n; i++)
+        cm->rqs[i].min_vruntime = snap->min_vruntime[1 + i];
+    for (uint32_t i = 0; i < h->nr_groups; i++)
+        s->groups[i].rq.min_vruntime = snap->groups[i].min_vruntime;
+
+    // Young CPUs in dispatch order, then the rest of the running ones.
+    cpu_t **young = xmalloc((size_t)cm->n * sizeof(*young));
+    uint32_t nr_young = 0;
+    for (int i = 0; i < cm->n; i++) {
+        const snapshot_cpu *r = &snap->cpus[i];
+        cpu_t *c = &cm->cpu_list[i];
+        cpu_account(cm, c, r->running_time);
+        c->warmup = r->warmup;
+        c->slice_lo = r->slice_lo;
+        c->slice_hi = r->slice_hi;
+        if (r->young != SNAPSHOT_NONE) {
+            young[r->young] = c;
+            nr_young++;
+        }
+    }
+    for (uint32_t k = 0; k < nr_young; k++) {
+        const snapshot_cpu *r = &snap->cpus[young[k]->cpu_id - 1];
+        cpu_restore(cm, young[k], task[r->task], r->last_dispatch, r->victim_vruntime, true);
+    }
+    for (int i = 0; i < cm->n; i++) {
+        const snapshot_cpu *r = &snap->cpus[i];
+        if (r->task != SNAPSHOT_NONE && r->young == SNAPSHOT_NONE)
+            cpu_restore(cm, &cm->cpu_list[i], task[r->task], r->last_dispatch,
+                        r->victim_vruntime, false);
+    }
+    for (int i = 0; i < cm->n; i++) {
+        cpu_t *c = &cm->cpu_list[i];
+        if (c->running_process) cpu_slice_set(cm, c, c->slice_lo, c->slice_hi);
+    }
+    free(young);
+    cm->nr_migrations = h->nr_migrations;
+    cm->last_balance = h->last_balance;
+
+    for (uint64_t i = 0; i < h->nr_events; i++) {
+        const snapshot_event *r = &snap->events[i];
+        event_t ev = { (event_type)r->type, r->time, task[r->task],
+                       r->cpu == SNAPSHOT_NONE ? NULL : &cm->cpu_list[r->cpu] };
+        event_handle eh = event_tree_insert(&s->events, &ev);
+        if (ev.cpu && (ev.ev == EVENT_END || ev.ev == EVENT_SLEEP)) ev.cpu->end_ev = eh;
+    }
+
+    if (h->nr_locks) {
+        s->locks = calloc(h->nr_locks, sizeof(sim_lock));
+        if (!s->locks) {
+            perror("calloc");
+            exit(EXIT_FAILURE);
+        }
+        s->nr_locks = h->nr_locks;
+    }
+    const uint32_t *w = snap->waiters;
+    for (uint32_t i = 0; i < h->nr_lock_recs; i++) {
+        const snapshot_lock *r = &snap->locks[i];
+        sim_lock *l = &s->locks[r->id];
+        l->owner = r->owner == SNAPSHOT_NONE ? NULL : task[r->owner];
+        for (uint32_t k = 0; k < r->nr_waiters; k++, w++) {
+            pcb_t *p = task[*w];
+            p->wait_next = NULL;
+            if (l->wait_tail) l->wait_tail->wait_next = p;
+            else              l->wait_head = p;
+            l->wait_tail = p;
+        }
+    }
+    free(task);
+
+    restore_metrics(s->metrics, &snap->metrics);
+    *t = h->time;
+    *done = h->done;
+}
@@ -0,0 +1,123 @@
+#define _DEFAULT_SOURCE             // clock_gettime
+#include <stdio.h>
+#include <stdlib.h>
+#include "sweep.h"
+#include "clock.h"
+#include "pool.h"
+#include "snapshot.h"
+
+typedef struct {
+    const workload_set *set;
+    sim_params          params;
+    const sim_snapshot *snap;
+
+    // filled in by the job
+    uint64_t tasks, makespan, events, context_switches, migrations, migration_cost;
+    double   response_mean, waiting_mean, turnaround_mean, wakeup_mean;
+    uint64_t response_p99, waiting_p99, turnaround_p99, wakeup_p99;
+    double   avg_utilization, jain;
+    uint64_t wall_ns;
+} sweep_job;
+
+static void sweep_job_run(void *arg) {
+    sweep_job *j = arg;
+    metrics_t *m = malloc(sizeof(*m));
+    if (!m) {
+        perror("malloc");
+        exit(EXIT_FAILURE);
+    }
+    trace_t trace;
+    trace_open(&trace, TRACE_OFF, NULL);
+    metrics_init(m, NULL);
+
+    uint64_t t0 = clock_ns();
+    sim_t sim;
+    sim_init(&sim, &j->params, &trace, m);
+    if (j->snap) sim_resume_set(&sim, j->set, j->snap);
+    else         sim_run_set(&sim, j->set);
+    sim_destroy(&sim);
+    j->wall_ns = clock_ns() - t0;
+
+    j->tasks            = m->tasks;
+    j->makespan         = m->makespan;
+    j->events           = m->events;
+    j->context_switches = m->context_switches;
+    j->migrations       = m->migrations;
+    j->migration_cost   = m->migration_cost;
+    j->response_mean    = hist_mean(&m->response);
+    j->waiting_mean     = hist_mean(&m->waiting);
+    j->turnaround_mean  = hist_mean(&m->turnaround);
+    j->response_p99     = hist_percentile(&m->response, 0.99);
+    j->waiting_p99      = hist_percentile(&m->waiting, 0.99);
+    j->turnaround_p99   = hist_percentile(&m->turnaround, 0.99);
+    j->wakeup_mean      = hist_mean(&m->wakeup);
+    j->wakeup_p99       = hist_percentile(&m->wakeup, 0.99);
+    j->avg_utilization  = metrics_avg_utilization(m);
+    j->jain             = metrics_jain(m);
+
+    metrics_destroy(m);
+    free(m);
+}
+
+void sweep_run(const sweep_spec *spec, FILE *out) {
+    workload_set *sets = malloc((size_t)spec->num_paths * sizeof(workload_set));
+    int ncpu = spec->num_cpus ? spec->num_cpus : 1;
+    int npol = spec->num_policies ? spec->num_policies : 1;
+    size_t njobs = (size_t)spec->num_paths * npol * spec->num_latencies
+                 * spec->num_granularities * ncpu;
+    sweep_job *jobs = malloc(njobs * sizeof(sweep_job));
+    if (!sets || !jobs) {
+        perror("malloc");
+        exit(EXIT_FAILURE);
+    }
+    for (int w = 0; w < spec->num_paths; w++)
+        workload_load(&sets[w], spec->paths[w]);
+
+    pool_t pool;
+    pool_init(&pool, spec->threads);
+    size_t n = 0;
+    for (int w = 0; w < spec->num_paths; w++)
+        for (int p = 0; p < npol; p++)
+            for (int l = 0; l < spec->num_latencies; l++)
+                for (int g = 0; g < spec->num_granularities; g++)
+                    for (int c = 0; c < ncpu; c++) {
+                        sweep_job *j = &jobs[n++];
+                        j->set = &sets[w];
+                        j->params = spec->base;
+                        j->snap = spec->snap;
+                        if (spec->num_policies) j->params.policy = spec->policies[p];
+                        j->params.tun.sched_latency   = spec->latencies[l];
+                        j->params.tun.min_granularity = spec->granularities[g];
+                        // Without --cpus, the topology's count (0 without one: the workload's).
+                        j->params.num_cpu = spec->num_cpus ? (uint32_t)spec->cpus[c]
+                                                           : (uint32_t)topology_cpus(&j->params.topo);
+                        pool_submit(&pool, sweep_job_run, j);
+                    }
+    pool_wait(&pool);
+    pool_destroy(&pool);
+
+    fprintf(out, "workload,policy,cpus,latency,granularity,tasks,makespan,events,context_switches,"
+                 "migrations,migration_cost,response_mean,response_p99,waiting_mean,waiting_p99,"
+                 "turnaround_mean,turnaround_p99,wakeup_mean,wakeup_p99,"
+                 "avg_utilization,jain_fairness,wall_ms\n");
+    for (size_t i = 0; i < njobs; i++) {
+        const sweep_job *j = &jobs[i];
+        fprintf(out, "%s,%s,%u,%llu,%llu,%llu,%llu,%llu,%llu,%llu,%llu,%.3f,%llu,%.3f,%llu,%.3f,%llu,%.3f,%llu,%.6f,%.6f,%.3f\n",
+                j->set->path, j->params.policy->name, j->params.num_cpu ? j->params.num_cpu : j->set->num_cpu,
+                (unsigned long long)j->params.tun.sched_latency,
+                (unsigned long long)j->params.tun.min_granularity,
+                (unsigned long long)j->tasks, (unsigned long long)j->makespan,
+                (unsigned long long)j->events, (unsigned long long)j->context_switches,
+                (unsigned long long)j->migrations, (unsigned long long)j->migration_cost,
+                j->response_mean, (unsigned long long)j->response_p99,
+                j->waiting_mean, (unsigned long long)j->waiting_p99,
+                j->turnaround_mean, (unsigned long long)j->turnaround_p99,
+                j->wakeup_mean, (unsigned long long)j->wakeup_p99,
+                j->avg_utilization, j->jain, j->wall_ns / 1e6);
+    }
+
+    for (int w = 0; w < spec->num_paths; w++)
+        workload_set_free(&sets[w]);
+    free(sets);
+    free(jobs);
+}
@@ -0,0 +1,49 @@
+#include <stdlib.h>
+#include "topology.h"
+
+const char *const topo_level_name[TOPO_LEVELS] = { "same", "smt", "llc", "node", "remote" };
+
+bool topology_parse(const char *spec, cpu_topology *t) {
+    uint32_t v[4];
+    const char *p = spec;
+    for (int i = 0; i < 4; i++) {
+        char *end;
+        unsigned long x = strtoul(p, &end, 10);
+        if (end == p || x == 0 || x > UINT16_MAX) return false;
+        if (*end != (i < 3 ? 'x' : '\0')) return false;
+        v[i] = (uint32_t)x;
+        p = end + 1;
+    }
+    *t = (cpu_topology){ v[0], v[1], v[2], v[3] };
+    return true;
+}
+
+void topology_flat(cpu_topology *t, uint32_t n) {
+    *t = (cpu_topology){ 1, 1, n, 1 };
+}
+
+// Number of CPUs in a level-l domain.
+static uint32_t domain_size(const cpu_topology *t, topo_level l) {
+    switch (l) {
+    case TOPO_SAME:   return 1;
+    case TOPO_SMT:    return t->threads;
+    case TOPO_LLC:    return t->threads * t->cores;
+    case TOPO_NODE:   return t->threads * t->cores * t->llcs;
+    default:          return (uint32_t)topology_cpus(t);
+    }
+}
+
+topo_level topology_distance(const cpu_topology *t, uint32_t a, uint32_t b) {
+    for (topo_level l = TOPO_SAME; l < TOPO_REMOTE; l++) {
+        uint32_t size = domain_size(t, l);
+        if (a / size == b / size) return l;
+    }
+    return TOPO_REMOTE;
+}
+
+void topology_domain(const cpu_topology *t, uint32_t cpu, topo_level l,
+                     uint32_t *lo, uint32_t *hi) {
+    uint32_t size = domain_size(t, l);
+    *lo = cpu / size * size;
+    *hi = *lo + size;
+}
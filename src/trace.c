@@ -0,0 +1,362 @@
+#define _DEFAULT_SOURCE             // nanosleep, sched_yield
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sched.h>
+#include <time.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include "trace.h"
+
+#define TRACE_RING_RECS   (1u << 16)    // 1 MiB ring, power of two
+#define TRACE_BATCH_RECS  (1u << 12)    // writer waits for this many unless closing
+#define TRACE_IDLE_NSEC   100000L
+
+static void write_all(int fd, const void *buf, size_t len) {
+    const char *p = buf;
+    while (len > 0) {
+        ssize_t n = write(fd, p, len);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            perror("write");
+            exit(EXIT_FAILURE);
+        }
+        p += n;
+        len -= (size_t)n;
+    }
+}
+
+/*
+ * The binary ring is single-producer/single-consumer. The simulator only
+ * ever advances head and the writer only ever advances tail, so each side
+ * needs just an acquire load of the other's index; no locks are taken on
+ * the hot path.
+ */
+static void *trace_writer(void *arg) {
+    trace_t *tr = arg;
+    const struct timespec idle = { 0, TRACE_IDLE_NSEC };
+    size_t t = atomic_load_explicit(&tr->tail, memory_order_relaxed);
+    while (1) {
+        // closing is read first: once it is set, head already holds the last record
+        bool closing = atomic_load_explicit(&tr->closing, memory_order_acquire);
+        size_t h = atomic_load_explicit(&tr->head, memory_order_acquire);
+        if (h == t && closing) break;
+        if (h - t < TRACE_BATCH_RECS && !closing) {
+            nanosleep(&idle, NULL);
+            continue;
+        }
+        // Write up to the wrap point; the rest goes out on the next pass.
+        size_t off = t & (TRACE_RING_RECS - 1);
+        size_t n = h - t;
+        if (n > TRACE_RING_RECS - off) n = TRACE_RING_RECS - off;
+        if (tr->mode == TRACE_CHROME) {
+            for (size_t i = 0; i < n; i++) trace_chrome(&tr->chrome, &tr->ring[off + i]);
+        } else {
+            write_all(tr->fd, &tr->ring[off], n * sizeof(trace_rec));
+        }
+        t += n;
+        atomic_store_explicit(&tr->tail, t, memory_order_release);
+    }
+    return NULL;
+}
+
+void trace_open(trace_t *tr, trace_mode mode, const char *path) {
+    tr->mode = mode;
+    tr->ring = NULL;
+    if (mode != TRACE_BINARY && mode != TRACE_CHROME) return;
+
+    tr->fd = strcmp(path, "-") == 0 ? STDOUT_FILENO
+                                   : open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (tr->fd < 0) {
+        perror("open");
+        exit(EXIT_FAILURE);
+    }
+    if (mode == TRACE_CHROME) {
+        FILE *out = tr->fd == STDOUT_FILENO ? stdout : fdopen(tr->fd, "w");
+        if (!out) {
+            perror("fdopen");
+            exit(EXIT_FAILURE);
+        }
+        setvbuf(out, NULL, _IOFBF, 1 << 20);
+        trace_chrome_begin(&tr->chrome, out);
+    } else {
+        trace_header h;
+        memcpy(h.magic, TRACE_MAGIC, sizeof(h.magic));
+        h.version = TRACE_VERSION;
+        h.rec_size = sizeof(trace_rec);
+        write_all(tr->fd, &h, sizeof(h));
+    }
+
+    tr->ring = malloc(TRACE_RING_RECS * sizeof(trace_rec));
+    if (!tr->ring) {
+        perror("malloc");
+        exit(EXIT_FAILURE);
+    }
+    atomic_init(&tr->head, 0);
+    atomic_init(&tr->tail, 0);
+    atomic_init(&tr->closing, false);
+    tr->tail_seen = 0;
+    if (pthread_create(&tr->writer, NULL, trace_writer, tr) != 0) {
+        fprintf(stderr, "Failed to start trace writer\n");
+        exit(EXIT_FAILURE);
+    }
+}
+
+void trace_close(trace_t *tr) {
+    if (tr->mode != TRACE_BINARY && tr->mode != TRACE_CHROME) return;
+    atomic_store_explicit(&tr->closing, true, memory_order_release);
+    pthread_join(tr->writer, NULL);
+    if (tr->mode == TRACE_CHROME) {
+        FILE *out = tr->chrome.out;
+        trace_chrome_end(&tr->chrome);
+        if ((out == stdout ? fflush(out) : fclose(out)) != 0) {
+            perror("fclose");
+            exit(EXIT_FAILURE);
+        }
+    } else if (tr->fd != STDOUT_FILENO) {
+        close(tr->fd);
+    }
+    free(tr->ring);
+    tr->ring = NULL;
+    tr->mode = TRACE_OFF;
+}
+
+static void trace_push(trace_t *tr, const trace_rec *r) {
+    size_t h = atomic_load_explicit(&tr->head, memory_order_relaxed);
+    // Only re-read tail when the cached view says the ring is full.
+    while (h - tr->tail_seen == TRACE_RING_RECS) {
+        tr->tail_seen = atomic_load_explicit(&tr->tail, memory_order_acquire);
+        if (h - tr->tail_seen == TRACE_RING_RECS) sched_yield();
+    }
+    tr->ring[h & (TRACE_RING_RECS - 1)] = *r;
+    atomic_store_explicit(&tr->head, h + 1, memory_order_release);
+}
+
+void trace_event(trace_t *tr, trace_kind kind, uint64_t time, uint32_t pid, uint32_t cpu) {
+    trace_rec r = { time, pid, (uint16_t)cpu, (uint16_t)kind };
+    if (tr->mode == TRACE_BINARY || tr->mode == TRACE_CHROME)
+        trace_push(tr, &r);
+    else if (tr->mode == TRACE_TEXT)
+        trace_format(stdout, &r, NULL);
+}
+
+void trace_migrate(trace_t *tr, uint64_t time, uint32_t pid, uint32_t from, uint32_t to) {
+    trace_rec src = { time, pid, (uint16_t)from, TRACE_MIGRATE_FROM };
+    trace_rec dst = { time, pid, (uint16_t)to,   TRACE_MIGRATE };
+    if (tr->mode == TRACE_BINARY || tr->mode == TRACE_CHROME) {
+        trace_push(tr, &src);
+        trace_push(tr, &dst);
+    } else if (tr->mode == TRACE_TEXT) {
+        uint32_t from_cpu;
+        trace_format(stdout, &src, &from_cpu);
+        trace_format(stdout, &dst, &from_cpu);
+    }
+}
+
+void trace_format(FILE *out, const trace_rec *r, uint32_t *migrate_src) {
+    unsigned long long t = r->time;
+    switch ((trace_kind)r->kind) {
+    case TRACE_ENQUEUE:
+        fprintf(out, "[t = %llu] Enqueue PID=%u \n", t, r->pid);
+        break;
+    case TRACE_ASSIGN:
+        fprintf(out, "[t = %llu] Assigned process with PID=%u to CPU %u\n", t, r->pid, r->cpu);
+        break;
+    case TRACE_STOP:
+        fprintf(out, "[t = %llu] Stopped PID=%u in CPU %u\n", t, r->pid, r->cpu);
+        break;
+    case TRACE_FINISH:
+        fprintf(out, "[t = %llu] Finish PID=%u\n", t, r->pid);
+        break;
+    case TRACE_MIGRATE_FROM:
+        if (migrate_src) *migrate_src = r->cpu;
+        break;
+    case TRACE_MIGRATE:
+        fprintf(out, "[t = %llu] Migrated PID=%u from CPU %u to CPU %u\n",
+                t, r->pid, migrate_src ? *migrate_src : 0u, r->cpu);
+        break;
+    case TRACE_DONE:
+        fprintf(out, "All done at t = %llu\n", t);
+        break;
+    case TRACE_MIGRATIONS:
+        fprintf(out, "Migrations: %llu\n", t);
+        break;
+    case TRACE_SLEEP:
+        fprintf(out, "[t = %llu] Sleep PID=%u in CPU %u\n", t, r->pid, r->cpu);
+        break;
+    case TRACE_WAKEUP:
+        fprintf(out, "[t = %llu] Wakeup PID=%u\n", t, r->pid);
+        break;
+    case TRACE_LOCK_WAIT:
+        fprintf(out, "[t = %llu] PID=%u waits for its lock in CPU %u\n", t, r->pid, r->cpu);
+        break;
+    }
+}
+
+int trace_decode(FILE *in, FILE *out, bool chrome) {
+    trace_header h;
+    if (fread(&h, sizeof(h), 1, in) != 1 || memcmp(h.magic, TRACE_MAGIC, sizeof(h.magic)) != 0
+        || h.version != TRACE_VERSION || h.rec_size != sizeof(trace_rec))
+        return -1;
+
+    static trace_rec buf[TRACE_BATCH_RECS];
+    uint32_t migrate_src = 0;
+    trace_chrome_t ct;
+    if (chrome) trace_chrome_begin(&ct, out);
+    size_t n;
+    int ret = 0;
+    while ((n = fread(buf, 1, sizeof(buf), in)) > 0) {
+        if (n % sizeof(trace_rec)) {
+            ret = -1;
+            break;
+        }
+        for (size_t i = 0; i < n / sizeof(trace_rec); i++) {
+            if (chrome) trace_chrome(&ct, &buf[i]);
+            else        trace_format(out, &buf[i], &migrate_src);
+        }
+    }
+    if (chrome) trace_chrome_end(&ct);
+    return ret || ferror(in) ? -1 : 0;
+}
+
+/* ---- Chrome trace-event JSON ---- */
+
+// Timestamps are in µs; simulated ns keep all their digits.
+static void chrome_ts(FILE *out, const char *key, uint64_t ns) {
+    fprintf(out, ",\"%s\":%llu.%03u", key, (unsigned long long)(ns / 1000), (unsigned)(ns % 1000));
+}
+
+static FILE *chrome_next(trace_chrome_t *ct) {
+    fputs(ct->first ? "\n" : ",\n", ct->out);
+    ct->first = false;
+    return ct->out;
+}
+
+static void chrome_track(trace_chrome_t *ct, uint32_t tid, const char *name) {
+    fprintf(chrome_next(ct), "{\"ph\":\"M\",\"pid\":1,\"tid\":%u,\"name\":\"thread_name\","
+                              "\"args\":{\"name\":\"%s\"}}", tid, name);
+    fprintf(chrome_next(ct), "{\"ph\":\"M\",\"pid\":1,\"tid\":%u,\"name\":\"thread_sort_index\","
+                              "\"args\":{\"sort_index\":%u}}", tid, tid);
+}
+
+// State of CPU id, naming its track the first time it shows up.
+static trace_chrome_cpu *chrome_cpu(trace_chrome_t *ct, uint32_t id) {
+    if (id >= ct->nr_cpus) {
+        uint32_t n = ct->nr_cpus ? ct->nr_cpus : 16;
+        while (n <= id) n *= 2;
+        trace_chrome_cpu *c = realloc(ct->cpus, n * sizeof(*c));
+        if (!c) {
+            perror("realloc");
+            exit(EXIT_FAILURE);
+        }
+        memset(c + ct->nr_cpus, 0, (n - ct->nr_cpus) * sizeof(*c));
+        ct->cpus = c;
+        ct->nr_cpus = n;
+    }
+    trace_chrome_cpu *c = &ct->cpus[id];
+    if (!c->named) {
+        char name[16];
+        snprintf(name, sizeof(name), "CPU %u", id);
+        chrome_track(ct, id, name);
+        c->named = true;
+    }
+    return c;
+}
+
+// Close the stint in progress on CPU id at t.
+static void chrome_slice_end(trace_chrome_t *ct, uint32_t id, uint64_t t, const char *why) {
+    trace_chrome_cpu *c = chrome_cpu(ct, id);
+    if (!c->running) return;
+    FILE *out = chrome_next(ct);
+    fprintf(out, "{\"ph\":\"X\",\"pid\":1,\"tid\":%u", id);
+    chrome_ts(out, "ts", c->start);
+    chrome_ts(out, "dur", t - c->start);
+    fprintf(out, ",\"name\":\"PID %u\",\"args\":{\"pid\":%u,\"end\":\"%s\"}}",
+            c->pid, c->pid, why);
+    c->running = false;
+}
+
+static void chrome_instant(trace_chrome_t *ct, uint32_t tid, uint64_t t, const char *name,
+                           const trace_rec *r) {
+    FILE *out = chrome_next(ct);
+    fprintf(out, "{\"ph\":\"i\",\"s\":\"t\",\"pid\":1,\"tid\":%u", tid);
+    chrome_ts(out, "ts", t);
+    fprintf(out, ",\"name\":\"%s\",\"args\":{\"pid\":%u", name, r->pid);
+    if (r->kind == TRACE_MIGRATE) fprintf(out, ",\"from\":%u", ct->migrate_src);
+    fputs("}}", out);
+}
+
+void trace_chrome_begin(trace_chrome_t *ct, FILE *out) {
+    ct->out = out;
+    ct->cpus = NULL;
+    ct->nr_cpus = 0;
+    ct->migrate_src = 0;
+    ct->first = true;
+    fputs("{\"displayTimeUnit\":\"ns\",\"traceEvents\":[", out);
+    fprintf(chrome_next(ct), "{\"ph\":\"M\",\"pid\":1,\"name\":\"process_name\","
+                              "\"args\":{\"name\":\"simulate_cfs\"}}");
+    chrome_track(ct, 0, "run queue");
+}
+
+void trace_chrome(trace_chrome_t *ct, const trace_rec *r) {
+    uint64_t t = r->time;
+    switch ((trace_kind)r->kind) {
+    case TRACE_ENQUEUE:
+        chrome_instant(ct, 0, t, "Enqueue", r);
+        break;
+    case TRACE_WAKEUP:
+        chrome_instant(ct, 0, t, "Wakeup", r);
+        break;
+    case TRACE_ASSIGN: {
+        chrome_slice_end(ct, r->cpu, t, "replaced");
+        trace_chrome_cpu *c = chrome_cpu(ct, r->cpu);
+        c->start = t;
+        c->pid = r->pid;
+        c->running = true;
+        break;
+    }
+    case TRACE_STOP:
+        chrome_slice_end(ct, r->cpu, t, "stop");
+        break;
+    case TRACE_SLEEP:
+        chrome_slice_end(ct, r->cpu, t, "sleep");
+        break;
+    case TRACE_FINISH: {
+        uint32_t id = r->cpu;
+        // Older logs leave the CPU out: look for the stint of this PID.
+        for (uint32_t i = 1; !id && i < ct->nr_cpus; i++)
+            if (ct->cpus[i].running && ct->cpus[i].pid == r->pid) id = i;
+        if (id) chrome_slice_end(ct, id, t, "finish");
+        chrome_instant(ct, id, t, "Finish", r);
+        break;
+    }
+    case TRACE_MIGRATE_FROM:
+        ct->migrate_src = r->cpu;
+        break;
+    case TRACE_MIGRATE:
+        chrome_cpu(ct, r->cpu);
+        chrome_instant(ct, r->cpu, t, "Migrated", r);
+        break;
+    case TRACE_LOCK_WAIT:
+        chrome_cpu(ct, r->cpu);
+        chrome_instant(ct, r->cpu, t, "Lock wait", r);
+        break;
+    case TRACE_DONE:
+        for (uint32_t i = 1; i < ct->nr_cpus; i++)
+            if (ct->cpus[i].running) chrome_slice_end(ct, i, t, "done");
+        break;
+    case TRACE_MIGRATIONS:
+        break;
+    }
+}
+
+void trace_chrome_end(trace_chrome_t *ct) {
+    fputs("\n]}\n", ct->out);
+    free(ct->cpus);
+    ct->cpus = NULL;
+    ct->nr_cpus = 0;
+}
@@ -0,0 +1,363 @@
+#define _DEFAULT_SOURCE
+#include "workload.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+typedef struct {
+    task_spec_t task;
+    uint64_t    seq;
+} pending_task;
+
+static int pending_cmp(const void *a, const void *b) {
+    const pending_task *x = a, *y = b;
+    if (x->task.arrival < y->task.arrival) return -1;
+    if (x->task.arrival > y->task.arrival) return  1;
+    if (x->seq < y->seq) return -1;
+    if (x->seq > y->seq) return  1;
+    return 0;
+}
+
+static void fail(const workload_t *w, const char *what) {
+    fprintf(stderr, "Error: %s in '%s'\n", what, w->path);
+    exit(EXIT_FAILURE);
+}
+
+/* ---- input bytes: the whole mapping, or a buffer refilled from fd ---- */
+
+// Keep the unread tail and top the buffer up. Returns false at end of input.
+static bool refill(workload_t *w) {
+    if (w->fd < 0) return false;
+    size_t left = (size_t)(w->end - w->cur);
+    memmove(w->buf, w->cur, left);
+    w->cur = w->buf;
+    w->end = w->buf + left;
+    ssize_t got = read(w->fd, w->buf + left, WORKLOAD_STREAM_BYTES - left);
+    if (got < 0) { perror("read"); exit(EXIT_FAILURE); }
+    w->end += got;
+    return got > 0;
+}
+
+static inline int peek_byte(workload_t *w) {
+    if (w->cur == w->end && !refill(w)) return EOF;
+    return *w->cur;
+}
+
+// Make n bytes available at cur; false if the input ends first.
+static bool need_bytes(workload_t *w, size_t n) {
+    while ((size_t)(w->end - w->cur) < n)
+        if (!refill(w)) return false;
+    return true;
+}
+
+/* ---- task groups, from either format ---- */
+
+static void add_group(workload_t *w, int64_t id, int64_t parent, int64_t shares) {
+    if (!w->group_defined) {
+        w->group_defined = calloc(WORKLOAD_MAX_GROUPS, sizeof(bool));
+        if (!w->group_defined) { perror("calloc"); exit(EXIT_FAILURE); }
+    }
+    if (id <= 0 || id >= WORKLOAD_MAX_GROUPS || w->group_defined[id])
+        fail(w, "bad or duplicate group id");
+    if (parent < 0 || parent >= WORKLOAD_MAX_GROUPS || (parent && !w->group_defined[parent]))
+        fail(w, "group parent not defined before the group");
+    if (shares < GROUP_MIN_SHARES || shares > GROUP_MAX_SHARES)
+        fail(w, "group shares out of range");
+    if ((w->num_groups & (w->num_groups - 1)) == 0) {   // grow at powers of two
+        size_t cap = w->num_groups ? 2 * (size_t)w->num_groups : 4;
+        workload_group *g = realloc(w->groups, cap * sizeof(*g));
+        if (!g) { perror("realloc"); exit(EXIT_FAILURE); }
+        w->groups = g;
+    }
+    w->groups[w->num_groups++] = (workload_group){ (uint32_t)id, (uint32_t)parent,
+                                                   (uint32_t)shares, 0 };
+    w->group_defined[id] = true;
+}
+
+static bool group_ok(const workload_t *w, int64_t group) {
+    return group == 0 || (group > 0 && group < WORKLOAD_MAX_GROUPS
+                          && w->group_defined && w->group_defined[group]);
+}
+
+/*
+ * ---- text format: "cpus n", optional "group id shares [parent]" lines,
+ *      then n lines of "pid nice arrival burst [run block [lock [group]]]" ----
+ */
+
+static void skip_space(workload_t *w) {
+    int c;
+    while ((c = peek_byte(w)) == ' ' || c == '\t' || c == '\n' || c == '\r')
+        w->cur++;
+}
+
+// True if another field follows on the current line.
+static bool more_on_line(workload_t *w) {
+    int c;
+    while ((c = peek_byte(w)) == ' ' || c == '\t' || c == '\r')
+        w->cur++;
+    return (c >= '0' && c <= '9') || c == '-' || c == '+';
+}
+
+static bool parse_int(workload_t *w, int64_t *out) {
+    skip_space(w);
+    bool neg = false;
+    int c = peek_byte(w);
+    if (c == '-' || c == '+') {
+        neg = c == '-';
+        w->cur++;
+        c = peek_byte(w);
+    }
+    if (c < '0' || c > '9') return false;
+    uint64_t v = 0;
+    while ((c = peek_byte(w)) >= '0' && c <= '9') {
+        v = v * 10 + (uint64_t)(c - '0');
+        w->cur++;
+    }
+    *out = neg ? -(int64_t)v : (int64_t)v;
+    return true;
+}
+
+static void read_text_header(workload_t *w) {
+    int64_t cpu, n;
+    if (!parse_int(w, &cpu) || !parse_int(w, &n) || n <= 0 || cpu <= 0)
+        fail(w, "invalid process count");
+    w->num_cpu = (uint32_t)cpu;
+    w->num_tasks = (uint64_t)n;
+}
+
+static void read_text_groups(workload_t *w) {
+    skip_space(w);
+    while (peek_byte(w) == 'g') {
+        for (const char *k = "group"; *k; k++, w->cur++)
+            if (peek_byte(w) != *k) fail(w, "bad group line");
+        int64_t id, shares, parent = 0;
+        bool ok = parse_int(w, &id) && parse_int(w, &shares);
+        if (ok && more_on_line(w)) ok = parse_int(w, &parent);
+        if (!ok) fail(w, "bad group line");
+        add_group(w, id, parent, shares);
+        skip_space(w);
+    }
+}
+
+static void read_text_task(workload_t *w, task_spec_t *t) {
+    int64_t pid, nice, at, bt, run = 0, block = 0, lock = -1, group = 0;
+    bool ok = parse_int(w, &pid) && parse_int(w, &nice) && parse_int(w, &at) && parse_int(w, &bt);
+    if (ok && more_on_line(w)) {
+        ok = parse_int(w, &run) && parse_int(w, &block);
+        if (ok && more_on_line(w)) ok = parse_int(w, &lock);
+        if (ok && more_on_line(w)) ok = parse_int(w, &group);
+    }
+    if (!ok || nice < -20 || nice > 19 || at < 0 || bt < 0 || run < 0 || block < 0
+        || lock < -1 || lock >= WORKLOAD_MAX_LOCKS || !group_ok(w, group)) {
+        fprintf(stderr, "Error: bad format or niceness out of range at line %llu in '%s'\n",
+                (unsigned long long)w->parsed + 2 + w->num_groups, w->path);
+        exit(EXIT_FAILURE);
+    }
+    t->pid      = (uint32_t)pid;
+    t->nice     = (int32_t)nice;
+    t->arrival  = (uint64_t)at;
+    t->burst    = (uint64_t)bt;
+    t->run      = (uint64_t)run;
+    t->block    = (uint64_t)block;
+    t->lock     = (int32_t)lock;
+    t->group    = (uint32_t)group;
+}
+
+/* ---- binary format ---- */
+
+typedef struct {
+    uint32_t pid;
+    int32_t  nice;
+    uint64_t arrival;
+    uint64_t burst;
+} task_spec_v1;
+
+static bool is_binary(workload_t *w) {
+    return need_bytes(w, sizeof(workload_bin_header))
+        && memcmp(w->cur, WORKLOAD_BIN_MAGIC, 8) == 0;
+}
+
+static void read_bin_header(workload_t *w) {
+    workload_bin_header h;
+    memcpy(&h, w->cur, sizeof(h));
+    w->cur += sizeof(h);
+    if (h.version == 1)
+        w->rec_size = sizeof(task_spec_v1);
+    else if (h.version == 2 || h.version == WORKLOAD_BIN_VERSION)
+        w->rec_size = sizeof(task_spec_t);
+    else
+        fail(w, "unsupported binary trace version");
+    if (h.num_cpu == 0 || h.num_tasks == 0)
+        fail(w, "invalid process count");
+    if (h.version >= 3) {
+        uint64_t n;
+        if (!need_bytes(w, sizeof(n))) fail(w, "truncated binary trace");
+        memcpy(&n, w->cur, sizeof(n));
+        w->cur += sizeof(n);
+        if (n >= WORKLOAD_MAX_GROUPS) fail(w, "too many groups");
+        for (uint64_t i = 0; i < n; i++) {
+            workload_group g;
+            if (!need_bytes(w, sizeof(g))) fail(w, "truncated binary trace");
+            memcpy(&g, w->cur, sizeof(g));
+            w->cur += sizeof(g);
+            add_group(w, g.id, g.parent, g.shares);
+        }
+    }
+    if (w->fd < 0 && (w->size - (size_t)(w->cur - w->base)) / w->rec_size < h.num_tasks)
+        fail(w, "truncated binary trace");
+    w->num_cpu = h.num_cpu;
+    w->num_tasks = h.num_tasks;
+}
+
+static void read_bin_task(workload_t *w, task_spec_t *t) {
+    if (!need_bytes(w, w->rec_size))
+        fail(w, "truncated binary trace");
+    if (w->rec_size == sizeof(task_spec_v1)) {
+        task_spec_v1 v1;
+        memcpy(&v1, w->cur, sizeof(v1));
+        *t = (task_spec_t){ v1.pid, v1.nice, v1.arrival, v1.burst, 0, 0, -1, 0 };
+    } else {
+        memcpy(t, w->cur, sizeof(*t));
+    }
+    w->cur += w->rec_size;
+    if (t->nice < -20 || t->nice > 19) {
+        fprintf(stderr, "Error: niceness out of range in record %llu of '%s'\n",
+                (unsigned long long)w->parsed, w->path);
+        exit(EXIT_FAILURE);
+    }
+    if (t->lock < -1 || t->lock >= WORKLOAD_MAX_LOCKS) {
+        fprintf(stderr, "Error: lock id out of range in record %llu of '%s'\n",
+                (unsigned long long)w->parsed, w->path);
+        exit(EXIT_FAILURE);
+    }
+    if (!group_ok(w, t->group)) {
+        fprintf(stderr, "Error: undefined group in record %llu of '%s'\n",
+                (unsigned long long)w->parsed, w->path);
+        exit(EXIT_FAILURE);
+    }
+}
+
+// Hand mapped pages behind the parse position back so RSS stays bounded.
+static void release_consumed(workload_t *w) {
+    if (!w->base) return;
+    long page = sysconf(_SC_PAGESIZE);
+    const unsigned char *upto = w->base + ((size_t)(w->cur - w->base) & ~(size_t)(page - 1));
+    if ((size_t)(upto - w->released) < WORKLOAD_RELEASE_BYTES) return;
+    madvise((void *)w->released, (size_t)(upto - w->released), MADV_DONTNEED);
+    w->released = upto;
+}
+
+void workload_open(workload_t *w, const char *path) {
+    memset(w, 0, sizeof(*w));
+    w->path = path;
+    w->fd = -1;
+
+    int fd = strcmp(path, "-") == 0 ? dup(STDIN_FILENO) : open(path, O_RDONLY);
+    if (fd < 0) { perror("open"); exit(EXIT_FAILURE); }
+    struct stat st;
+    if (fstat(fd, &st) != 0) { perror("fstat"); exit(EXIT_FAILURE); }
+
+    void *m = MAP_FAILED;
+    if (S_ISREG(st.st_mode) && st.st_size > 0)
+        m = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (m != MAP_FAILED) {
+        close(fd);
+        madvise(m, (size_t)st.st_size, MADV_SEQUENTIAL);
+        w->base = w->released = w->cur = m;
+        w->size = (size_t)st.st_size;
+        w->end  = w->base + w->size;
+    } else {
+        // pipes and other unmappable inputs are read through a buffer
+        w->fd  = fd;
+        w->buf = malloc(WORKLOAD_STREAM_BYTES);
+        if (!w->buf) { perror("malloc"); exit(EXIT_FAILURE); }
+        w->cur = w->end = w->buf;
+    }
+
+    w->binary = is_binary(w);
+    if (w->binary) read_bin_header(w);
+    else         { read_text_header(w); read_text_groups(w); }
+
+    if (w->num_cpu > MAX_CPU) {
+        fprintf(stderr, "Error: CPU count (%u) exceeds maximum (%d)\n", w->num_cpu, MAX_CPU);
+        exit(EXIT_FAILURE);
+    }
+    if (heap_init(&w->window, sizeof(pending_task), WORKLOAD_WINDOW, pending_cmp) != 0) {
+        perror("malloc");
+        exit(EXIT_FAILURE);
+    }
+}
+
+void workload_close(workload_t *w) {
+    heap_free(&w->window);
+    if (w->base) munmap((void *)w->base, w->size);
+    if (w->fd >= 0) close(w->fd);
+    free(w->buf);
+    free(w->groups);
+    free(w->group_defined);
+    w->groups = NULL;
+    w->group_defined = NULL;
+    w->base = w->buf = NULL;
+    w->cur = w->end = w->released = NULL;
+    w->fd = -1;
+}
+
+bool workload_next(workload_t *w, task_spec_t *out, uint64_t *seq) {
+    while (w->window.size < WORKLOAD_WINDOW && w->parsed < w->num_tasks) {
+        pending_task pt;
+        if (w->binary) read_bin_task(w, &pt.task);
+        else           read_text_task(w, &pt.task);
+        pt.seq = w->parsed++;
+        heap_push(&w->window, &pt);
+        release_consumed(w);
+    }
+    pending_task pt;
+    if (heap_pop(&w->window, &pt) != 0) return false;
+    if (w->emitted && pt.task.arrival < w->last_arrival) {
+        fprintf(stderr, "Error: task %llu in '%s' arrives more than %d tasks out of order\n",
+                (unsigned long long)pt.seq, w->path, WORKLOAD_WINDOW);
+        exit(EXIT_FAILURE);
+    }
+    w->emitted++;
+    w->last_arrival = pt.task.arrival;
+    *out = pt.task;
+    *seq = pt.seq;
+    return true;
+}
+
+/*
+ * Same-time arrivals come out of workload_next() in file order, so the
+ * index in the loaded array orders them exactly as the streamed seq would.
+ */
+void workload_load(workload_set *set, const char *path) {
+    workload_t w;
+    workload_open(&w, path);
+    set->path = path;
+    set->num_cpu = w.num_cpu;
+    set->num_tasks = w.num_tasks;
+    set->tasks = malloc((w.num_tasks ? w.num_tasks : 1) * sizeof(task_spec_t));
+    if (!set->tasks) {
+        perror("malloc");
+        exit(EXIT_FAILURE);
+    }
+    uint64_t n = 0, seq;
+    while (n < w.num_tasks && workload_next(&w, &set->tasks[n], &seq)) n++;
+    set->num_tasks = n;
+    set->groups = w.groups;         // the set keeps the group table
+    set->num_groups = w.num_groups;
+    w.groups = NULL;
+    workload_close(&w);
+}
+
+void workload_set_free(workload_set *set) {
+    free(set->tasks);
+    free(set->groups);
+    set->tasks = NULL;
+    set->groups = NULL;
+    set->num_tasks = 0;
+    set->num_groups = 0;
+}
@@ -0,0 +1,176 @@
+#!/usr/bin/env python3
+"""
+bench.py – end-to-end scaling sweep for simulate_cfs
+
+Generates a binary workload with gen_workload for every (tasks, cpus, load)
+point, runs the bench build of the simulator on it with --stats and records
+events/sec, ns per scheduling decision, peak RSS and heap allocations per
+event. Workload generation is not timed.
+
+Load is offered work per CPU: arrival rate = load * cpus / mean burst.
+CPU counts above MAX_CPU in include/workload.h are dropped from the sweep.
+
+USAGE
+  make bench
+  make bench BENCH_ARGS="--full --out base.json"
+  make bench BENCH_ARGS="--compare base.json --threshold 0.05"
+  python3 tools/bench.py --sim ./simulate_cfs_bench --gen ./gen_workload \\
+      --tasks 1e5 --cpus 1,8 --loads 0.9 --repeat 5
+
+With --compare, every point that also exists in the baseline is checked and
+the script exits with status 1 if any metric is worse by more than the
+threshold.
+"""
+
+import argparse, json, os, pathlib, platform, re, subprocess, sys, tempfile, textwrap, time
+
+ROOT = pathlib.Path(__file__).resolve().parent.parent
+QUICK_TASKS = [10**3, 10**4, 10**5, 10**6]
+FULL_TASKS = QUICK_TASKS + [10**7, 10**8]
+CPU_STEPS = [1, 4, 16, 64, 256, 1024]
+MEAN_BURST = 100
+
+# metric → True if larger is better
+METRICS = {
+    "events_per_sec":   True,
+    "ns_per_decision":  False,
+    "peak_rss_kb":      False,
+    "allocs_per_event": False,
+}
+
+def max_cpu():
+    text = (ROOT / "include" / "workload.h").read_text()
+    m = re.search(r'#define\s+MAX_CPU\s+(\d+)', text)
+    return int(m[1]) if m else 1
+
+def int_list(s):
+    return [int(float(x)) for x in s.split(",") if x]
+
+def float_list(s):
+    return [float(x) for x in s.split(",") if x]
+
+def run_point(args, tmp, tasks, cpus, load):
+    rate = load * cpus / MEAN_BURST
+    wl = pathlib.Path(tmp) / "wl.bin"
+    subprocess.run([args.gen, "-n", str(tasks), "-c", str(cpus),
+                    f"--arrival=poisson:{rate:g}", f"--burst=exp:{MEAN_BURST}",
+                    f"--seed={args.seed}", "--format=binary", "-o", str(wl)], check=True)
+    sim = [args.sim, "--stats"] + args.sim_args.split()
+    if args.log == "binary":
+        sim.append("--trace=/dev/null")
+    sim.append(str(wl))
+
+    best = None
+    for _ in range(args.repeat):
+        p = subprocess.run(sim, stdout=subprocess.DEVNULL, stderr=subprocess.PIPE,
+                           text=True, check=True)
+        st = json.loads(p.stderr.strip().splitlines()[-1])
+        if best is None or st["wall_ns"] < best["wall_ns"]:
+            best = st
+    wl.unlink()
+
+    ev = max(best["events"], 1)
+    return {
+        "tasks": tasks, "cpus": cpus, "load": load, "rate": rate,
+        "events": best["events"], "decisions": best["decisions"],
+        "wall_ns": best["wall_ns"],
+        "events_per_sec": best["events"] / (best["wall_ns"] / 1e9),
+        "ns_per_decision": best["wall_ns"] / max(best["decisions"], 1),
+        "peak_rss_kb": best["peak_rss_kb"],
+        "allocs_per_event": None if best["allocs"] is None else best["allocs"] / ev,
+    }
+
+def key(r):
+    return (r["tasks"], r["cpus"], r["load"])
+
+def compare(results, baseline, threshold):
+    base = {key(r): r for r in baseline["results"]}
+    regressions = 0
+    print(f"\n{'tasks':>10} {'cpus':>5} {'load':>5}  {'metric':<17}{'base':>14}{'now':>14}{'change':>9}")
+    for r in results:
+        b = base.get(key(r))
+        if not b:
+            continue
+        for name, higher_better in METRICS.items():
+            old, new = b.get(name), r.get(name)
+            if old is None or new is None or old == 0:
+                continue
+            change = (new - old) / old
+            worse = -change if higher_better else change
+            flag = ""
+            if worse > threshold:
+                flag = "  REGRESSION"
+                regressions += 1
+            print(f"{r['tasks']:>10} {r['cpus']:>5} {r['load']:>5}  {name:<17}"
+                  f"{old:>14.4g}{new:>14.4g}{change:>+9.1%}{flag}")
+    return regressions
+
+def main():
+    ap = argparse.ArgumentParser(
+        formatter_class=argparse.RawDescriptionHelpFormatter,
+        description=textwrap.dedent(__doc__)
+    )
+    ap.add_argument("--sim", default="./simulate_cfs_bench", help="simulator binary")
+    ap.add_argument("--gen", default="./gen_workload", help="workload generator binary")
+    ap.add_argument("--tasks", type=int_list, help="comma list of task counts")
+    ap.add_argument("--full", action="store_true", help="sweep tasks up to 1e8")
+    ap.add_argument("--cpus", type=int_list, help="comma list of CPU counts")
+    ap.add_argument("--loads", type=float_list, default=[0.5, 0.9, 1.2],
+                    help="comma list of offered loads per CPU")
+    ap.add_argument("--repeat", type=int, default=3, help="runs per point, fastest kept")
+    ap.add_argument("--seed", type=int, default=1)
+    ap.add_argument("--log", choices=["binary", "text"], default="binary",
+                    help="event log mode, discarded either way (default binary)")
+    ap.add_argument("--sim-args", default="", help="extra simulator options, e.g. '--per-cpu'")
+    ap.add_argument("--out", default="bench_results.json", help="results file")
+    ap.add_argument("--compare", help="baseline results file to check against")
+    ap.add_argument("--threshold", type=float, default=0.10,
+                    help="relative change counted as a regression (default 0.10)")
+    args = ap.parse_args()
+
+    tasks = args.tasks or (FULL_TASKS if args.full else QUICK_TASKS)
+    limit = max_cpu()
+    cpus = args.cpus or sorted({c for c in CPU_STEPS if c <= limit} | {limit})
+    cpus = [c for c in cpus if 1 <= c <= limit]
+
+    results = []
+    print(f"{'tasks':>10} {'cpus':>5} {'load':>5} {'events/s':>12} {'ns/dec':>9} "
+          f"{'rss KiB':>9} {'alloc/ev':>9}")
+    with tempfile.TemporaryDirectory() as tmp:
+        for n in tasks:
+            for c in cpus:
+                for load in args.loads:
+                    r = run_point(args, tmp, n, c, load)
+                    results.append(r)
+                    ape = "-" if r["allocs_per_event"] is None else f"{r['allocs_per_event']:.4f}"
+                    print(f"{n:>10} {c:>5} {load:>5} {r['events_per_sec']:>12.4g} "
+                          f"{r['ns_per_decision']:>9.1f} {r['peak_rss_kb']:>9} {ape:>9}",
+                          flush=True)
+
+    doc = {
+        "meta": {
+            "date": time.strftime("%Y-%m-%dT%H:%M:%S"),
+            "host": platform.node(),
+            "machine": platform.machine(),
+            "sim": os.path.basename(args.sim),
+            "sim_args": args.sim_args,
+            "log": args.log,
+            "seed": args.seed,
+            "repeat": args.repeat,
+        },
+        "results": results,
+    }
+    with open(args.out, "w", encoding="utf-8") as f:
+        json.dump(doc, f, indent=2)
+    print(f"Results → {args.out}")
+
+    if args.compare:
+        with open(args.compare, encoding="utf-8") as f:
+            baseline = json.load(f)
+        regressions = compare(results, baseline, args.threshold)
+        if regressions:
+            sys.exit(f"{regressions} regression(s) above {args.threshold:.0%}")
+        print("No regressions.")
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,38 @@
+/*
+ * decode_trace.c – turn a binary event log from `simulate_cfs --trace=FILE`
+ * back into the text log the simulator prints by default:
+ *
+ *   ./simulate_cfs --trace=run.bin input.in && ./decode_trace run.bin > run.log
+ *   python3 tools/parse_cfs.py run.log
+ *
+ * or, with --chrome, into Chrome trace-event JSON for Perfetto:
+ *
+ *   ./decode_trace --chrome run.bin > run.json
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include "trace.h"
+
+int main(int argc, char *argv[]) {
+    bool chrome = argc == 3 && strcmp(argv[1], "--chrome") == 0;
+    if (argc != 2 + chrome) {
+        fprintf(stderr, "Usage: %s [--chrome] <trace-file|->\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+    const char *path = argv[1 + chrome];
+    FILE *in = strcmp(path, "-") == 0 ? stdin : fopen(path, "rb");
+    if (!in) {
+        perror("fopen");
+        return EXIT_FAILURE;
+    }
+    static char iobuf[1 << 20];
+    setvbuf(stdout, iobuf, _IOFBF, sizeof(iobuf));
+    if (trace_decode(in, stdout, chrome) != 0) {
+        fprintf(stderr, "%s: not a valid event log\n", path);
+        return EXIT_FAILURE;
+    }
+    if (in != stdin) fclose(in);
+    return EXIT_SUCCESS;
+}
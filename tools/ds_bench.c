@@ -0,0 +1,540 @@
+/*
+ * ds_bench.c – replay container operations recorded from real runs
+ *
+ * The record build of the simulator logs every operation on the run
+ * queues, the event queue and the idle-CPU heap (include/oprec.h). This
+ * replays each of the three streams against every candidate container and
+ * prints ns/op, cache misses per op (perf counters, when the kernel allows
+ * them), bytes per element, the bytes held beyond that at the stream's
+ * peak, and whether every min/pop found the element the simulator got:
+ *
+ *   make simulate_cfs_record ds_bench
+ *   ./simulate_cfs_record --record-ops=ops.bin input.in > /dev/null
+ *   ./ds_bench --repeat=5 --json=ds.json ops.bin
+ *
+ * Built with -Wl,--wrap=malloc,--wrap=calloc,--wrap=realloc,--wrap=free so
+ * the bytes the containers hold can be counted.
+ *
+ * Candidates
+ *   rb_intrusive   RB_GENERATE tree, links in the element (cfs_rq, event_rb)
+ *   rb_generic     RBTree from src/rbtree.c: a malloc'd node per element,
+ *                  CmpOp comparator, erase by key search
+ *   heap_typed     HEAP_GENERATE heap of pointers with position handles (CPUs)
+ *   heap_bytes     heap_t from src/heap.c: byte-copying, erase by linear search
+ *   evq_wheel      event_tree on the timing wheel (event stream only)
+ *   evq_rbtree     event_tree on its red-black tree (event stream only)
+ */
+#define _GNU_SOURCE                 // malloc_usable_size, syscall
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <getopt.h>
+#include <malloc.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+#include "clock.h"
+#include "oprec.h"
+#include "rbtree.h"
+#include "rbtree_intrusive.h"
+#include "heap.h"
+#include "heap_typed.h"
+#include "event.h"
+#include "workload.h"
+
+typedef struct ds_elem {
+    uint64_t key;
+    uint64_t tie;
+    RB_ENTRY(struct ds_elem) link;
+    size_t       hidx;
+    event_handle ev;
+} ds_elem;
+
+static inline int ds_cmp(const ds_elem *a, const ds_elem *b) {
+    if (a->key != b->key) return a->key < b->key ? -1 : 1;
+    if (a->tie != b->tie) return a->tie < b->tie ? -1 : 1;
+    return 0;
+}
+
+RB_HEAD(ds_tree, ds_elem);
+RB_GENERATE(ds_tree, ds_elem, link, ds_cmp)
+HEAP_HEAD(ds_heap, ds_elem);
+HEAP_GENERATE(ds_heap, ds_elem, hidx, ds_cmp)
+
+/* ---- elements ---- */
+
+// Shared by every replay; allocated before any container is measured.
+static ds_elem *elems;
+static pcb_t   *ev_pcbs;        // event_tree candidates: the event of elems[i] is ev_pcbs[i]'s
+static cpu_t   *ev_cpus;        // END events, by CPU id
+
+static void *xcalloc(size_t n, size_t size) {
+    void *p = calloc(n ? n : 1, size);
+    if (!p) {
+        perror("calloc");
+        exit(EXIT_FAILURE);
+    }
+    return p;
+}
+
+/* ---- candidates ---- */
+
+typedef struct {
+    const char *name;
+    size_t      link_bytes;     // room the container needs inside each element
+    bool        events_only;
+    void     *(*create)(void);
+    void      (*destroy)(void *q);
+    void      (*insert)(void *q, ds_elem *e);
+    void      (*erase)(void *q, ds_elem *e);
+    ds_elem  *(*pop_min)(void *q);
+    ds_elem  *(*min)(void *q);
+    void      (*update)(void *q, ds_elem *e, uint64_t key, uint64_t tie);
+} ds_impl;
+
+static void *rbi_create(void) { struct ds_tree *t = xcalloc(1, sizeof(*t)); ds_tree_init(t); return t; }
+static void  rbi_destroy(void *q) { free(q); }
+static void  rbi_insert(void *q, ds_elem *e) { ds_tree_insert(q, e); }
+static void  rbi_erase(void *q, ds_elem *e) { ds_tree_erase(q, e); }
+static ds_elem *rbi_min(void *q) { return ds_tree_first(q); }
+static ds_elem *rbi_pop_min(void *q) {
+    ds_elem *e = ds_tree_first(q);
+    if (e) ds_tree_erase(q, e);
+    return e;
+}
+static void rbi_update(void *q, ds_elem *e, uint64_t key, uint64_t tie) {
+    ds_tree_erase(q, e);
+    e->key = key;
+    e->tie = tie;
+    ds_tree_insert(q, e);
+}
+
+static int rbg_cmp(void *a, void *b) { return ds_cmp(a, b); }
+static void *rbg_create(void) { return new_rbtree(rbg_cmp, NULL, NULL); }
+static void  rbg_destroy(void *q) { destroy_rbtree(q); }
+static void  rbg_insert(void *q, ds_elem *e) { rbtree_insert(q, e); }
+static void  rbg_erase(void *q, ds_elem *e) { rbtree_delete(q, e); }
+static ds_elem *rbg_min(void *q) {
+    RBNode *n = rb_first(q);
+    return n ? n->data : NULL;
+}
+static ds_elem *rbg_pop_min(void *q) {
+    RBNode *n = rb_first(q);
+    if (!n) return NULL;
+    ds_elem *e = n->data;
+    rbtree_erase(q, n);
+    return e;
+}
+static void rbg_update(void *q, ds_elem *e, uint64_t key, uint64_t tie) {
+    rbtree_delete(q, e);
+    e->key = key;
+    e->tie = tie;
+    rbtree_insert(q, e);
+}
+
+static void *ht_create(void) {
+    struct ds_heap *h = xcalloc(1, sizeof(*h));
+    if (ds_heap_init(h, 16) != 0) {
+        perror("malloc");
+        exit(EXIT_FAILURE);
+    }
+    return h;
+}
+static void ht_destroy(void *q) { ds_heap_free(q); free(q); }
+static void ht_insert(void *q, ds_elem *e) {
+    if (ds_heap_push(q, e) != 0) {
+        perror("realloc");
+        exit(EXIT_FAILURE);
+    }
+}
+static void ht_erase(void *q, ds_elem *e) { ds_heap_remove(q, e); }
+static ds_elem *ht_min(void *q) { return ds_heap_peek(q); }
+static ds_elem *ht_pop_min(void *q) { return ds_heap_pop(q); }
+static void ht_update(void *q, ds_elem *e, uint64_t key, uint64_t tie) {
+    e->key = key;
+    e->tie = tie;
+    ds_heap_update(q, e);
+}
+
+static int hb_cmp(const void *a, const void *b) {
+    return ds_cmp(*(ds_elem *const *)a, *(ds_elem *const *)b);
+}
+static void *hb_create(void) {
+    heap_t *h = xcalloc(1, sizeof(*h));
+    if (heap_init(h, sizeof(ds_elem *), 16, hb_cmp) != 0) {
+        perror("malloc");
+        exit(EXIT_FAILURE);
+    }
+    return h;
+}
+static void hb_destroy(void *q) { heap_free(q); free(q); }
+static void hb_insert(void *q, ds_elem *e) {
+    if (heap_push(q, &e) != 0) {
+        perror("realloc");
+        exit(EXIT_FAILURE);
+    }
+}
+static void hb_erase(void *q, ds_elem *e) { heap_remove(q, &e); }
+static ds_elem *hb_min(void *q) {
+    ds_elem *e;
+    return heap_peek(q, &e) == 0 ? e : NULL;
+}
+static ds_elem *hb_pop_min(void *q) {
+    ds_elem *e;
+    return heap_pop(q, &e) == 0 ? e : NULL;
+}
+static void hb_update(void *q, ds_elem *e, uint64_t key, uint64_t tie) {
+    e->key = key;       // the search compares e with itself, so it still finds it
+    e->tie = tie;
+    heap_remove(q, &e);
+    hb_insert(q, e);
+}
+
+/*
+ * The event queue itself. The tie the recorder wrote is ev_cmp()'s: the
+ * rank in the top byte, then the task's seq for arrivals and wakeups or
+ * the CPU id for ENDs, so the fake tasks and CPUs order exactly the same.
+ */
+static const event_type rank_type[] = { EVENT_END, EVENT_WAKEUP, EVENT_ARRIVAL };
+#define TIE_LOW(tie) ((tie) & ((1ULL << 56) - 1))
+
+static void *evq_create(evq_backend b) {
+    event_tree *et = xcalloc(1, sizeof(*et));
+    event_tree_init(et, b);
+    return et;
+}
+static void *evw_create(void) { return evq_create(EVQ_WHEEL); }
+static void *evr_create(void) { return evq_create(EVQ_RBTREE); }
+static void  evq_destroy(void *q) { event_tree_destroy(q); free(q); }
+static void  evq_insert(void *q, ds_elem *e) {
+    pcb_t *p = &ev_pcbs[e - elems];
+    event_type type = rank_type[e->tie >> 56];
+    p->seq = TIE_LOW(e->tie);
+    event_t ev = { type, e->key, p, type == EVENT_END ? &ev_cpus[TIE_LOW(e->tie)] : NULL };
+    e->ev = event_tree_insert(q, &ev);
+}
+static void evq_erase(void *q, ds_elem *e) { event_cancel(q, e->ev); }
+static ds_elem *evq_min(void *q) {
+    event_t ev;
+    return event_tree_peek(q, &ev) ? &elems[ev.proc - ev_pcbs] : NULL;
+}
+static ds_elem *evq_pop_min(void *q) {
+    event_t ev;
+    return event_tree_pop(q, &ev) ? &elems[ev.proc - ev_pcbs] : NULL;
+}
+static void evq_update(void *q, ds_elem *e, uint64_t key, uint64_t tie) {
+    e->key = key;
+    e->tie = tie;
+    event_move(q, e->ev, key);
+}
+
+static const ds_impl impls[] = {
+    { "rb_intrusive", sizeof(((ds_elem *)0)->link), false, rbi_create, rbi_destroy,
+      rbi_insert, rbi_erase, rbi_pop_min, rbi_min, rbi_update },
+    { "rb_generic", sizeof(void *), false, rbg_create, rbg_destroy,
+      rbg_insert, rbg_erase, rbg_pop_min, rbg_min, rbg_update },
+    { "heap_typed", sizeof(size_t), false, ht_create, ht_destroy,
+      ht_insert, ht_erase, ht_pop_min, ht_min, ht_update },
+    { "heap_bytes", 0, false, hb_create, hb_destroy,
+      hb_insert, hb_erase, hb_pop_min, hb_min, hb_update },
+    { "evq_wheel", sizeof(event_handle), true, evw_create, evq_destroy,
+      evq_insert, evq_erase, evq_pop_min, evq_min, evq_update },
+    { "evq_rbtree", sizeof(event_handle), true, evr_create, evq_destroy,
+      evq_insert, evq_erase, evq_pop_min, evq_min, evq_update },
+};
+#define NR_IMPLS (sizeof(impls) / sizeof(impls[0]))
+
+/* ---- streams ---- */
+
+typedef struct {
+    oprec   *ops;
+    size_t   n;
+    size_t   cap;
+    uint32_t nr_queues;
+    uint32_t nr_elems;
+    size_t   peak_at;       // ops before the most elements are queued
+    size_t   peak;
+} stream;
+
+static const char *kind_name[OPQ_KINDS] = { "run", "event", "cpu" };
+
+static void load(const char *path, stream st[OPQ_KINDS]) {
+    FILE *f = fopen(path, "rb");
+    if (!f) {
+        perror("fopen");
+        exit(EXIT_FAILURE);
+    }
+    oprec_header h;
+    if (fread(&h, sizeof(h), 1, f) != 1 || memcmp(h.magic, OPREC_MAGIC, sizeof(OPREC_MAGIC)) != 0
+        || h.version != OPREC_VERSION || h.rec_size != sizeof(oprec)) {
+        fprintf(stderr, "%s: not a version %d operation record\n", path, OPREC_VERSION);
+        exit(EXIT_FAILURE);
+    }
+    static oprec buf[4096];
+    size_t got;
+    while ((got = fread(buf, sizeof(oprec), 4096, f)) > 0) {
+        for (size_t i = 0; i < got; i++) {
+            if (buf[i].kind >= OPQ_KINDS || buf[i].op > OP_UPDATE) {
+                fprintf(stderr, "%s: corrupt record\n", path);
+                exit(EXIT_FAILURE);
+            }
+            stream *s = &st[buf[i].kind];
+            if (s->n == s->cap) {
+                s->cap = s->cap ? s->cap * 2 : 4096;
+                s->ops = realloc(s->ops, s->cap * sizeof(oprec));
+                if (!s->ops) {
+                    perror("realloc");
+                    exit(EXIT_FAILURE);
+                }
+            }
+            s->ops[s->n++] = buf[i];
+            if (buf[i].queue >= s->nr_queues) s->nr_queues = buf[i].queue + 1u;
+            if (buf[i].id >= s->nr_elems) s->nr_elems = buf[i].id + 1;
+        }
+    }
+    fclose(f);
+
+    for (int k = 0; k < OPQ_KINDS; k++) {
+        size_t live = 0;
+        for (size_t i = 0; i < st[k].n; i++) {
+            uint8_t op = st[k].ops[i].op;
+            if (op == OP_INSERT) live++;
+            else if (op == OP_ERASE || op == OP_POP_MIN) live--;
+            if (live > st[k].peak) {
+                st[k].peak = live;
+                st[k].peak_at = i + 1;
+            }
+        }
+    }
+}
+
+/* ---- measurement ---- */
+
+// Bytes the containers have allocated, while counting is on.
+static bool   counting;
+static size_t live_bytes;
+
+void *__real_malloc(size_t size);
+void *__real_calloc(size_t n, size_t size);
+void *__real_realloc(void *ptr, size_t size);
+void  __real_free(void *ptr);
+
+void *__wrap_malloc(size_t size) {
+    void *p = __real_malloc(size);
+    if (counting && p) live_bytes += malloc_usable_size(p);
+    return p;
+}
+
+void *__wrap_calloc(size_t n, size_t size) {
+    void *p = __real_calloc(n, size);
+    if (counting && p) live_bytes += malloc_usable_size(p);
+    return p;
+}
+
+void *__wrap_realloc(void *ptr, size_t size) {
+    size_t old = counting && ptr ? malloc_usable_size(ptr) : 0;
+    void *p = __real_realloc(ptr, size);
+    if (counting && p) live_bytes += malloc_usable_size(p) - old;
+    return p;
+}
+
+void __wrap_free(void *ptr) {
+    if (counting && ptr) live_bytes -= malloc_usable_size(ptr);
+    __real_free(ptr);
+}
+
+// Cache misses of this thread in user space; -1 if perf events are not allowed.
+static int perf_open(void) {
+    struct perf_event_attr a;
+    memset(&a, 0, sizeof(a));
+    a.type = PERF_TYPE_HARDWARE;
+    a.size = sizeof(a);
+    a.config = PERF_COUNT_HW_CACHE_MISSES;
+    a.disabled = 1;
+    a.exclude_kernel = 1;
+    a.exclude_hv = 1;
+    return (int)syscall(SYS_perf_event_open, &a, 0, -1, -1, 0);
+}
+
+typedef struct {
+    uint64_t ns;
+    uint64_t misses;
+    size_t   mismatches;    // min/pop results other than the recorded element
+    size_t   empty_bytes;   // held by the containers before the first op
+    size_t   peak_bytes;    // held after the last op
+} replay_result;
+
+// Runs the first stop ops; with count set, also the bytes held on the way.
+static replay_result replay(const ds_impl *im, const stream *s, size_t stop, int perf_fd,
+                            bool count) {
+    replay_result r = { 0, 0, 0, 0, 0 };
+    void **q = xcalloc(s->nr_queues, sizeof(*q));
+    live_bytes = 0;
+    counting = count;
+    for (uint32_t i = 0; i < s->nr_queues; i++) q[i] = im->create();
+    r.empty_bytes = live_bytes;
+    if (perf_fd >= 0) {
+        ioctl(perf_fd, PERF_EVENT_IOC_RESET, 0);
+        ioctl(perf_fd, PERF_EVENT_IOC_ENABLE, 0);
+    }
+    uint64_t t0 = clock_ns();
+    for (size_t i = 0; i < stop; i++) {
+        const oprec *o = &s->ops[i];
+        ds_elem *e = &elems[o->id];
+        void *c = q[o->queue];
+        switch (o->op) {
+        case OP_INSERT:
+            e->key = o->key;
+            e->tie = o->tie;
+            im->insert(c, e);
+            break;
+        case OP_ERASE:   im->erase(c, e); break;
+        case OP_POP_MIN: r.mismatches += im->pop_min(c) != e; break;
+        case OP_MIN:     r.mismatches += im->min(c) != e; break;
+        case OP_UPDATE:  im->update(c, e, o->key, o->tie); break;
+        }
+    }
+    r.ns = clock_ns() - t0;
+    if (perf_fd >= 0) {
+        ioctl(perf_fd, PERF_EVENT_IOC_DISABLE, 0);
+        if (read(perf_fd, &r.misses, sizeof(r.misses)) != sizeof(r.misses)) r.misses = 0;
+    }
+    r.peak_bytes = live_bytes;
+    for (uint32_t i = 0; i < s->nr_queues; i++) im->destroy(q[i]);
+    counting = false;
+    free(q);
+    return r;
+}
+
+/*
+ * Bytes each further element costs: the links inside it plus the slope of
+ * the bytes held between FILL_LO and FILL_HI elements in one queue. Both are
+ * multiples of the event slab and of every doubling array's capacity, so
+ * neither slabs nor array slack skew it.
+ */
+#define FILL_LO (1u << 14)
+#define FILL_HI (1u << 15)
+
+static double elem_bytes(const ds_impl *im) {
+    live_bytes = 0;
+    counting = true;
+    void *q = im->create();
+    size_t at_lo = 0;
+    for (uint32_t i = 0; i < FILL_HI; i++) {
+        if (i == FILL_LO) at_lo = live_bytes;
+        ds_elem *e = &elems[i];
+        e->key = (uint64_t)i * 1000;
+        e->tie = 2ULL << 56 | i;     // an arrival, for the event queue
+        im->insert(q, e);
+    }
+    size_t at_hi = live_bytes;
+    im->destroy(q);
+    counting = false;
+    return (double)im->link_bytes + (double)(at_hi - at_lo) / (FILL_HI - FILL_LO);
+}
+
+static void usage(const char *prog) {
+    fprintf(stderr, "Usage: %s [--repeat=N] [--json=FILE] <ops-file>\n", prog);
+}
+
+int main(int argc, char *argv[]) {
+    static const struct option long_opts[] = {
+        { "repeat", required_argument, NULL, 'r' },
+        { "json",   required_argument, NULL, 'j' },
+        { NULL,     0,                 NULL,  0  }
+    };
+    int repeat = 3;
+    const char *json_path = NULL;
+    int opt;
+    while ((opt = getopt_long(argc, argv, "r:j:", long_opts, NULL)) != -1) {
+        switch (opt) {
+        case 'r': repeat = atoi(optarg); break;
+        case 'j': json_path = optarg; break;
+        default:  usage(argv[0]); return EXIT_FAILURE;
+        }
+    }
+    if (optind != argc - 1 || repeat < 1) {
+        usage(argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    stream st[OPQ_KINDS];
+    memset(st, 0, sizeof(st));
+    load(argv[optind], st);
+    uint32_t max_elems = FILL_HI;
+    for (int k = 0; k < OPQ_KINDS; k++)
+        if (st[k].nr_elems > max_elems) max_elems = st[k].nr_elems;
+    elems = xcalloc(max_elems, sizeof(*elems));
+    ev_pcbs = xcalloc(max_elems, sizeof(*ev_pcbs));
+    ev_cpus = xcalloc(MAX_CPU + 1, sizeof(*ev_cpus));
+
+    int perf_fd = perf_open();
+    FILE *json = NULL;
+    if (json_path) {
+        json = fopen(json_path, "w");
+        if (!json) {
+            perror("fopen");
+            return EXIT_FAILURE;
+        }
+        fprintf(json, "[");
+    }
+    bool first_row = true;
+    printf("%-6s %-13s %10s %6s %7s %10s %10s %10s %9s %9s  %s\n",
+           "queue", "container", "ops", "queues", "peak", "ns/op", "misses/op", "bytes/elem",
+           "fixed KB", "slack KB", "check");
+    for (int k = 0; k < OPQ_KINDS; k++) {
+        const stream *s = &st[k];
+        if (s->n == 0) continue;
+        for (size_t i = 0; i < NR_IMPLS; i++) {
+            const ds_impl *im = &impls[i];
+            if (im->events_only && k != OPQ_EVENT) continue;
+            replay_result best = replay(im, s, s->n, perf_fd, false);
+            for (int r = 1; r < repeat; r++) {
+                replay_result x = replay(im, s, s->n, perf_fd, false);
+                if (x.ns < best.ns) {
+                    best.ns = x.ns;
+                    best.misses = x.misses;
+                }
+            }
+            replay_result mem = replay(im, s, s->peak_at, -1, true);
+            double ns_op = (double)best.ns / (double)s->n;
+            double bytes = elem_bytes(im);
+            // slabs and array capacity held at the peak beyond bytes/elem
+            double slack = (double)(mem.peak_bytes - mem.empty_bytes)
+                         - (bytes - (double)im->link_bytes) * (double)s->peak;
+            if (slack < 0) slack = 0;
+            char misses[32] = "n/a";
+            if (perf_fd >= 0) snprintf(misses, sizeof(misses), "%.3f", (double)best.misses / (double)s->n);
+            printf("%-6s %-13s %10zu %6u %7zu %10.2f %10s %10.1f %9.1f %9.1f  %s\n",
+                   kind_name[k], im->name, s->n, s->nr_queues, s->peak, ns_op, misses, bytes,
+                   (double)mem.empty_bytes / 1024, slack / 1024,
+                   best.mismatches ? "MISMATCH" : "ok");
+            if (json) {
+                fprintf(json, "%s\n  {\"queue\": \"%s\", \"container\": \"%s\", \"ops\": %zu, "
+                              "\"queues\": %u, \"peak\": %zu, \"ns_per_op\": %.3f, "
+                              "\"misses_per_op\": ",
+                        first_row ? "" : ",", kind_name[k], im->name, s->n, s->nr_queues,
+                        s->peak, ns_op);
+                if (perf_fd >= 0) fprintf(json, "%.4f", (double)best.misses / (double)s->n);
+                else              fprintf(json, "null");
+                fprintf(json, ", \"bytes_per_elem\": %.1f, \"fixed_bytes\": %zu, "
+                              "\"slack_bytes\": %.0f, \"mismatches\": %zu}",
+                        bytes, mem.empty_bytes, slack, best.mismatches);
+                first_row = false;
+            }
+        }
+    }
+    if (json) {
+        fprintf(json, "\n]\n");
+        fclose(json);
+    }
+    if (perf_fd >= 0) close(perf_fd);
+    for (int k = 0; k < OPQ_KINDS; k++) free(st[k].ops);
+    free(elems);
+    free(ev_pcbs);
+    free(ev_cpus);
+    return EXIT_SUCCESS;
+}
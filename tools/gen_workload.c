@@ -0,0 +1,352 @@
+/*
+ * gen_workload.c – synthetic workload generator for simulate_cfs
+ *
+ * Emits `cpus n` + `pid nice arrival burst [run block [lock [group]]]` lines, or the
+ * binary trace from include/workload.h, in arrival order. The same seed always produces the
+ * same workload, and "-o -" (the default) lets it feed the simulator directly:
+ *
+ *   ./gen_workload -n 1000000 -c 8 --arrival=poisson:0.05 --burst=pareto:1.5,20 \
+ *       | ./simulate_cfs -
+ *
+ * Distributions
+ *   --arrival  poisson:RATE          exponential gaps, RATE tasks per ns
+ *              bursty:RATE,SIZE      bursts of geometric(SIZE) tasks sharing one
+ *                                    arrival time, bursts Poisson at RATE/SIZE
+ *   --burst    fixed:V | uniform:MIN,MAX | exp:MEAN
+ *              pareto:ALPHA,MIN      heavy tail
+ *              lognormal:MU,SIGMA
+ *   --nice     uniform | fixed:N | mix:N=W,N=W,...   (weights need not sum to 1)
+ *   --io       FRAC:RUN,BLOCK        FRAC of the tasks alternate CPU and sleep;
+ *                                    per task run ~ exp(RUN), block ~ exp(BLOCK)
+ *   --locks    FRAC:N                FRAC of the tasks hold one of N locks
+ *                                    through every run phase
+ *   --groups   SHARES:FRAC,...       one task group per entry, under the root;
+ *                                    FRAC of the tasks join it, the rest none
+ */
+#define _DEFAULT_SOURCE             // M_PI
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <math.h>
+#include <getopt.h>
+#include "workload.h"
+
+/* ---- xoshiro256** seeded through splitmix64 ---- */
+
+typedef struct { uint64_t s[4]; } rng_t;
+
+static uint64_t splitmix64(uint64_t *x) {
+    uint64_t z = (*x += 0x9e3779b97f4a7c15ULL);
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+    return z ^ (z >> 31);
+}
+
+static void rng_seed(rng_t *r, uint64_t seed) {
+    for (int i = 0; i < 4; i++) r->s[i] = splitmix64(&seed);
+}
+
+static inline uint64_t rotl(uint64_t x, int k) { return (x << k) | (x >> (64 - k)); }
+
+static uint64_t rng_next(rng_t *r) {
+    uint64_t *s = r->s;
+    uint64_t result = rotl(s[1] * 5, 7) * 9;
+    uint64_t t = s[1] << 17;
+    s[2] ^= s[0]; s[3] ^= s[1]; s[1] ^= s[2]; s[0] ^= s[3];
+    s[2] ^= t;
+    s[3] = rotl(s[3], 45);
+    return result;
+}
+
+// Uniform in (0, 1], safe for log()
+static double rng_unit(rng_t *r) {
+    return ((rng_next(r) >> 11) + 1) * (1.0 / 9007199254740992.0);
+}
+
+static double rng_exp(rng_t *r, double mean) { return -log(rng_unit(r)) * mean; }
+
+static double rng_normal(rng_t *r) {
+    return sqrt(-2.0 * log(rng_unit(r))) * cos(2.0 * M_PI * rng_unit(r));
+}
+
+/* ---- distributions ---- */
+
+#define GEN_MAX_GROUPS 64
+
+typedef enum { ARR_POISSON, ARR_BURSTY } arrival_kind;
+typedef enum { BURST_FIXED, BURST_UNIFORM, BURST_EXP, BURST_PARETO, BURST_LOGNORMAL } burst_kind;
+
+typedef struct {
+    arrival_kind arrival;
+    double       rate, burst_size;
+    burst_kind   burst;
+    double       b1, b2;
+    double       nice_weight[40];   // index nice + 20; all zero means uniform
+    double       io_frac, io_run, io_block;
+    double       lock_frac;
+    unsigned     nr_locks;
+    unsigned     nr_groups;
+    uint32_t     group_shares[GEN_MAX_GROUPS];
+    double       group_frac[GEN_MAX_GROUPS];
+} dist_t;
+
+static void die(const char *msg, const char *arg) {
+    fprintf(stderr, "gen_workload: %s '%s'\n", msg, arg);
+    exit(EXIT_FAILURE);
+}
+
+static void parse_arrival(dist_t *d, const char *s) {
+    if (sscanf(s, "poisson:%lf", &d->rate) == 1 && d->rate > 0) {
+        d->arrival = ARR_POISSON;
+    } else if (sscanf(s, "bursty:%lf,%lf", &d->rate, &d->burst_size) == 2
+               && d->rate > 0 && d->burst_size >= 1) {
+        d->arrival = ARR_BURSTY;
+    } else {
+        die("bad --arrival", s);
+    }
+}
+
+static void parse_burst(dist_t *d, const char *s) {
+    if      (sscanf(s, "fixed:%lf", &d->b1) == 1)                 d->burst = BURST_FIXED;
+    else if (sscanf(s, "uniform:%lf,%lf", &d->b1, &d->b2) == 2)   d->burst = BURST_UNIFORM;
+    else if (sscanf(s, "exp:%lf", &d->b1) == 1)                   d->burst = BURST_EXP;
+    else if (sscanf(s, "pareto:%lf,%lf", &d->b1, &d->b2) == 2)    d->burst = BURST_PARETO;
+    else if (sscanf(s, "lognormal:%lf,%lf", &d->b1, &d->b2) == 2) d->burst = BURST_LOGNORMAL;
+    else die("bad --burst", s);
+}
+
+static void parse_nice(dist_t *d, const char *s) {
+    memset(d->nice_weight, 0, sizeof(d->nice_weight));
+    if (strcmp(s, "uniform") == 0) return;
+    int n;
+    if (sscanf(s, "fixed:%d", &n) == 1) {
+        if (n < -20 || n > 19) die("nice out of range in", s);
+        d->nice_weight[n + 20] = 1;
+        return;
+    }
+    if (strncmp(s, "mix:", 4) != 0) die("bad --nice", s);
+    const char *p = s + 4;
+    while (*p) {
+        double wgt;
+        int used;
+        if (sscanf(p, "%d=%lf%n", &n, &wgt, &used) != 2 || n < -20 || n > 19 || wgt < 0)
+            die("bad --nice", s);
+        d->nice_weight[n + 20] += wgt;
+        p += used;
+        if (*p == ',') p++;
+    }
+}
+
+static void parse_io(dist_t *d, const char *s) {
+    if (sscanf(s, "%lf:%lf,%lf", &d->io_frac, &d->io_run, &d->io_block) != 3
+        || d->io_frac < 0 || d->io_frac > 1 || d->io_run < 1 || d->io_block < 0)
+        die("bad --io", s);
+}
+
+static void parse_locks(dist_t *d, const char *s) {
+    if (sscanf(s, "%lf:%u", &d->lock_frac, &d->nr_locks) != 2
+        || d->lock_frac < 0 || d->lock_frac > 1 || d->nr_locks == 0
+        || d->nr_locks > WORKLOAD_MAX_LOCKS)
+        die("bad --locks", s);
+}
+
+static void parse_groups(dist_t *d, const char *s) {
+    const char *p = s;
+    double total = 0;
+    d->nr_groups = 0;
+    while (*p) {
+        unsigned shares;
+        double frac;
+        int used;
+        if (d->nr_groups == GEN_MAX_GROUPS
+            || sscanf(p, "%u:%lf%n", &shares, &frac, &used) != 2
+            || shares < GROUP_MIN_SHARES || shares > GROUP_MAX_SHARES || frac < 0)
+            die("bad --groups", s);
+        d->group_shares[d->nr_groups] = shares;
+        d->group_frac[d->nr_groups++] = frac;
+        total += frac;
+        p += used;
+        if (*p == ',') p++;
+    }
+    if (d->nr_groups == 0 || total > 1 + 1e-9) die("bad --groups", s);
+}
+
+static int draw_nice(const dist_t *d, rng_t *r) {
+    double total = 0;
+    for (int i = 0; i < 40; i++) total += d->nice_weight[i];
+    if (total <= 0) return (int)(rng_next(r) % 40) - 20;
+    double x = rng_unit(r) * total;
+    for (int i = 0; i < 40; i++) {
+        if (x <= d->nice_weight[i]) return i - 20;
+        x -= d->nice_weight[i];
+    }
+    return 19;
+}
+
+static uint64_t draw_burst(const dist_t *d, rng_t *r) {
+    double v;
+    switch (d->burst) {
+    case BURST_FIXED:     v = d->b1; break;
+    case BURST_UNIFORM:   v = d->b1 + (d->b2 - d->b1) * rng_unit(r); break;
+    case BURST_EXP:       v = rng_exp(r, d->b1); break;
+    case BURST_PARETO:    v = d->b2 / pow(rng_unit(r), 1.0 / d->b1); break;
+    case BURST_LOGNORMAL: v = exp(d->b1 + d->b2 * rng_normal(r)); break;
+    default:              v = 1; break;
+    }
+    if (!(v >= 1)) return 1;                    // also catches NaN
+    if (v > 1e18) return (uint64_t)1e18;
+    return (uint64_t)v;
+}
+
+// Phases and lock; the generator is only consulted for options that are set,
+// so workloads without them come out exactly as before.
+static void draw_phases(const dist_t *d, rng_t *r, task_spec_t *t) {
+    t->run = t->block = 0;
+    t->lock = -1;
+    t->group = 0;
+    if (d->io_frac > 0 && rng_unit(r) <= d->io_frac) {
+        double run = rng_exp(r, d->io_run);
+        t->run   = run < 1 ? 1 : (uint64_t)run;
+        t->block = (uint64_t)rng_exp(r, d->io_block);
+    }
+    if (d->lock_frac > 0 && rng_unit(r) <= d->lock_frac)
+        t->lock = (int32_t)(rng_next(r) % d->nr_locks);
+}
+
+static void draw_group(const dist_t *d, rng_t *r, task_spec_t *t) {
+    if (d->nr_groups == 0) return;
+    double x = rng_unit(r);
+    for (unsigned i = 0; i < d->nr_groups; i++) {
+        if (x <= d->group_frac[i]) {
+            t->group = i + 1;
+            return;
+        }
+        x -= d->group_frac[i];
+    }
+}
+
+/* ---- output ---- */
+
+static void usage(const char *prog) {
+    fprintf(stderr,
+        "Usage: %s -n TASKS -c CPUS [--arrival=DIST] [--burst=DIST] [--nice=DIST]\n"
+        "          [--io=FRAC:RUN,BLOCK] [--locks=FRAC:N] [--groups=SHARES:FRAC,...]\n"
+        "          [--seed=N] [--format=text|binary] [-o FILE|-]\n", prog);
+}
+
+int main(int argc, char *argv[]) {
+    static const struct option long_opts[] = {
+        { "tasks",   required_argument, NULL, 'n' },
+        { "cpus",    required_argument, NULL, 'c' },
+        { "arrival", required_argument, NULL, 'a' },
+        { "burst",   required_argument, NULL, 'b' },
+        { "nice",    required_argument, NULL, 'N' },
+        { "io",      required_argument, NULL, 'i' },
+        { "locks",   required_argument, NULL, 'l' },
+        { "groups",  required_argument, NULL, 'g' },
+        { "seed",    required_argument, NULL, 's' },
+        { "format",  required_argument, NULL, 'f' },
+        { "output",  required_argument, NULL, 'o' },
+        { NULL,      0,                 NULL,  0  }
+    };
+    uint64_t n = 0, seed = 1;
+    unsigned cpus = 0;
+    bool binary = false;
+    const char *out_path = "-";
+    dist_t d;
+    memset(&d, 0, sizeof(d));
+    d.arrival = ARR_POISSON; d.rate = 0.01;
+    d.burst = BURST_EXP;     d.b1 = 100;
+
+    int opt;
+    while ((opt = getopt_long(argc, argv, "n:c:a:b:N:i:l:g:s:f:o:", long_opts, NULL)) != -1) {
+        switch (opt) {
+        case 'n': n = strtoull(optarg, NULL, 10); break;
+        case 'c': cpus = (unsigned)strtoul(optarg, NULL, 10); break;
+        case 'a': parse_arrival(&d, optarg); break;
+        case 'b': parse_burst(&d, optarg); break;
+        case 'N': parse_nice(&d, optarg); break;
+        case 'i': parse_io(&d, optarg); break;
+        case 'l': parse_locks(&d, optarg); break;
+        case 'g': parse_groups(&d, optarg); break;
+        case 's': seed = strtoull(optarg, NULL, 10); break;
+        case 'f':
+            if (strcmp(optarg, "text") == 0)        binary = false;
+            else if (strcmp(optarg, "binary") == 0) binary = true;
+            else die("bad --format", optarg);
+            break;
+        case 'o': out_path = optarg; break;
+        default:  usage(argv[0]); return EXIT_FAILURE;
+        }
+    }
+    if (n == 0 || cpus == 0 || optind != argc) {
+        usage(argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    FILE *out = strcmp(out_path, "-") == 0 ? stdout : fopen(out_path, binary ? "wb" : "w");
+    if (!out) { perror("fopen"); return EXIT_FAILURE; }
+    static char iobuf[1 << 20];
+    setvbuf(out, iobuf, _IOFBF, sizeof(iobuf));
+
+    if (binary) {
+        workload_bin_header h;
+        memcpy(h.magic, WORKLOAD_BIN_MAGIC, 8);
+        h.version = WORKLOAD_BIN_VERSION;
+        h.num_cpu = cpus;
+        h.num_tasks = n;
+        fwrite(&h, sizeof(h), 1, out);
+        uint64_t nr_groups = d.nr_groups;
+        fwrite(&nr_groups, sizeof(nr_groups), 1, out);
+        for (unsigned i = 0; i < d.nr_groups; i++) {
+            workload_group g = { i + 1, 0, d.group_shares[i], 0 };
+            fwrite(&g, sizeof(g), 1, out);
+        }
+    } else {
+        fprintf(out, "%u %llu\n", cpus, (unsigned long long)n);
+        for (unsigned i = 0; i < d.nr_groups; i++)
+            fprintf(out, "group %u %u\n", i + 1, d.group_shares[i]);
+    }
+
+    rng_t r;
+    rng_seed(&r, seed);
+    double clock = 0;
+    uint64_t left_in_burst = 0;
+    for (uint64_t i = 0; i < n; i++) {
+        if (d.arrival == ARR_POISSON) {
+            if (i) clock += rng_exp(&r, 1.0 / d.rate);
+        } else if (left_in_burst == 0) {
+            if (i) clock += rng_exp(&r, d.burst_size / d.rate);
+            // geometric burst length with mean burst_size
+            left_in_burst = 1;
+            while (rng_unit(&r) > 1.0 / d.burst_size) left_in_burst++;
+        }
+        if (left_in_burst) left_in_burst--;
+
+        task_spec_t t;
+        t.pid     = (uint32_t)(i + 1);
+        t.nice    = draw_nice(&d, &r);
+        t.arrival = (uint64_t)clock;
+        t.burst   = draw_burst(&d, &r);
+        draw_phases(&d, &r, &t);
+        draw_group(&d, &r, &t);
+        if (binary) {
+            fwrite(&t, sizeof(t), 1, out);
+            continue;
+        }
+        fprintf(out, "%u %d %llu %llu", t.pid, t.nice,
+                (unsigned long long)t.arrival, (unsigned long long)t.burst);
+        if (t.run || t.lock >= 0 || t.group)
+            fprintf(out, " %llu %llu", (unsigned long long)t.run, (unsigned long long)t.block);
+        if (t.lock >= 0 || t.group)
+            fprintf(out, " %d", t.lock);
+        if (t.group)
+            fprintf(out, " %u", t.group);
+        fputc('\n', out);
+    }
+
+    if (fclose(out) != 0) { perror("fclose"); return EXIT_FAILURE; }
+    return EXIT_SUCCESS;
+}
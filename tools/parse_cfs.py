@@ -6,6 +6,7 @@ from logs in format:
   [t = 0] Enqueue PID=2
   [t = 0] Assigned process with PID=2 to CPU 1
   [t = 200] Stopped PID=2 in CPU 1
+  [t = 300] Sleep PID=2 in CPU 1
   [t = 400] Finish PID=2
 
 USAGE
@@ -16,7 +17,7 @@ import re, csv, argparse, sys, statistics, textwrap, collections, pathlib
 
 _RE_ENQ    = re.compile(r'\[t\s*=\s*(\d+)] Enqueue PID=(\d+)')
 _RE_ASSIGN = re.compile(r'\[t\s*=\s*(\d+)] Assigned process with PID=(\d+) to CPU (\d+)')
-_RE_STOP   = re.compile(r'\[t\s*=\s*(\d+)] Stopped PID=(\d+) in CPU (\d+)')
+_RE_STOP   = re.compile(r'\[t\s*=\s*(\d+)] (?:Stopped|Sleep) PID=(\d+) in CPU (\d+)')
 _RE_FINISH = re.compile(r'\[t\s*=\s*(\d+)] Finish PID=(\d+)')
 
 def parse_log(path: str):